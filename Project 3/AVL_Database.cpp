@@ -5,15 +5,21 @@ Description:
              • This file implements an AVL Tree and an Indexed Database using the AVL Tree.
              • The AVL Tree ensures self-balancing during insertions and deletions, maintaining a height of O(log n).
              • The Indexed Database is a wrapper around the AVL Tree, providing additional functionality such as range queries and database clearing.
+             • An optional write buffer absorbs inserts and deletes and merges them into the tree in bulk.
+             • An optional hot-key cache answers repeated searches without descending the tree.
+             • The Compact AVL Tree keeps 16-byte nodes with 2-bit balance factors in one array.
+             • The Versioned Database keeps every committed version readable by path copying.
 */
 
 #include "AVL_Database.hpp"
 #include <algorithm>
 #include <cmath>
+#include <stdexcept>
 
 Record::Record(const std::string& k, int v) : key(k), value(v) {}
 
-AVLNode::AVLNode(Record* r) : record(r), left(nullptr), right(nullptr), height(1) {}
+AVLNode::AVLNode(Record* r)
+    : record(r), left(nullptr), right(nullptr), height(1), count(1), sum(r->value) {}
 
 AVLTree::AVLTree() : root(nullptr), nodeCount(0), searchComparisonCount(0) {}
 
@@ -27,6 +33,21 @@ void AVLTree::updateHeight(AVLNode* node) {
     }
 }
 
+// Recomputes a node's subtree count and sum from its children.
+void AVLTree::updateAggregates(AVLNode* node) {
+    if (!node) return;
+    node->count = 1;
+    node->sum = node->record->value;
+    if (node->left) {
+        node->count += node->left->count;
+        node->sum += node->left->sum;
+    }
+    if (node->right) {
+        node->count += node->right->count;
+        node->sum += node->right->sum;
+    }
+}
+
 int AVLTree::getBalance(AVLNode* node) {
     return node ? height(node->left) - height(node->right) : 0;
 }
@@ -41,6 +62,8 @@ AVLNode* AVLTree::rotateRight(AVLNode* y) {
 
     updateHeight(y);
     updateHeight(x);
+    updateAggregates(y);
+    updateAggregates(x);
 
     return x;
 }
@@ -55,6 +78,8 @@ AVLNode* AVLTree::rotateLeft(AVLNode* x) {
 
     updateHeight(x);
     updateHeight(y);
+    updateAggregates(x);
+    updateAggregates(y);
 
     return y;
 }
@@ -80,8 +105,9 @@ AVLNode* AVLTree::insertHelper(AVLNode* node, Record* record) {
     else 
         return node;                                                                    // Duplicate values not allowed
 
-    // Update height of current node
+    // Update height and aggregates of current node
     updateHeight(node);
+    updateAggregates(node);
 
     // Get balance factor to check if rebalancing is needed
     int balance = getBalance(node);
@@ -152,6 +178,7 @@ AVLNode* AVLTree::deleteHelper(AVLNode* node, const std::string& key, int value)
 
     // Update height and balance the tree
     updateHeight(node);
+    updateAggregates(node);
     int balance = getBalance(node);
 
                                                                    // Handle imbalances
@@ -205,19 +232,654 @@ AVLNode* AVLTree::searchHelper(AVLNode* node, const std::string& key, int value)
     return searchHelper(node->right, key, value);
 }
 
+// Finds the node holding a value, whatever its key.
+AVLNode* AVLTree::findValue(int value) const {
+    AVLNode* node = root;
+    while (node && node->record->value != value)
+        node = value < node->record->value ? node->left : node->right;
+    return node;
+}
+
+// Finds the node with the smallest value not below value.
+AVLNode* AVLTree::ceilingNode(long long value) const {
+    AVLNode* best = nullptr;
+    for (AVLNode* node = root; node;) {
+        if (node->record->value >= value) {
+            best = node;
+            node = node->left;
+        } else {
+            node = node->right;
+        }
+    }
+    return best;
+}
+
+// Finds the node with the largest value not above value.
+AVLNode* AVLTree::floorNode(long long value) const {
+    AVLNode* best = nullptr;
+    for (AVLNode* node = root; node;) {
+        if (node->record->value <= value) {
+            best = node;
+            node = node->right;
+        } else {
+            node = node->left;
+        }
+    }
+    return best;
+}
+
+// Adds up count and sum of the values not above limit, one root-to-leaf walk.
+void AVLTree::prefixAggregate(long long limit, int& count, long long& sum) const {
+    count = 0;
+    sum = 0;
+    for (AVLNode* node = root; node;) {
+        if (node->record->value <= limit) {
+            count += 1 + (node->left ? node->left->count : 0);
+            sum += node->record->value + (node->left ? node->left->sum : 0);
+            node = node->right;
+        } else {
+            node = node->left;
+        }
+    }
+}
+
+// Appends the nodes of a subtree in order.
+void AVLTree::collectNodes(AVLNode* node, std::vector<AVLNode*>& nodes) const {
+    if (!node) return;
+    collectNodes(node->left, nodes);
+    nodes.push_back(node);
+    collectNodes(node->right, nodes);
+}
+
+// Links nodes[begin, end), already in order, into a perfectly balanced subtree.
+AVLNode* AVLTree::buildBalanced(std::vector<AVLNode*>& nodes, size_t begin, size_t end) {
+    if (begin == end) return nullptr;
+    size_t middle = begin + (end - begin) / 2;
+    AVLNode* node = nodes[middle];
+    node->left = buildBalanced(nodes, begin, middle);
+    node->right = buildBalanced(nodes, middle + 1, end);
+    updateHeight(node);
+    updateAggregates(node);
+    return node;
+}
+
+// Hashes a key to the 32 bits a compact node keeps of it.
+static uint32_t hashKey(const std::string& key) {
+    uint32_t hash = 2166136261u;                                                        // FNV-1a
+    for (size_t i = 0; i < key.size(); i++)
+        hash = (hash ^ static_cast<unsigned char>(key[i])) * 16777619u;
+    return hash;
+}
+
+CompactAVLTree::CompactAVLTree() : nodes(1), records(1), root(0), freeList(0), nodeCount(0) {}
+
+int CompactAVLTree::balance(uint32_t node) const {
+    return static_cast<int>(nodes[node].right >> 31) - static_cast<int>(nodes[node].left >> 31);
+}
+
+void CompactAVLTree::setBalance(uint32_t node, int balance) {
+    nodes[node].left = (nodes[node].left & INDEX) | (balance < 0 ? HEAVY : 0);
+    nodes[node].right = (nodes[node].right & INDEX) | (balance > 0 ? HEAVY : 0);
+}
+
+// Takes a node slot for a record, reusing a freed one if there is one.
+uint32_t CompactAVLTree::allocate(Record* record, uint32_t keyHash) {
+    uint32_t node = freeList;
+    if (node) {
+        freeList = nodes[node].left;
+    } else {
+        node = static_cast<uint32_t>(nodes.size());
+        nodes.push_back(CompactNode());
+        records.push_back(nullptr);
+    }
+    nodes[node].value = record->value;
+    nodes[node].keyHash = keyHash;
+    nodes[node].left = nodes[node].right = 0;
+    records[node] = record;
+    nodeCount++;
+    return node;
+}
+
+void CompactAVLTree::release(uint32_t node) {
+    nodes[node].left = freeList;
+    records[node] = nullptr;
+    freeList = node;
+    nodeCount--;
+}
+
+// Rotations relink children only; callers set the balance factors they know.
+uint32_t CompactAVLTree::rotateRight(uint32_t node) {
+    uint32_t child = left(node);
+    setLeft(node, right(child));
+    setRight(child, node);
+    return child;
+}
+
+uint32_t CompactAVLTree::rotateLeft(uint32_t node) {
+    uint32_t child = right(node);
+    setRight(node, left(child));
+    setLeft(child, node);
+    return child;
+}
+
+// Rebalances a node whose left side became two taller than its right. Sets shorter if the
+// subtree ends up lower than it was while unbalanced.
+uint32_t CompactAVLTree::fixLeftHeavy(uint32_t node, bool& shorter) {
+    uint32_t child = left(node);
+    int childBalance = balance(child);
+    if (childBalance <= 0) {
+        rotateRight(node);                                                              // Left Left Case
+        setBalance(node, childBalance == 0 ? -1 : 0);
+        setBalance(child, childBalance == 0 ? 1 : 0);
+        shorter = childBalance != 0;
+        return child;
+    }
+
+    uint32_t grandchild = right(child);                                                 // Left Right Case
+    int grandchildBalance = balance(grandchild);
+    setLeft(node, rotateLeft(child));
+    rotateRight(node);
+    setBalance(node, grandchildBalance < 0 ? 1 : 0);
+    setBalance(child, grandchildBalance > 0 ? -1 : 0);
+    setBalance(grandchild, 0);
+    shorter = true;
+    return grandchild;
+}
+
+uint32_t CompactAVLTree::fixRightHeavy(uint32_t node, bool& shorter) {
+    uint32_t child = right(node);
+    int childBalance = balance(child);
+    if (childBalance >= 0) {
+        rotateLeft(node);                                                               // Right Right Case
+        setBalance(node, childBalance == 0 ? 1 : 0);
+        setBalance(child, childBalance == 0 ? -1 : 0);
+        shorter = childBalance != 0;
+        return child;
+    }
+
+    uint32_t grandchild = left(child);                                                  // Right Left Case
+    int grandchildBalance = balance(grandchild);
+    setRight(node, rotateRight(child));
+    rotateLeft(node);
+    setBalance(node, grandchildBalance > 0 ? -1 : 0);
+    setBalance(child, grandchildBalance < 0 ? 1 : 0);
+    setBalance(grandchild, 0);
+    shorter = true;
+    return grandchild;
+}
+
+// Updates a node after its left subtree lost a level; shorter tells whether it lost one too.
+uint32_t CompactAVLTree::leftShrunk(uint32_t node, bool& shorter) {
+    int nodeBalance = balance(node);
+    if (nodeBalance < 0) {
+        setBalance(node, 0);
+        shorter = true;
+        return node;
+    }
+    if (nodeBalance == 0) {
+        setBalance(node, 1);
+        shorter = false;
+        return node;
+    }
+    return fixRightHeavy(node, shorter);
+}
+
+uint32_t CompactAVLTree::rightShrunk(uint32_t node, bool& shorter) {
+    int nodeBalance = balance(node);
+    if (nodeBalance > 0) {
+        setBalance(node, 0);
+        shorter = true;
+        return node;
+    }
+    if (nodeBalance == 0) {
+        setBalance(node, -1);
+        shorter = false;
+        return node;
+    }
+    return fixLeftHeavy(node, shorter);
+}
+
+// Inserts a Record into the compact tree.
+void CompactAVLTree::insert(Record* record) {
+    bool taller = false;
+    root = insertHelper(root, record, hashKey(record->key), taller);
+}
+
+// Inserts below node, setting taller if the subtree gained a level.
+uint32_t CompactAVLTree::insertHelper(uint32_t node, Record* record, uint32_t keyHash, bool& taller) {
+    if (!node) {
+        taller = true;
+        return allocate(record, keyHash);
+    }
+
+    bool unused;
+    if (record->value < nodes[node].value) {
+        uint32_t child = insertHelper(left(node), record, keyHash, taller);
+        setLeft(node, child);
+        if (!taller) return node;
+        int nodeBalance = balance(node);
+        taller = nodeBalance == 0;
+        if (nodeBalance >= 0) {
+            setBalance(node, nodeBalance - 1);
+            return node;
+        }
+        return fixLeftHeavy(node, unused);
+    } else if (record->value > nodes[node].value) {
+        uint32_t child = insertHelper(right(node), record, keyHash, taller);
+        setRight(node, child);
+        if (!taller) return node;
+        int nodeBalance = balance(node);
+        taller = nodeBalance == 0;
+        if (nodeBalance <= 0) {
+            setBalance(node, nodeBalance + 1);
+            return node;
+        }
+        return fixRightHeavy(node, unused);
+    }
+
+    taller = false;
+    return node;                                                                        // Duplicate values not allowed
+}
+
+// Searches the compact tree; only the final node's record is read.
+Record* CompactAVLTree::search(const std::string& key, int value) const {
+    uint32_t node = root;
+    while (node) {
+        const CompactNode& current = nodes[node];
+        if (value == current.value) {
+            if (current.keyHash == hashKey(key) && records[node]->key == key)
+                return records[node];
+            return nullptr;
+        }
+        node = (value < current.value ? current.left : current.right) & INDEX;
+    }
+    return nullptr;
+}
+
+// Deletes the record with the given key and value from the compact tree.
+void CompactAVLTree::deleteNode(const std::string& key, int value) {
+    bool shorter = false;
+    root = deleteHelper(root, key, hashKey(key), value, shorter);
+}
+
+// Deletes below node, setting shorter if the subtree lost a level.
+uint32_t CompactAVLTree::deleteHelper(uint32_t node, const std::string& key, uint32_t keyHash, int value,
+                                      bool& shorter) {
+    if (!node) {
+        shorter = false;
+        return 0;
+    }
+
+    if (value < nodes[node].value) {
+        setLeft(node, deleteHelper(left(node), key, keyHash, value, shorter));
+        return shorter ? leftShrunk(node, shorter) : node;
+    }
+    if (value > nodes[node].value) {
+        setRight(node, deleteHelper(right(node), key, keyHash, value, shorter));
+        return shorter ? rightShrunk(node, shorter) : node;
+    }
+    if (nodes[node].keyHash != keyHash || records[node]->key != key) {
+        shorter = false;
+        return node;                                                                    // Key does not match
+    }
+
+    if (!left(node) || !right(node)) {
+        uint32_t child = left(node) ? left(node) : right(node);
+        release(node);
+        shorter = true;
+        return child;
+    }
+
+    // Two children: the successor's record moves up into this node
+    uint32_t successor;
+    setRight(node, removeMin(right(node), successor, shorter));
+    nodes[node].value = nodes[successor].value;
+    nodes[node].keyHash = nodes[successor].keyHash;
+    records[node] = records[successor];
+    release(successor);
+    return shorter ? rightShrunk(node, shorter) : node;
+}
+
+// Unlinks the minimum of a subtree, returned in minimum, and rebalances on the way up.
+uint32_t CompactAVLTree::removeMin(uint32_t node, uint32_t& minimum, bool& shorter) {
+    if (!left(node)) {
+        minimum = node;
+        shorter = true;
+        return right(node);
+    }
+    setLeft(node, removeMin(left(node), minimum, shorter));
+    return shorter ? leftShrunk(node, shorter) : node;
+}
+
+// Returns the height of a subtree, clearing valid if a balance factor or the order is wrong.
+int CompactAVLTree::heightOf(uint32_t node, bool& valid) const {
+    if (!node) return 0;
+    int leftHeight = heightOf(left(node), valid);
+    int rightHeight = heightOf(right(node), valid);
+    if (rightHeight - leftHeight != balance(node) ||
+        (left(node) && nodes[left(node)].value >= nodes[node].value) ||
+        (right(node) && nodes[right(node)].value <= nodes[node].value))
+        valid = false;
+    return 1 + std::max(leftHeight, rightHeight);
+}
+
+int CompactAVLTree::getHeight() const {
+    bool valid = true;
+    return heightOf(root, valid);
+}
+
+bool CompactAVLTree::isBalanced() const {
+    bool valid = true;
+    heightOf(root, valid);
+    return valid;
+}
+
+WriteBuffer::WriteBuffer() : sortedValid(true) {}
+
+// Records an insert (record set) or a delete of key (record nullptr) for value.
+void WriteBuffer::add(int value, Record* record, const std::string& key) {
+    int index = static_cast<int>(ops.size());
+    std::unordered_map<int, int>::iterator found = first.find(value);
+    PendingOp op;
+    op.record = record;
+    if (!record) op.key = key;
+    op.next = -1;
+    op.last = index;
+    if (found != first.end()) {
+        PendingOp& head = ops[found->second];
+        ops[head.last].next = index;                                                    // Append to the value's chain
+        head.last = index;
+    } else {
+        first[value] = index;
+        sortedValid = false;                                                            // A new value to place
+    }
+    ops.push_back(op);
+}
+
+// Replays the buffered ops of a value, oldest first, on top of the tree's record for it.
+Record* WriteBuffer::resolve(int value, Record* current) const {
+    std::unordered_map<int, int>::const_iterator found = first.find(value);
+    if (found == first.end()) return current;
+
+    for (int i = found->second; i >= 0; i = ops[i].next) {
+        const PendingOp& op = ops[i];
+        if (op.record) {
+            if (!current) current = op.record;                                          // Existing values are kept
+        } else if (current && current->key == op.key) {
+            current = nullptr;                                                          // Tombstone
+        }
+    }
+    return current;
+}
+
+const std::vector<int>& WriteBuffer::sortedValues() const {
+    if (!sortedValid) {
+        sorted.clear();
+        sorted.reserve(first.size());
+        for (std::unordered_map<int, int>::const_iterator it = first.begin(); it != first.end(); ++it)
+            sorted.push_back(it->first);
+        std::sort(sorted.begin(), sorted.end());
+        sortedValid = true;
+    }
+    return sorted;
+}
+
+void WriteBuffer::clear() {
+    ops.clear();
+    first.clear();
+    sorted.clear();
+    sortedValid = true;
+}
+
+// Mixes a value into a well-spread hash, a different one per seed.
+static uint64_t hashValue(int value, uint64_t seed) {
+    uint64_t x = static_cast<uint32_t>(value) + seed * 0x9E3779B97F4A7C15ULL;
+    x ^= x >> 33;
+    x *= 0xFF51AFD7ED558CCDULL;
+    x ^= x >> 33;
+    return x;
+}
+
+HotCache::HotCache() : hand(0), additions(0) {
+    stats.hits = stats.misses = stats.admitted = stats.rejected = 0;
+}
+
+// Sizes the cache for capacity records, dropping its contents and statistics.
+void HotCache::reset(size_t capacity) {
+    size_t width = 1;
+    while (width < capacity) width *= 2;
+    entries.assign(capacity, Entry());
+    table.assign(capacity ? width * 2 : 0, -1);
+    sketch.assign(capacity ? width * SKETCH_ROWS : 0, 0);
+    clear();
+    stats.hits = stats.misses = stats.admitted = stats.rejected = 0;
+}
+
+size_t HotCache::slotOf(int value) const {
+    size_t mask = table.size() - 1;
+    size_t slot = hashValue(value, 0) & mask;
+    while (table[slot] >= 0 && entries[table[slot]].value != value)
+        slot = (slot + 1) & mask;
+    return slot;
+}
+
+uint8_t& HotCache::counter(int value, int row) {
+    size_t width = sketch.size() / SKETCH_ROWS;
+    return sketch[row * width + (hashValue(value, row + 1) & (width - 1))];
+}
+
+// Estimates how often value was looked up recently.
+int HotCache::frequency(int value) {
+    int estimate = 15;
+    for (int row = 0; row < SKETCH_ROWS; row++)
+        estimate = std::min(estimate, static_cast<int>(counter(value, row)));
+    return estimate;
+}
+
+// Counts a lookup, halving every counter after 10 lookups per slot so old popularity fades.
+void HotCache::recordAccess(int value) {
+    for (int row = 0; row < SKETCH_ROWS; row++) {
+        uint8_t& count = counter(value, row);
+        if (count < 15) count++;
+    }
+    if (++additions >= 10 * entries.size()) {
+        for (size_t i = 0; i < sketch.size(); i++)
+            sketch[i] /= 2;
+        additions = 0;
+    }
+}
+
+// Returns the cached record for key and value, or nullptr.
+Record* HotCache::lookup(const std::string& key, int value) {
+    recordAccess(value);
+    int index = table[slotOf(value)];
+    if (index >= 0 && entries[index].record->key == key) {
+        entries[index].referenced = true;
+        stats.hits++;
+        return entries[index].record;
+    }
+    stats.misses++;
+    return nullptr;
+}
+
+// Caches a record unless the CLOCK victim is looked up at least as often.
+void HotCache::admit(Record* record) {
+    size_t slot = slotOf(record->value);
+    if (table[slot] >= 0) return;
+
+    while (entries[hand].record && entries[hand].referenced) {
+        entries[hand].referenced = false;                                               // Second chance
+        hand = (hand + 1) % entries.size();
+    }
+    Entry& victim = entries[hand];
+    if (victim.record) {
+        if (frequency(record->value) <= frequency(victim.value)) {
+            stats.rejected++;                                                           // The hand stays on the victim
+            return;
+        }
+        unlink(slotOf(victim.value));
+        slot = slotOf(record->value);                                                   // The unlink may have moved the probe's end
+    }
+    victim.record = record;
+    victim.value = record->value;
+    victim.referenced = false;
+    table[slot] = static_cast<int>(hand);
+    hand = (hand + 1) % entries.size();
+    stats.admitted++;
+}
+
+// Empties a table slot, shifting later entries of the probe sequence back into the gap.
+void HotCache::unlink(size_t slot) {
+    size_t mask = table.size() - 1;
+    size_t hole = slot;
+    for (size_t next = (slot + 1) & mask; table[next] >= 0; next = (next + 1) & mask) {
+        size_t home = hashValue(entries[table[next]].value, 0) & mask;
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            table[hole] = table[next];
+            hole = next;
+        }
+    }
+    table[hole] = -1;
+}
+
+// Drops the record cached for value, if any.
+void HotCache::erase(int value) {
+    if (!enabled()) return;
+    size_t slot = slotOf(value);
+    int index = table[slot];
+    if (index < 0) return;
+    unlink(slot);
+    entries[index].record = nullptr;
+    entries[index].referenced = false;
+}
+
+void HotCache::clear() {
+    std::fill(entries.begin(), entries.end(), Entry());
+    std::fill(table.begin(), table.end(), -1);
+    std::fill(sketch.begin(), sketch.end(), 0);
+    hand = 0;
+    additions = 0;
+}
+
+IndexedDatabase::IndexedDatabase() : buffered(false), bufferLimit(0), mergeCount(0) {}
+
 // Provides a database-like interface over the AVL Tree.
 void IndexedDatabase::insert(Record* record) {
-    index.insert(record);
+    if (buffered) {
+        buffer.add(record->value, record, record->key);
+        mergeIfFull();
+    } else {
+        index.insert(record);
+    }
 }
 
 // Searches for a Record in the Indexed Database.
 Record* IndexedDatabase::search(const std::string& key, int value) {
-    return index.search(key, value);
+    Record* record = find(key, value);
+    return record ? record : new Record("", 0);                                         // Not found, as AVLTree::search reports it
+}
+
+// Looks up a Record, returning nullptr rather than a new empty Record if it is not there.
+Record* IndexedDatabase::find(const std::string& key, int value) {
+    if (cache.enabled()) {
+        Record* cached = cache.lookup(key, value);
+        if (cached) return cached;
+    }
+
+    AVLNode* node = index.findValue(value);
+    Record* record = node ? node->record : nullptr;
+    if (buffer.contains(value))
+        record = buffer.resolve(value, record);
+    if (!record || record->key != key)
+        return nullptr;
+    if (cache.enabled())
+        cache.admit(record);
+    return record;
+}
+
+// Checks for a Record with the given value, whatever its key, in the tree and the write buffer.
+bool IndexedDatabase::containsValue(int value) {
+    AVLNode* node = index.findValue(value);
+    Record* record = node ? node->record : nullptr;
+    if (buffer.contains(value))
+        record = buffer.resolve(value, record);
+    return record != nullptr;
 }
 
 // Deletes a Record from the Indexed Database.
 void IndexedDatabase::deleteRecord(const std::string& key, int value) {
-    index.deleteNode(key, value);
+    cache.erase(value);
+    if (buffered) {
+        buffer.add(value, nullptr, key);
+        mergeIfFull();
+    } else {
+        index.deleteNode(key, value);
+    }
+}
+
+// Turns on the write buffer. It is merged once it holds minimumEntries ops and a quarter
+// of the tree's size, so rebuilding costs O(1) amortised per buffered op.
+void IndexedDatabase::enableWriteBuffer(size_t minimumEntries) {
+    buffered = true;
+    bufferLimit = minimumEntries;
+}
+
+void IndexedDatabase::disableWriteBuffer() {
+    flushWriteBuffer();
+    buffered = false;
+}
+
+// Turns on a cache of the capacity most often searched records.
+void IndexedDatabase::enableHotCache(size_t capacity) {
+    cache.reset(capacity);
+}
+
+void IndexedDatabase::disableHotCache() {
+    cache.reset(0);
+}
+
+void IndexedDatabase::mergeIfFull() {
+    if (buffer.size() >= std::max(bufferLimit, static_cast<size_t>(index.getNodeCount()) / MERGE_RATIO))
+        flushWriteBuffer();
+}
+
+// Merges the buffer into the tree: one in-order pass over both gives the new sorted contents,
+// which are linked into a balanced tree reusing the existing nodes.
+void IndexedDatabase::flushWriteBuffer() {
+    if (buffer.empty()) return;
+
+    std::vector<AVLNode*> nodes;
+    nodes.reserve(index.getNodeCount() + buffer.size());
+    index.collectNodes(index.root, nodes);
+    const std::vector<int>& values = buffer.sortedValues();
+    std::vector<Record*> merged;
+    merged.reserve(nodes.size() + values.size());
+    size_t next = 0;
+    for (size_t i = 0; i < values.size(); i++) {
+        while (next < nodes.size() && nodes[next]->record->value < values[i])
+            merged.push_back(nodes[next++]->record);
+        Record* current = nullptr;
+        if (next < nodes.size() && nodes[next]->record->value == values[i])
+            current = nodes[next++]->record;
+        Record* result = buffer.resolve(values[i], current);
+        if (result)
+            merged.push_back(result);
+    }
+    while (next < nodes.size())
+        merged.push_back(nodes[next++]->record);
+
+    while (nodes.size() < merged.size())
+        nodes.push_back(new AVLNode(merged[nodes.size()]));
+    while (nodes.size() > merged.size()) {
+        delete nodes.back();
+        nodes.pop_back();
+    }
+    for (size_t i = 0; i < merged.size(); i++)
+        nodes[i]->record = merged[i];
+    index.root = index.buildBalanced(nodes, 0, nodes.size());
+    index.nodeCount = static_cast<int>(nodes.size());
+    buffer.clear();
+    mergeCount++;
 }
 
 // Helper function for performing range queries recursively.
@@ -238,6 +900,92 @@ void IndexedDatabase::rangeQueryHelper(AVLNode* node, int start, int end,
 std::vector<Record*> IndexedDatabase::rangeQuery(int start, int end) {
     std::vector<Record*> result;
     rangeQueryHelper(index.root, start, end, result);
+    if (buffer.empty())
+        return result;
+
+    // Merge in the buffered values of the range, both sides being sorted by value
+    const std::vector<int>& values = buffer.sortedValues();
+    std::vector<int>::const_iterator first = std::lower_bound(values.begin(), values.end(), start);
+    std::vector<int>::const_iterator last = std::upper_bound(first, values.end(), end);
+    std::vector<Record*> tree;
+    tree.swap(result);
+    size_t next = 0;
+    for (std::vector<int>::const_iterator it = first; it != last; ++it) {
+        while (next < tree.size() && tree[next]->value < *it)
+            result.push_back(tree[next++]);
+        Record* current = nullptr;
+        if (next < tree.size() && tree[next]->value == *it)
+            current = tree[next++];
+        Record* record = buffer.resolve(*it, current);
+        if (record)
+            result.push_back(record);
+    }
+    while (next < tree.size())
+        result.push_back(tree[next++]);
+    return result;
+}
+
+// Returns the count, sum, minimum and maximum of the values in [start, end] from the subtree
+// aggregates, without building the list of records: O(log n) with an empty write buffer. The b
+// buffered values in the band are folded in one tree lookup each, so a non-empty buffer makes it
+// O(log n + b log n).
+RangeAggregate IndexedDatabase::aggregateRange(int start, int end) {
+    RangeAggregate result = { 0, 0, 0, 0 };
+    if (start > end) return result;
+
+    int below;
+    long long belowSum;
+    index.prefixAggregate(static_cast<long long>(start) - 1, below, belowSum);
+    index.prefixAggregate(end, result.count, result.sum);
+    result.count -= below;
+    result.sum -= belowSum;
+
+    const std::vector<int>* values = nullptr;
+    std::vector<int>::const_iterator first, last;
+    if (!buffer.empty()) {
+        values = &buffer.sortedValues();
+        first = std::lower_bound(values->begin(), values->end(), start);
+        last = std::upper_bound(first, values->end(), end);
+        for (std::vector<int>::const_iterator it = first; it != last; ++it) {
+            AVLNode* node = index.findValue(*it);
+            bool inTree = node != nullptr;
+            bool present = buffer.resolve(*it, node ? node->record : nullptr) != nullptr;
+            if (present != inTree) {
+                result.count += present ? 1 : -1;
+                result.sum += present ? *it : -static_cast<long long>(*it);
+            }
+        }
+    }
+    if (result.count == 0) return result;
+
+    // Extremes: the tree's nearest values, skipping any the buffer deletes, against the buffer's own
+    long long low = static_cast<long long>(end) + 1, high = static_cast<long long>(start) - 1;
+    for (AVLNode* node = index.ceilingNode(start); node && node->record->value <= end;
+         node = index.ceilingNode(static_cast<long long>(node->record->value) + 1))
+        if (!buffer.contains(node->record->value) || buffer.resolve(node->record->value, node->record)) {
+            low = node->record->value;
+            break;
+        }
+    for (AVLNode* node = index.floorNode(end); node && node->record->value >= start;
+         node = index.floorNode(static_cast<long long>(node->record->value) - 1))
+        if (!buffer.contains(node->record->value) || buffer.resolve(node->record->value, node->record)) {
+            high = node->record->value;
+            break;
+        }
+    if (values) {
+        for (std::vector<int>::const_iterator it = first; it != last && *it < low; ++it)
+            if (!index.findValue(*it) && buffer.resolve(*it, nullptr)) {
+                low = *it;
+                break;
+            }
+        for (std::vector<int>::const_iterator it = last; it != first && *(it - 1) > high; --it)
+            if (!index.findValue(*(it - 1)) && buffer.resolve(*(it - 1), nullptr)) {
+                high = *(it - 1);
+                break;
+            }
+    }
+    result.minValue = static_cast<int>(low);
+    result.maxValue = static_cast<int>(high);
     return result;
 }
 
@@ -250,8 +998,16 @@ void IndexedDatabase::clearHelper(AVLNode* node) {
 }
 
 void IndexedDatabase::clearDatabase() {
+    flushWriteBuffer();
+    cache.clear();
     clearHelper(index.root);
     index.root = nullptr;
+    index.nodeCount = 0;
+}
+
+int IndexedDatabase::countRecords() {
+    flushWriteBuffer();
+    return index.getNodeCount();
 }
 
 int IndexedDatabase::calculateHeight(AVLNode* node) const {
@@ -264,6 +1020,253 @@ int IndexedDatabase::getTreeHeight() const {
 }
 
 int IndexedDatabase::getSearchComparisons(const std::string& key, int value) {
-    search(key, value);
+    flushWriteBuffer();                                                                 // Counts the descent through the tree
+    index.search(key, value);
     return index.getLastSearchComparisons();
 }
+
+VersionedDatabase::VersionedDatabase() : current(0), history(0), liveNodes(0) {
+    Version empty = { nullptr, 0, 0 };
+    versions[0] = empty;
+}
+
+VersionedDatabase::~VersionedDatabase() {
+    for (std::map<long long, Version>::iterator it = versions.begin(); it != versions.end(); ++it)
+        release(it->second.root);
+}
+
+// Helpers below take and return owned references: a node passed as left or right is
+// consumed, and a returned node carries one reference for the caller.
+VersionNode* VersionedDatabase::retain(VersionNode* node) {
+    if (node) node->refs++;
+    return node;
+}
+
+VersionNode* VersionedDatabase::make(Record* record, VersionNode* left, VersionNode* right) {
+    VersionNode* node = new VersionNode;
+    node->record = record;
+    node->left = left;
+    node->right = right;
+    node->height = 1 + std::max(height(left), height(right));
+    node->refs = 1;
+    liveNodes++;
+    return node;
+}
+
+// Drops a reference, freeing the node and releasing its children when it was the last.
+void VersionedDatabase::release(VersionNode* node) {
+    if (!node || --node->refs > 0) return;
+    release(node->left);
+    release(node->right);
+    delete node;
+    liveNodes--;
+}
+
+// Builds a node over left and right, rotating when their heights differ by two. Rotations
+// build new nodes, since the ones they would relink may be shared with older versions.
+VersionNode* VersionedDatabase::balance(Record* record, VersionNode* left, VersionNode* right) {
+    if (height(left) > height(right) + 1) {
+        Record* leftRecord = left->record;
+        VersionNode* leftLeft = retain(left->left);
+        VersionNode* leftRight = retain(left->right);
+        release(left);
+        if (height(leftLeft) >= height(leftRight))
+            return make(leftRecord, leftLeft, make(record, leftRight, right));              // Left Left Case
+
+        // Left Right Case
+        Record* middleRecord = leftRight->record;
+        VersionNode* middleLeft = retain(leftRight->left);
+        VersionNode* middleRight = retain(leftRight->right);
+        release(leftRight);
+        return make(middleRecord, make(leftRecord, leftLeft, middleLeft), make(record, middleRight, right));
+    }
+
+    if (height(right) > height(left) + 1) {
+        Record* rightRecord = right->record;
+        VersionNode* rightLeft = retain(right->left);
+        VersionNode* rightRight = retain(right->right);
+        release(right);
+        if (height(rightRight) >= height(rightLeft))
+            return make(rightRecord, make(record, left, rightLeft), rightRight);            // Right Right Case
+
+        // Right Left Case
+        Record* middleRecord = rightLeft->record;
+        VersionNode* middleLeft = retain(rightLeft->left);
+        VersionNode* middleRight = retain(rightLeft->right);
+        release(rightLeft);
+        return make(middleRecord, make(record, left, middleLeft), make(rightRecord, middleRight, rightRight));
+    }
+
+    return make(record, left, right);
+}
+
+// Copies the path to where record goes; the value must not be in the tree.
+VersionNode* VersionedDatabase::insertHelper(VersionNode* node, Record* record) {
+    if (!node)
+        return make(record, nullptr, nullptr);
+    if (record->value < node->record->value)
+        return balance(node->record, insertHelper(node->left, record), retain(node->right));
+    return balance(node->record, retain(node->left), insertHelper(node->right, record));
+}
+
+// Copies the path to value's node, leaving it out; the value must be in the tree.
+VersionNode* VersionedDatabase::deleteHelper(VersionNode* node, int value) {
+    if (value < node->record->value)
+        return balance(node->record, deleteHelper(node->left, value), retain(node->right));
+    if (value > node->record->value)
+        return balance(node->record, retain(node->left), deleteHelper(node->right, value));
+
+    if (!node->left) return retain(node->right);
+    if (!node->right) return retain(node->left);
+    Record* successor;
+    VersionNode* right = removeMin(node->right, successor);
+    return balance(successor, retain(node->left), right);
+}
+
+VersionNode* VersionedDatabase::removeMin(VersionNode* node, Record*& minimum) {
+    if (!node->left) {
+        minimum = node->record;
+        return retain(node->right);
+    }
+    return balance(node->record, removeMin(node->left, minimum), retain(node->right));
+}
+
+const VersionNode* VersionedDatabase::find(const VersionNode* node, int value) {
+    while (node && node->record->value != value)
+        node = value < node->record->value ? node->left : node->right;
+    return node;
+}
+
+void VersionedDatabase::rangeHelper(const VersionNode* node, int start, int end, std::vector<Record*>& result) {
+    if (!node) return;
+    if (start < node->record->value)
+        rangeHelper(node->left, start, end, result);
+    if (start <= node->record->value && node->record->value <= end)
+        result.push_back(node->record);
+    if (node->record->value < end)
+        rangeHelper(node->right, start, end, result);
+}
+
+// Publishes a new latest version; the caller holds the lock.
+long long VersionedDatabase::commit(VersionNode* root, int records) {
+    Version version = { root, records, 0 };
+    versions[++current] = version;
+    collect(current - history - 1);                                                     // Just left the history window
+    return current;
+}
+
+// Frees a version if nothing keeps it; the caller holds the lock.
+void VersionedDatabase::collect(long long version) {
+    std::map<long long, Version>::iterator it = versions.find(version);
+    if (it == versions.end() || it->second.pins > 0 || version >= current - history)
+        return;
+    release(it->second.root);
+    versions.erase(it);
+}
+
+VersionNode* VersionedDatabase::pin(long long version) {
+    std::lock_guard<std::mutex> guard(lock);
+    std::map<long long, Version>::iterator it = versions.find(version);
+    if (it == versions.end())
+        throw std::out_of_range("Version " + std::to_string(version) + " is no longer retained");
+    it->second.pins++;
+    return it->second.root;
+}
+
+// Inserts a Record, committing a new version unless its value is already present.
+long long VersionedDatabase::insert(Record* record) {
+    std::lock_guard<std::mutex> guard(lock);
+    const Version& latest = versions.rbegin()->second;
+    if (find(latest.root, record->value))
+        return current;                                                                 // Duplicate values not allowed
+    return commit(insertHelper(latest.root, record), latest.records + 1);
+}
+
+// Deletes the Record with the given key and value, committing a new version if there is one.
+long long VersionedDatabase::deleteRecord(const std::string& key, int value) {
+    std::lock_guard<std::mutex> guard(lock);
+    const Version& latest = versions.rbegin()->second;
+    const VersionNode* node = find(latest.root, value);
+    if (!node || node->record->key != key)
+        return current;
+    return commit(deleteHelper(latest.root, value), latest.records - 1);
+}
+
+Record* VersionedDatabase::search(const std::string& key, int value) {
+    long long version = openSnapshot();
+    Record* record = searchAsOf(version, key, value);
+    closeSnapshot(version);
+    return record;
+}
+
+std::vector<Record*> VersionedDatabase::rangeQuery(int start, int end) {
+    long long version = openSnapshot();
+    std::vector<Record*> result = asOf(version, start, end);
+    closeSnapshot(version);
+    return result;
+}
+
+std::vector<Record*> VersionedDatabase::inorderTraversal() {
+    return rangeQuery(INT_MIN, INT_MAX);
+}
+
+int VersionedDatabase::countRecords() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return versions.rbegin()->second.records;
+}
+
+long long VersionedDatabase::getVersion() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return current;
+}
+
+long long VersionedDatabase::openSnapshot() {
+    std::lock_guard<std::mutex> guard(lock);
+    versions.rbegin()->second.pins++;
+    return current;
+}
+
+void VersionedDatabase::closeSnapshot(long long version) {
+    std::lock_guard<std::mutex> guard(lock);
+    std::map<long long, Version>::iterator it = versions.find(version);
+    if (it == versions.end() || it->second.pins == 0) return;
+    it->second.pins--;
+    collect(version);
+}
+
+// Returns the records of a retained version with values in [start, end], reading it unlocked.
+std::vector<Record*> VersionedDatabase::asOf(long long version, int start, int end) {
+    const VersionNode* root = pin(version);
+    std::vector<Record*> result;
+    rangeHelper(root, start, end, result);
+    closeSnapshot(version);
+    return result;
+}
+
+Record* VersionedDatabase::searchAsOf(long long version, const std::string& key, int value) {
+    const VersionNode* node = find(pin(version), value);
+    Record* record = node && node->record->key == key ? node->record : nullptr;
+    closeSnapshot(version);
+    return record;
+}
+
+// Keeps the given number of versions before the latest readable without snapshots.
+void VersionedDatabase::retainHistory(long long count) {
+    std::lock_guard<std::mutex> guard(lock);
+    history = std::max(0LL, count);
+    std::vector<long long> expired;
+    for (std::map<long long, Version>::iterator it = versions.begin(); it != versions.end(); ++it)
+        if (it->first < current - history) expired.push_back(it->first);
+    for (size_t i = 0; i < expired.size(); i++)
+        collect(expired[i]);
+}
+
+size_t VersionedDatabase::getRetainedVersions() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return versions.size();
+}
+
+size_t VersionedDatabase::getLiveNodes() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return liveNodes;
+}
@@ -4,6 +4,11 @@
 #include <string>
 #include <vector>
 #include <queue>
+#include <unordered_map>
+#include <cstdint>
+#include <climits>
+#include <map>
+#include <mutex>
 
 class Record {
 public:
@@ -19,6 +24,8 @@ public:
     AVLNode* left;
     AVLNode* right;
     int height;
+    int count;                      // Records in this subtree
+    long long sum;                  // Sum of their values
     
     AVLNode(Record* r);
 };
@@ -32,6 +39,7 @@ private:
     int height(AVLNode* node);
     int getBalance(AVLNode* node);
     void updateHeight(AVLNode* node);
+    void updateAggregates(AVLNode* node);
     
     AVLNode* rotateRight(AVLNode* y);
     AVLNode* rotateLeft(AVLNode* x);
@@ -40,6 +48,12 @@ private:
     AVLNode* deleteHelper(AVLNode* node, const std::string& key, int value);
     AVLNode* searchHelper(AVLNode* node, const std::string& key, int value) const;
     AVLNode* minValueNode(AVLNode* node);
+    AVLNode* findValue(int value) const;
+    AVLNode* ceilingNode(long long value) const;
+    AVLNode* floorNode(long long value) const;
+    void prefixAggregate(long long limit, int& count, long long& sum) const;
+    void collectNodes(AVLNode* node, std::vector<AVLNode*>& nodes) const;
+    AVLNode* buildBalanced(std::vector<AVLNode*>& nodes, size_t begin, size_t end);
     
     friend class IndexedDatabase;
 
@@ -52,28 +66,265 @@ public:
     int getLastSearchComparisons() const { return searchComparisonCount; }
 };
 
+// Node of the compact tree: 16 bytes, four to a cache line. Children are indices into the
+// tree's node array (0 = none), and the top bit of each child field marks that side as the
+// taller one, which encodes the AVL balance factor in two bits.
+struct CompactNode {
+    int value;
+    uint32_t keyHash;               // Hash of the record's key, checked before the record is read
+    uint32_t left;
+    uint32_t right;
+};
+
+// AVL tree over CompactNode with the same rules as AVLTree (values are unique, a delete needs
+// the key to match). The records sit in an array parallel to the nodes and are only read when
+// a search reaches the node holding its value.
+class CompactAVLTree {
+private:
+    std::vector<CompactNode> nodes;                 // nodes[0] is unused, so index 0 means none
+    std::vector<Record*> records;                   // records[i] belongs to nodes[i]
+    uint32_t root;
+    uint32_t freeList;                              // Freed slots, chained through left
+    int nodeCount;
+    
+    static const uint32_t HEAVY = 0x80000000u;      // Top bit of a child field
+    static const uint32_t INDEX = 0x7FFFFFFFu;
+    
+    uint32_t left(uint32_t node) const { return nodes[node].left & INDEX; }
+    uint32_t right(uint32_t node) const { return nodes[node].right & INDEX; }
+    void setLeft(uint32_t node, uint32_t child) { nodes[node].left = (nodes[node].left & HEAVY) | child; }
+    void setRight(uint32_t node, uint32_t child) { nodes[node].right = (nodes[node].right & HEAVY) | child; }
+    int balance(uint32_t node) const;               // Height of right minus height of left: -1, 0 or 1
+    void setBalance(uint32_t node, int balance);
+    
+    uint32_t allocate(Record* record, uint32_t keyHash);
+    void release(uint32_t node);
+    uint32_t rotateRight(uint32_t node);
+    uint32_t rotateLeft(uint32_t node);
+    uint32_t fixLeftHeavy(uint32_t node, bool& shorter);
+    uint32_t fixRightHeavy(uint32_t node, bool& shorter);
+    uint32_t leftShrunk(uint32_t node, bool& shorter);
+    uint32_t rightShrunk(uint32_t node, bool& shorter);
+    uint32_t insertHelper(uint32_t node, Record* record, uint32_t keyHash, bool& taller);
+    uint32_t deleteHelper(uint32_t node, const std::string& key, uint32_t keyHash, int value, bool& shorter);
+    uint32_t removeMin(uint32_t node, uint32_t& minimum, bool& shorter);
+    int heightOf(uint32_t node, bool& valid) const;
+
+public:
+    CompactAVLTree();
+    void insert(Record* record);
+    Record* search(const std::string& key, int value) const;   // nullptr if not found
+    void deleteNode(const std::string& key, int value);
+    int getNodeCount() const { return nodeCount; }
+    
+    // For testing
+    int getHeight() const;
+    bool isBalanced() const;                        // Checks every stored balance factor and the ordering
+};
+
+// An insert or delete waiting in the write buffer
+struct PendingOp {
+    Record* record;                 // Record to insert, nullptr for a delete (tombstone)
+    std::string key;                // Key a delete must match
+    int next;                       // Later op on the same value, -1 if none
+    int last;                       // On a value's oldest op, the index of its newest
+};
+
+// Write buffer in front of the AVL tree: inserts and deletes are appended in O(1) and
+// replayed in order per value when read or merged, so the tree's rules still hold
+// (an insert of a value that exists is ignored, a delete needs the key to match).
+class WriteBuffer {
+private:
+    std::vector<PendingOp> ops;
+    std::unordered_map<int, int> first;             // Value -> index of its oldest op
+    mutable std::vector<int> sorted;                // Buffered values in order, rebuilt lazily
+    mutable bool sortedValid;
+
+public:
+    WriteBuffer();
+    void add(int value, Record* record, const std::string& key);
+    bool contains(int value) const { return first.count(value) != 0; }
+    Record* resolve(int value, Record* current) const;      // current is the tree's record for value, or nullptr
+    const std::vector<int>& sortedValues() const;
+    size_t size() const { return ops.size(); }
+    bool empty() const { return ops.empty(); }
+    void clear();
+};
+
+// Summary of the values in a range; minValue and maxValue are 0 when count is 0
+struct RangeAggregate {
+    long long sum;
+    int count;
+    int minValue;
+    int maxValue;
+};
+
+// Hit and miss counts of the hot-key cache
+struct CacheStats {
+    long long hits;
+    long long misses;
+    long long admitted;             // Misses that took a slot
+    long long rejected;             // Misses TinyLFU judged colder than the CLOCK victim
+    
+    double hitRate() const { return hits + misses ? double(hits) / (hits + misses) : 0.0; }
+};
+
+// Small fixed-size cache of found records, indexed by value in a flat open-addressed table.
+// Slots are replaced in CLOCK order, and only when a count-min sketch of recent lookups
+// (TinyLFU) says the newcomer is asked for more often than the slot it would evict.
+class HotCache {
+private:
+    struct Entry {
+        Record* record;             // nullptr for a free slot
+        int value;                  // record->value, kept here so probes stay in the cache's own memory
+        bool referenced;            // CLOCK bit, set on every hit
+    };
+    
+    std::vector<Entry> entries;
+    std::vector<int> table;                         // Entry index per hash slot, -1 if empty
+    std::vector<uint8_t> sketch;                    // SKETCH_ROWS rows of 4-bit-range counters
+    size_t hand;
+    size_t additions;                               // Sketch increments since counters were last halved
+    CacheStats stats;
+    
+    static const int SKETCH_ROWS = 4;
+    
+    size_t slotOf(int value) const;                 // Slot holding value, or the empty slot ending its probe
+    uint8_t& counter(int value, int row);
+    int frequency(int value);
+    void recordAccess(int value);
+    void unlink(size_t slot);
+
+public:
+    HotCache();
+    void reset(size_t capacity);                    // 0 disables the cache
+    bool enabled() const { return !entries.empty(); }
+    Record* lookup(const std::string& key, int value);     // Counts a hit or a miss
+    void admit(Record* record);                     // Offers a record found in the index
+    void erase(int value);
+    void clear();
+    const CacheStats& getStats() const { return stats; }
+};
+
 class IndexedDatabase {
 private:
     AVLTree index;
+    WriteBuffer buffer;
+    HotCache cache;
+    bool buffered;
+    size_t bufferLimit;
+    int mergeCount;
+    
+    static const size_t MERGE_RATIO = 4;            // Merge once the buffer holds a quarter of the tree
     
     void inorderHelper(AVLNode* node, std::vector<Record*>& result) const;
     void rangeQueryHelper(AVLNode* node, int start, int end, std::vector<Record*>& result) const;
     void clearHelper(AVLNode* node);
     int calculateHeight(AVLNode* node) const;
 
+    void mergeIfFull();
+
 public:
+    IndexedDatabase();
     void insert(Record* record);
     Record* search(const std::string& key, int value);
+    Record* find(const std::string& key, int value);   // nullptr if not found
+    bool containsValue(int value);                  // Whether any record holds value
     void deleteRecord(const std::string& key, int value);
     std::vector<Record*> rangeQuery(int start, int end);
+    RangeAggregate aggregateRange(int start, int end);
     std::vector<Record*> findKNearestKeys(int key, int k);
     std::vector<Record*> inorderTraversal();
     void clearDatabase();
-    int countRecords() { return index.getNodeCount(); }
+    int countRecords();
+    
+    // Optional write buffer for insert-heavy bursts
+    void enableWriteBuffer(size_t minimumEntries = 4096);
+    void disableWriteBuffer();
+    void flushWriteBuffer();                        // Merges the buffer into the tree by one bulk rebuild
+    size_t getBufferedOperations() const { return buffer.size(); }
+    int getMergeCount() const { return mergeCount; }
+    
+    // Optional hot-key cache in front of search
+    void enableHotCache(size_t capacity = 1024);
+    void disableHotCache();
+    CacheStats getCacheStats() const { return cache.getStats(); }
     
     // New methods for testing
     int getSearchComparisons(const std::string& key, int value);
     int getTreeHeight() const;
 };
 
+// Node of a VersionedDatabase tree. Never changed once built: a write copies the path to the
+// nodes it touches and shares everything else with the versions before it.
+struct VersionNode {
+    Record* record;
+    VersionNode* left;
+    VersionNode* right;
+    int height;
+    int refs;                       // Parents and version roots pointing here
+};
+
+// Multi-version database: every insert or delete that changes the contents commits a new version
+// number, and any retained version can be read as it was. Snapshots pin a version so it stays
+// readable; versions that are neither pinned, the latest, nor inside the history window are freed.
+// Readers pin under a short lock and then walk their version without one, so scans and writes
+// never wait on each other for more than one commit's path copy.
+class VersionedDatabase {
+private:
+    struct Version {
+        VersionNode* root;
+        int records;
+        int pins;
+    };
+    
+    std::map<long long, Version> versions;          // Retained versions, latest last
+    long long current;
+    long long history;                              // Latest versions kept without pins
+    size_t liveNodes;
+    mutable std::mutex lock;                        // Guards versions and node reference counts
+    
+    static int height(VersionNode* node) { return node ? node->height : 0; }
+    static VersionNode* retain(VersionNode* node);
+    VersionNode* make(Record* record, VersionNode* left, VersionNode* right);
+    void release(VersionNode* node);
+    VersionNode* balance(Record* record, VersionNode* left, VersionNode* right);
+    VersionNode* insertHelper(VersionNode* node, Record* record);
+    VersionNode* deleteHelper(VersionNode* node, int value);
+    VersionNode* removeMin(VersionNode* node, Record*& minimum);
+    static const VersionNode* find(const VersionNode* node, int value);
+    static void rangeHelper(const VersionNode* node, int start, int end, std::vector<Record*>& result);
+    long long commit(VersionNode* root, int records);
+    void collect(long long version);
+    VersionNode* pin(long long version);
+
+    VersionedDatabase(const VersionedDatabase&);
+    VersionedDatabase& operator=(const VersionedDatabase&);
+
+public:
+    VersionedDatabase();
+    ~VersionedDatabase();
+    
+    // Writes return the version they committed, or the latest one if nothing changed
+    long long insert(Record* record);
+    long long deleteRecord(const std::string& key, int value);
+    
+    // Reads of the latest version
+    Record* search(const std::string& key, int value);         // nullptr if not found
+    std::vector<Record*> rangeQuery(int start, int end);
+    std::vector<Record*> inorderTraversal();
+    int countRecords() const;
+    long long getVersion() const;
+    
+    // Time travel; versions that are no longer retained throw std::out_of_range
+    long long openSnapshot();                       // Pins the latest version and returns it
+    void closeSnapshot(long long version);
+    std::vector<Record*> asOf(long long version, int start = INT_MIN, int end = INT_MAX);
+    Record* searchAsOf(long long version, const std::string& key, int value);
+    void retainHistory(long long count);            // Versions before the latest kept without pins
+    
+    size_t getRetainedVersions() const;
+    size_t getLiveNodes() const;
+};
+
 #endif // AVL_DATABASE_HPP
\ No newline at end of file
@@ -0,0 +1,247 @@
+// db_bench.cpp
+// Sustained ingest into the IndexedDatabase with and without the write buffer: throughput and
+// the insert latency distribution, then a mixed run of inserts and searches, then Zipfian
+// searches with and without the hot-key cache, then the pointer and compact tree layouts, then
+// range aggregates against summing a materialised rangeQuery.
+#include "AVL_Database.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+using Clock = chrono::steady_clock;
+
+// Prints throughput and percentiles of per-operation latencies in nanoseconds.
+static void report(const string& name, vector<long long>& latencies, double seconds) {
+    sort(latencies.begin(), latencies.end());
+    auto at = [&latencies](double q) { return latencies[min(latencies.size() - 1, size_t(q * latencies.size()))]; };
+    cout << left << setw(28) << name << right
+         << setw(10) << fixed << setprecision(0) << latencies.size() / seconds << " ops/s"
+         << "  p50 " << setw(6) << at(0.5) << " ns"
+         << "  p99 " << setw(7) << at(0.99) << " ns"
+         << "  p99.9 " << setw(8) << at(0.999) << " ns"
+         << "  max " << setw(10) << latencies.back() << " ns" << endl;
+}
+
+// Inserts count records with random values, timing each insert.
+static void benchIngest(int count, bool buffered) {
+    IndexedDatabase db;
+    if (buffered) db.enableWriteBuffer();
+    mt19937 random(1);
+    vector<long long> latencies;
+    latencies.reserve(count);
+
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < count; i++) {
+        Record* record = new Record("Record " + to_string(i), int(random() & 0x7fffffff));
+        Clock::time_point before = Clock::now();
+        db.insert(record);
+        latencies.push_back(chrono::duration_cast<chrono::nanoseconds>(Clock::now() - before).count());
+    }
+    db.flushWriteBuffer();
+    double seconds = chrono::duration<double>(Clock::now() - start).count();
+
+    report(buffered ? "ingest, write buffer" : "ingest, direct", latencies, seconds);
+    if (buffered)
+        cout << "  " << db.getMergeCount() << " merges, " << db.countRecords() << " records" << endl;
+    db.clearDatabase();
+}
+
+// Runs count operations, one in ten a search for a value inserted earlier.
+static void benchMixed(int count, bool buffered) {
+    IndexedDatabase db;
+    if (buffered) db.enableWriteBuffer();
+    mt19937 random(2);
+    vector<pair<string, int> > inserted;
+    vector<long long> latencies;
+    latencies.reserve(count);
+    int found = 0;
+
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < count; i++) {
+        if (i % 10 == 9 && !inserted.empty()) {
+            const pair<string, int>& target = inserted[random() % inserted.size()];
+            Clock::time_point before = Clock::now();
+            Record* record = db.search(target.first, target.second);
+            latencies.push_back(chrono::duration_cast<chrono::nanoseconds>(Clock::now() - before).count());
+            if (record->key == target.first) found++;
+            else delete record;                                                     // Misses return a fresh empty record
+        } else {
+            int value = int(random() & 0x7fffffff);
+            Record* record = new Record("Record " + to_string(i), value);
+            inserted.push_back(make_pair(record->key, value));
+            Clock::time_point before = Clock::now();
+            db.insert(record);
+            latencies.push_back(chrono::duration_cast<chrono::nanoseconds>(Clock::now() - before).count());
+        }
+    }
+    db.flushWriteBuffer();
+    double seconds = chrono::duration<double>(Clock::now() - start).count();
+
+    report(buffered ? "mixed 90/10, write buffer" : "mixed 90/10, direct", latencies, seconds);
+    cout << "  " << found << " searches hit" << endl;
+    db.clearDatabase();
+}
+
+// Draws ranks 0..n-1 with probability proportional to 1/(rank+1)^skew.
+class ZipfSampler {
+private:
+    vector<double> cdf;
+
+public:
+    ZipfSampler(int n, double skew) : cdf(n) {
+        double sum = 0;
+        for (int i = 0; i < n; i++)
+            cdf[i] = sum += 1.0 / pow(i + 1.0, skew);
+        for (int i = 0; i < n; i++)
+            cdf[i] /= sum;
+    }
+
+    int operator()(mt19937& random) const {
+        double u = uniform_real_distribution<double>(0.0, 1.0)(random);
+        return int(min(cdf.size() - 1, size_t(lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin())));
+    }
+};
+
+// Searches count times for records of a database of size entries, popularity following a Zipf
+// law over a random order of the records.
+static void benchZipf(int size, int count, double skew, size_t cacheCapacity) {
+    IndexedDatabase db;
+    mt19937 random(3);
+    vector<int> values(size);
+    for (int i = 0; i < size; i++)
+        values[i] = i * 2;                                                           // Even values, inserted in random order
+    shuffle(values.begin(), values.end(), random);
+    for (int i = 0; i < size; i++)
+        db.insert(new Record("Record " + to_string(values[i]), values[i]));
+    shuffle(values.begin(), values.end(), random);                                  // values[rank] is the rank-th most popular
+    vector<string> keys(size);
+    for (int i = 0; i < size; i++)
+        keys[i] = "Record " + to_string(values[i]);
+    if (cacheCapacity) db.enableHotCache(cacheCapacity);
+
+    ZipfSampler zipf(size, skew);
+    vector<int> ranks(count);
+    for (int i = 0; i < count; i++)
+        ranks[i] = zipf(random);                                                     // Drawn up front, out of the timing
+    vector<long long> latencies;
+    latencies.reserve(count);
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < count; i++) {
+        int rank = ranks[i];
+        Clock::time_point before = Clock::now();
+        db.search(keys[rank], values[rank]);
+        latencies.push_back(chrono::duration_cast<chrono::nanoseconds>(Clock::now() - before).count());
+    }
+    double seconds = chrono::duration<double>(Clock::now() - start).count();
+
+    ostringstream name;
+    name << "zipf " << skew << (cacheCapacity ? ", cache " + to_string(cacheCapacity) : ", no cache");
+    report(name.str(), latencies, seconds);
+    if (cacheCapacity) {
+        CacheStats stats = db.getCacheStats();
+        cout << "  hit rate " << setprecision(1) << stats.hitRate() * 100 << "%, "
+             << stats.admitted << " admitted, " << stats.rejected << " rejected" << endl;
+    }
+    db.clearDatabase();
+}
+
+// Times an operation over a whole batch, returning nanoseconds per item.
+template <typename Operation>
+static double timePerItem(int items, Operation operation) {
+    Clock::time_point start = Clock::now();
+    operation();
+    return chrono::duration<double, nano>(Clock::now() - start).count() / items;
+}
+
+// Builds both tree layouts over size random records and times inserts and random lookups.
+static void benchLayout(int size, int lookups) {
+    mt19937 random(4);
+    vector<Record*> records(size);
+    for (int i = 0; i < size; i++)
+        records[i] = new Record("Record " + to_string(i), int(random() & 0x7fffffff));
+    vector<int> targets(lookups);
+    for (int i = 0; i < lookups; i++)
+        targets[i] = int(random() % size);
+
+    AVLTree pointer;
+    CompactAVLTree compact;
+    long long found = 0;
+    double pointerInsert = timePerItem(size, [&]() { for (int i = 0; i < size; i++) pointer.insert(records[i]); });
+    double compactInsert = timePerItem(size, [&]() { for (int i = 0; i < size; i++) compact.insert(records[i]); });
+    double pointerSearch = timePerItem(lookups, [&]() {
+        for (int i = 0; i < lookups; i++) found += pointer.search(records[targets[i]]->key, records[targets[i]]->value) == records[targets[i]];
+    });
+    double compactSearch = timePerItem(lookups, [&]() {
+        for (int i = 0; i < lookups; i++) found += compact.search(records[targets[i]]->key, records[targets[i]]->value) == records[targets[i]];
+    });
+
+    cout << setw(9) << size << fixed << setprecision(1)
+         << "  insert " << setw(7) << pointerInsert << " / " << setw(7) << compactInsert << " ns"
+         << "  search " << setw(7) << pointerSearch << " / " << setw(7) << compactSearch << " ns"
+         << "  (" << found << " found)" << endl;
+    for (int i = 0; i < size; i++)
+        delete records[i];                                                          // AVLTree has no destructor; its nodes are left behind
+}
+
+// Sums bands covering a given share of size records, through rangeQuery and through aggregateRange.
+static void benchAggregate(int size, int queries) {
+    IndexedDatabase db;
+    mt19937 random(5);
+    for (int i = 0; i < size; i++)
+        db.insert(new Record("Record " + to_string(i), int(random() % (size * 10LL))));
+    for (double share : {0.001, 0.01, 0.1, 1.0}) {
+        int width = int(size * 10LL * share);
+        vector<int> starts(queries);
+        for (int i = 0; i < queries; i++)
+            starts[i] = int(random() % (size * 10LL - width + 1));
+        long long check = 0;
+        double materialised = timePerItem(queries, [&]() {
+            for (int i = 0; i < queries; i++) {
+                vector<Record*> records = db.rangeQuery(starts[i], starts[i] + width - 1);
+                for (size_t j = 0; j < records.size(); j++)
+                    check += records[j]->value;
+            }
+        });
+        double aggregated = timePerItem(queries, [&]() {
+            for (int i = 0; i < queries; i++)
+                check -= db.aggregateRange(starts[i], starts[i] + width - 1).sum;
+        });
+        cout << setw(9) << size << setw(7) << setprecision(1) << share * 100 << "%"
+             << "  rangeQuery + sum " << setw(12) << setprecision(0) << materialised << " ns"
+             << "  aggregateRange " << setw(7) << aggregated << " ns" << (check ? "  MISMATCH" : "") << endl;
+    }
+    db.clearDatabase();
+}
+
+int main(int argc, char* argv[]) {
+    int count = argc > 1 ? atoi(argv[1]) : 1000000;
+    cout << count << " operations" << endl;
+    benchIngest(count, false);
+    benchIngest(count, true);
+    benchMixed(count, false);
+    benchMixed(count, true);
+    for (double skew : {0.8, 0.99, 1.2}) {
+        benchZipf(count, count, skew, 0);
+        benchZipf(count, count, skew, 1024);
+        benchZipf(count, count, skew, 16384);
+    }
+
+    cout << "layout: pointer AVLNode " << sizeof(AVLNode) << " B + Record " << sizeof(Record) << " B ("
+         << 64 / sizeof(AVLNode) << " nodes per 64 B line), CompactNode " << sizeof(CompactNode) << " B ("
+         << 64 / sizeof(CompactNode) << " per line)" << endl;
+    cout << "     size  insert pointer / compact     search pointer / compact" << endl;
+    for (int size = 1000; size <= count; size *= 10)
+        benchLayout(size, count);
+
+    cout << "     size   band  per query" << endl;
+    benchAggregate(count, 100);
+    return 0;
+}
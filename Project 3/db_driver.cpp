@@ -1,9 +1,13 @@
 // db_driver.cpp
 #include "AVL_Database.hpp"
+#include "db_server.hpp"
 #include <cassert>
 #include <iostream>
 #include <iomanip>
 #include <cmath>
+#include <stdexcept>
+#include <thread>
+#include <unistd.h>
 
 using namespace std;
 
@@ -137,6 +141,356 @@ int main() {
         db.clearDatabase();
     }
 
+    // Test Group 6: Write Buffer
+    cout << "\nTesting Write Buffer:" << endl;
+    {
+        IndexedDatabase buffered;
+        buffered.enableWriteBuffer(64);
+        buffered.insert(new Record("Moby Dick", 30));
+        buffered.insert(new Record("Ulysses", 10));
+        buffered.insert(new Record("Middlemarch", 30));                 // Duplicate value, ignored
+        buffered.deleteRecord("Dracula", 10);                           // Key does not match, ignored
+        printTest("Buffered Insert Visible",
+                 buffered.getBufferedOperations() == 4 &&
+                 buffered.search("Moby Dick", 30)->key == "Moby Dick" &&
+                 buffered.search("Middlemarch", 30)->key == "" &&
+                 buffered.search("Ulysses", 10)->key == "Ulysses");
+
+        buffered.deleteRecord("Moby Dick", 30);
+        buffered.insert(new Record("Middlemarch", 30));                 // Value is free again
+        auto range = buffered.rangeQuery(0, 100);
+        printTest("Buffered Delete and Reinsert",
+                 buffered.search("Moby Dick", 30)->key == "" &&
+                 range.size() == 2 && range[0]->value == 10 && range[1]->key == "Middlemarch");
+
+        // Mirror a random mix of inserts and deletes in an unbuffered database
+        IndexedDatabase plain;
+        bool consistent = true;
+        srand(41);
+        for (int i = 0; i < 20000; i++) {
+            int value = rand() % 500;
+            if (rand() % 3) {
+                string key = "Vol." + to_string(i);
+                buffered.insert(new Record(key, value + 1000));
+                plain.insert(new Record(key, value + 1000));
+            } else {
+                auto found = plain.rangeQuery(value + 1000, value + 1000);
+                string key = !found.empty() && rand() % 4 ? found[0]->key : "Missing";
+                buffered.deleteRecord(key, value + 1000);
+                plain.deleteRecord(key, value + 1000);
+            }
+            if (i % 1000 == 0) {
+                auto expected = plain.rangeQuery(1100, 1300);
+                auto actual = buffered.rangeQuery(1100, 1300);
+                consistent = consistent && expected.size() == actual.size();
+                for (size_t j = 0; consistent && j < expected.size(); j++)
+                    consistent = expected[j]->value == actual[j]->value && expected[j]->key == actual[j]->key;
+            }
+        }
+        printTest("Buffered Matches Unbuffered", consistent && buffered.getMergeCount() > 0);
+
+        buffered.flushWriteBuffer();
+        auto all = buffered.rangeQuery(1000, 2000);
+        auto expected = plain.rangeQuery(1000, 2000);
+        bool same = all.size() == expected.size();
+        for (size_t j = 0; same && j < all.size(); j++)
+            same = all[j]->value == expected[j]->value && all[j]->key == expected[j]->key;
+        printTest("Merge Keeps Records and Count",
+                 same && buffered.getBufferedOperations() == 0 &&
+                 buffered.countRecords() == plain.countRecords() + 2);
+
+        printTest("Merged Tree Balanced",
+                 buffered.getTreeHeight() <= ceil(log2(buffered.countRecords() + 1)) + 1);
+
+        buffered.clearDatabase();
+        plain.clearDatabase();
+        printTest("Clear Resets Count", buffered.countRecords() == 0 && plain.countRecords() == 0);
+    }
+
+    // Test Group 7: Hot-Key Cache
+    cout << "\nTesting Hot-Key Cache:" << endl;
+    {
+        IndexedDatabase cached;
+        cached.enableHotCache(8);
+        for (int i = 0; i < 100; i++)
+            cached.insert(new Record("Canto " + to_string(i), i));
+        for (int i = 0; i < 5; i++)
+            cached.search("Canto 7", 7);
+        CacheStats stats = cached.getCacheStats();
+        printTest("Repeated Search Hits", stats.hits == 4 && stats.misses == 1 && stats.admitted == 1);
+
+        cached.deleteRecord("Canto 7", 7);
+        bool gone = cached.search("Canto 7", 7)->key == "";
+        cached.insert(new Record("Inferno", 7));
+        printTest("Delete Invalidates Entry",
+                 gone && cached.search("Canto 7", 7)->key == "" && cached.search("Inferno", 7)->key == "Inferno");
+
+        // A hot working set survives a scan of keys each searched once
+        for (int round = 0; round < 20; round++)
+            for (int i = 50; i < 54; i++)
+                cached.search("Canto " + to_string(i), i);
+        for (int i = 0; i < 40; i++)
+            cached.search("Canto " + to_string(i), i);
+        long long hitsBefore = cached.getCacheStats().hits;
+        for (int i = 50; i < 54; i++)
+            cached.search("Canto " + to_string(i), i);
+        printTest("Frequent Keys Survive Scan", cached.getCacheStats().hits == hitsBefore + 4);
+
+        cached.clearDatabase();
+        cached.insert(new Record("Paradiso", 50));
+        printTest("Clear Empties Cache", cached.search("Canto 50", 50)->key == "" &&
+                                         cached.search("Paradiso", 50)->key == "Paradiso");
+    }
+
+    // Test Group 8: Compact AVL Tree
+    cout << "\nTesting Compact AVL Tree:" << endl;
+    {
+        CompactAVLTree compact;
+        IndexedDatabase reference;
+        for (int i = 0; i < 1023; i++) {
+            Record* record = new Record("Sonnet " + to_string(i), i);
+            compact.insert(record);                                                 // Ascending, rotates on every level
+            reference.insert(record);
+        }
+        printTest("Compact Sequential Insert",
+                 compact.getNodeCount() == 1023 && compact.isBalanced() && compact.getHeight() == 10);
+
+        printTest("Compact Search",
+                 compact.search("Sonnet 512", 512) && compact.search("Sonnet 512", 512)->value == 512 &&
+                 !compact.search("Sonnet 511", 512) && !compact.search("Sonnet 2000", 2000));
+
+        // Mirror a random mix of inserts and deletes in the pointer-based tree
+        bool consistent = true;
+        srand(43);
+        for (int i = 0; i < 20000 && consistent; i++) {
+            int value = rand() % 3000;
+            string key = "Sonnet " + to_string(rand() % 2 ? value : i);
+            if (rand() % 2) {
+                Record* record = new Record(key, value);
+                compact.insert(record);
+                reference.insert(record);
+            } else {
+                compact.deleteNode(key, value);
+                reference.deleteRecord(key, value);
+            }
+            if (i % 500 == 0)
+                consistent = compact.isBalanced();
+        }
+        for (int value = 0; value < 3000 && consistent; value++) {
+            auto expected = reference.rangeQuery(value, value);
+            Record* found = expected.empty() ? nullptr : compact.search(expected[0]->key, value);
+            consistent = expected.empty() ? !compact.search("Sonnet " + to_string(value), value)
+                                          : found == expected[0];
+        }
+        printTest("Compact Matches Pointer Tree",
+                 consistent && compact.getNodeCount() == reference.countRecords());
+
+        for (int value = 0; value < 3000; value++) {
+            auto found = reference.rangeQuery(value, value);
+            if (!found.empty()) compact.deleteNode(found[0]->key, value);
+        }
+        printTest("Compact Delete All", compact.getNodeCount() == 0 && compact.getHeight() == 0);
+    }
+
+    // Test Group 9: Versioned Database
+    cout << "\nTesting Versioned Database:" << endl;
+    {
+        VersionedDatabase versioned;
+        versioned.insert(new Record("Emma", 10));
+        versioned.insert(new Record("Persuasion", 20));
+        long long before = versioned.insert(new Record("Sanditon", 30));
+        long long snapshot = versioned.openSnapshot();
+        versioned.deleteRecord("Persuasion", 20);
+        versioned.insert(new Record("Lady Susan", 25));
+        auto past = versioned.asOf(snapshot);
+        auto now = versioned.inorderTraversal();
+        printTest("Snapshot Sees Past Version",
+                 before == 3 && snapshot == 3 && past.size() == 3 && past[1]->key == "Persuasion" &&
+                 now.size() == 3 && now[1]->key == "Lady Susan" && versioned.getVersion() == 5);
+
+        long long unchanged = versioned.getVersion();
+        printTest("No-op Writes Keep Version",
+                 versioned.insert(new Record("Emma Again", 10)) == unchanged &&
+                 versioned.deleteRecord("Northanger Abbey", 30) == unchanged &&
+                 versioned.search("Lady Susan", 25) && !versioned.search("Persuasion", 20) &&
+                 versioned.searchAsOf(snapshot, "Persuasion", 20));
+
+        versioned.closeSnapshot(snapshot);
+        bool collected = false;
+        try {
+            versioned.asOf(snapshot);
+        } catch (const out_of_range&) {
+            collected = true;
+        }
+        printTest("Closed Snapshot Collected",
+                 collected && versioned.getRetainedVersions() == 1 &&
+                 versioned.getLiveNodes() == size_t(versioned.countRecords()));
+
+        versioned.retainHistory(100);
+        long long first = versioned.getVersion();
+        for (int i = 0; i < 200; i++)
+            versioned.insert(new Record("Juvenilia " + to_string(i), 1000 + i));
+        bool history = versioned.asOf(first + 100).size() == 3 + 100 && versioned.getRetainedVersions() == 101;
+        try {
+            versioned.asOf(first + 99);
+            history = false;
+        } catch (const out_of_range&) {
+        }
+        printTest("History Window", history);
+
+        // A scan of a pinned version keeps returning the same records while another thread writes
+        long long pinned = versioned.openSnapshot();
+        auto expected = versioned.asOf(pinned);
+        bool stable = true;
+        thread writer([&versioned]() {
+            for (int i = 0; i < 20000; i++) {
+                versioned.insert(new Record("Letter " + to_string(i), 5000 + i % 3000));
+                versioned.deleteRecord("Letter " + to_string(i - 1500), 5000 + (i - 1500) % 3000);
+            }
+        });
+        for (int scan = 0; scan < 200; scan++)
+            stable = stable && versioned.asOf(pinned) == expected;
+        writer.join();
+        versioned.closeSnapshot(pinned);
+        versioned.retainHistory(0);
+        printTest("Scan Isolated From Writer",
+                 stable && versioned.getRetainedVersions() == 1 &&
+                 versioned.getLiveNodes() == size_t(versioned.countRecords()) &&
+                 int(versioned.inorderTraversal().size()) == versioned.countRecords());
+    }
+
+    // Test Group 10: Range Aggregates
+    cout << "\nTesting Range Aggregates:" << endl;
+    {
+        IndexedDatabase plain, buffered;
+        buffered.enableWriteBuffer(16);
+        auto matches = [](IndexedDatabase& database, int start, int end) {
+            RangeAggregate aggregate = database.aggregateRange(start, end);
+            auto records = database.rangeQuery(start, end);
+            long long sum = 0;
+            for (size_t i = 0; i < records.size(); i++)
+                sum += records[i]->value;
+            return aggregate.count == int(records.size()) && aggregate.sum == sum &&
+                   (records.empty() || (aggregate.minValue == records.front()->value &&
+                                        aggregate.maxValue == records.back()->value));
+        };
+
+        RangeAggregate empty = plain.aggregateRange(0, 100);
+        plain.insert(new Record("Hamlet", 5));
+        plain.insert(new Record("Macbeth", -7));
+        plain.insert(new Record("Othello", 12));
+        RangeAggregate three = plain.aggregateRange(-10, 12);
+        printTest("Aggregate Small Range",
+                 empty.count == 0 && three.count == 3 && three.sum == 10 &&
+                 three.minValue == -7 && three.maxValue == 12 && plain.aggregateRange(6, 11).count == 0);
+
+        bool consistent = true;
+        srand(45);
+        for (int i = 0; i < 20000 && consistent; i++) {
+            int value = rand() % 4000 - 2000;
+            string key = "Folio " + to_string(rand() % 2 ? value : i);
+            if (rand() % 3) {
+                plain.insert(new Record(key, value));
+                buffered.insert(new Record(key, value));
+            } else {
+                plain.deleteRecord(key, value);
+                buffered.deleteRecord(key, value);
+            }
+            if (i % 100 == 0) {
+                int start = rand() % 4400 - 2200, end = start + rand() % 1500;
+                consistent = matches(plain, start, end) && matches(buffered, start, end);
+            }
+        }
+        printTest("Aggregate Matches Range Query", consistent && buffered.getMergeCount() > 0);
+
+        buffered.flushWriteBuffer();
+        RangeAggregate all = buffered.aggregateRange(INT_MIN, INT_MAX);
+        printTest("Aggregate Whole Tree",
+                 matches(buffered, INT_MIN, INT_MAX) && all.count == buffered.countRecords() &&
+                 plain.aggregateRange(INT_MIN, INT_MAX).count == plain.countRecords());
+    }
+
+    // Test Group 11: Socket Server
+    cout << "\nTesting Socket Server:" << endl;
+    {
+        IndexedDatabase served;
+        string socketPath = "/tmp/avl_database_test_" + to_string(getpid()) + ".sock";
+        DatabaseServer server(served, socketPath, 2);
+        server.start();
+        DatabaseClient client(socketPath);
+        printTest("Server Insert and Search",
+                 client.insert("Beowulf", 8) == protocol::STATUS_OK &&
+                 client.insert("Grendel", 8) == protocol::STATUS_EXISTS &&
+                 client.search("Beowulf", 8) && !client.search("Grendel", 8) && !client.search("Beowulf", 9));
+
+        printTest("Server Delete",
+                 client.deleteRecord("Grendel", 8) == protocol::STATUS_NOT_FOUND &&
+                 client.deleteRecord("Beowulf", 8) == protocol::STATUS_OK &&
+                 !client.search("Beowulf", 8) && served.countRecords() == 0);
+
+        // ("", 0) is what a miss used to look like, so it must not be mistaken for a hit
+        printTest("Server Empty Key Miss",
+                 !client.search("", 0) && client.deleteRecord("", 0) == protocol::STATUS_NOT_FOUND &&
+                 served.countRecords() == 0);
+
+        // Keys longer than the u16 length field are refused rather than cut short
+        bool refused = false;
+        try {
+            client.queueInsert(string(protocol::MAX_KEY + 1, 'k'), 1);
+        } catch (const runtime_error&) {
+            refused = true;
+        }
+        Record* longKey = new Record(string(protocol::MAX_KEY + 1, 'x'), 50000);
+        served.insert(longKey);
+        client.queueRange(49999, 50001);
+        client.flush();
+        bool rejected = client.receive().status == protocol::STATUS_BAD_REQUEST;
+        served.deleteRecord(longKey->key, longKey->value);
+        delete longKey;
+        printTest("Server Long Key", refused && rejected && !client.search("Beowulf", 8));
+
+        // A thousand requests in one write come back in order
+        for (int i = 0; i < 1000; i++)
+            client.queueInsert("Fitt " + to_string(i), i);
+        uint32_t searchId = client.queueSearch("Fitt 500", 500);
+        uint32_t rangeId = client.queueRange(100, 199);
+        client.flush();
+        bool ordered = true;
+        Response response;
+        for (int i = 0; i < 1000; i++) {
+            response = client.receive();
+            ordered = ordered && response.status == protocol::STATUS_OK;
+        }
+        Response search = client.receive();
+        Response range = client.receive();
+        ServerStats stats = server.getStats();
+        printTest("Server Pipelined Batch",
+                 ordered && search.id == searchId && search.records.size() == 1 &&
+                 search.records[0].first == "Fitt 500" && range.id == rangeId && range.records.size() == 100 &&
+                 range.records[0].second == 100 && stats.batches < stats.requests);
+
+        // Several clients on separate threads, each with its own result slot
+        vector<char> succeeded(4, 1);
+        vector<thread> clients;
+        for (int c = 0; c < 4; c++)
+            clients.push_back(thread([&socketPath, &succeeded, c]() {
+                DatabaseClient own(socketPath);
+                for (int i = 0; i < 200; i++) {
+                    int value = 10000 + c * 1000 + i;
+                    if (own.insert("Kenning", value) != protocol::STATUS_OK || !own.search("Kenning", value))
+                        succeeded[c] = 0;
+                }
+            }));
+        bool concurrent = true;
+        for (size_t i = 0; i < clients.size(); i++) {
+            clients[i].join();
+            concurrent = concurrent && succeeded[i];
+        }
+        printTest("Server Concurrent Clients",
+                 concurrent && client.rangeQuery(10000, 20000).size() == 800 && served.countRecords() == 1800);
+        server.stop();
+    }
+
     // Print Summary
     cout << "\nTest Summary:" << endl;
     cout << "Tests Passed: " << passedTests << "/" << totalTests 
@@ -0,0 +1,134 @@
+// db_load.cpp
+// Load generator for the database server: several connections, each sending pipelined batches
+// of searches, inserts and deletes, then throughput and per-request latency percentiles. Runs a
+// server in-process unless --socket names one that is already running.
+#include "db_server.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+using Clock = chrono::steady_clock;
+
+struct Options {
+    string socket;
+    int workers = 2;
+    int connections = 4;
+    int depth = 16;
+    int requests = 100000;                          // Per connection
+    int records = 100000;
+    int searchPercent = 80;                         // The rest is split between inserts and deletes
+};
+
+static Options parseOptions(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        string name = argv[i];
+        if (name == "--socket") options.socket = argv[i + 1];
+        else if (name == "--workers") options.workers = atoi(argv[i + 1]);
+        else if (name == "--connections") options.connections = atoi(argv[i + 1]);
+        else if (name == "--depth") options.depth = atoi(argv[i + 1]);
+        else if (name == "--requests") options.requests = atoi(argv[i + 1]);
+        else if (name == "--records") options.records = atoi(argv[i + 1]);
+        else if (name == "--search") options.searchPercent = atoi(argv[i + 1]);
+        else {
+            cerr << "Unknown option " << name << endl;
+            exit(1);
+        }
+    }
+    options.depth = max(1, options.depth);
+    return options;
+}
+
+static string keyOf(int value) {
+    return "Record " + to_string(value);
+}
+
+// Sends options.requests requests on one connection in batches of options.depth, recording
+// the time from each batch's send to each of its responses.
+static void runConnection(const Options& options, int seed, vector<long long>& latencies) {
+    DatabaseClient client(options.socket);
+    mt19937 random(seed);
+    latencies.reserve(options.requests);
+    for (int sent = 0; sent < options.requests;) {
+        int batch = min(options.depth, options.requests - sent);
+        for (int i = 0; i < batch; i++) {
+            int value = int(random() % (options.records * 2u));
+            int pick = int(random() % 100);
+            if (pick < options.searchPercent)
+                client.queueSearch(keyOf(value), value);
+            else if (pick % 2)
+                client.queueInsert(keyOf(value), value);
+            else
+                client.queueDelete(keyOf(value), value);
+        }
+        Clock::time_point start = Clock::now();
+        client.flush();
+        for (int i = 0; i < batch; i++) {
+            client.receive();
+            latencies.push_back(chrono::duration_cast<chrono::nanoseconds>(Clock::now() - start).count());
+        }
+        sent += batch;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    Options options = parseOptions(argc, argv);
+
+    IndexedDatabase database;
+    DatabaseServer* server = nullptr;
+    if (options.socket.empty()) {
+        options.socket = "/tmp/db_load_" + to_string(getpid()) + ".sock";
+        server = new DatabaseServer(database, options.socket, options.workers);
+        server->start();
+    }
+
+    // Preload every even value, so about half the searches hit
+    DatabaseClient loader(options.socket);
+    for (int value = 0; value < options.records * 2;) {
+        int batch = 0;
+        for (; batch < 1024 && value < options.records * 2; batch++, value += 2)
+            loader.queueInsert(keyOf(value), value);
+        loader.flush();
+        for (int i = 0; i < batch; i++)
+            loader.receive();
+    }
+
+    ServerStats before = server ? server->getStats() : ServerStats();
+    vector<vector<long long> > latencies(options.connections);
+    vector<thread> threads;
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < options.connections; i++)
+        threads.push_back(thread(runConnection, cref(options), i + 1, ref(latencies[i])));
+    for (size_t i = 0; i < threads.size(); i++)
+        threads[i].join();
+    double seconds = chrono::duration<double>(Clock::now() - start).count();
+
+    vector<long long> all;
+    for (size_t i = 0; i < latencies.size(); i++)
+        all.insert(all.end(), latencies[i].begin(), latencies[i].end());
+    sort(all.begin(), all.end());
+    auto at = [&all](double q) { return all[min(all.size() - 1, size_t(q * all.size()))] / 1000.0; };
+
+    cout << options.connections << " connections, depth " << options.depth << ", "
+         << (server ? to_string(options.workers) + " server workers" : "external server") << endl;
+    cout << fixed << setprecision(0) << all.size() / seconds << " requests/s"
+         << setprecision(1) << "  p50 " << at(0.5) << " us  p99 " << at(0.99) << " us  p99.9 " << at(0.999)
+         << " us  max " << all.back() / 1000.0 << " us" << endl;
+    if (server) {
+        ServerStats stats = server->getStats();
+        cout << setprecision(1) << double(stats.requests - before.requests) / max(1LL, stats.batches - before.batches)
+             << " requests per batch" << endl;
+        server->stop();
+        delete server;
+    }
+    return 0;
+}
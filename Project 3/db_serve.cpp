@@ -0,0 +1,41 @@
+// db_serve.cpp
+// Serves an empty IndexedDatabase on a Unix-domain socket until interrupted.
+//   db_serve <socket path> [workers]
+#include "db_server.hpp"
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+
+using namespace std;
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        cerr << "Usage: " << argv[0] << " <socket path> [workers]" << endl;
+        return 1;
+    }
+
+    // Block the stop signals here so every thread inherits the mask, then wait for one
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    IndexedDatabase database;
+    DatabaseServer server(database, argv[1], argc > 2 ? atoi(argv[2]) : 2);
+    try {
+        server.start();
+    } catch (const exception& error) {
+        cerr << error.what() << endl;
+        return 1;
+    }
+    cout << "Serving on " << argv[1] << endl;
+
+    int signal;
+    sigwait(&signals, &signal);
+    server.stop();
+    ServerStats stats = server.getStats();
+    cout << stats.connections << " connections, " << stats.requests << " requests in "
+         << stats.batches << " batches" << endl;
+    return 0;
+}
@@ -0,0 +1,463 @@
+// db_server.cpp
+#include "db_server.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Appends and reads integers of the wire format.
+template <typename T>
+static void put(std::string& buffer, T value) {
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+static T get(const char* data) {
+    T value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static void putRecord(std::string& buffer, int value, const std::string& key) {
+    put<int32_t>(buffer, value);
+    put<uint16_t>(buffer, static_cast<uint16_t>(key.size()));
+    buffer.append(key, 0, static_cast<uint16_t>(key.size()));
+}
+
+// Reads a value and key at data, returning false if they overrun end.
+static bool getRecord(const char*& data, const char* end, int& value, std::string& key) {
+    if (end - data < 6) return false;
+    value = get<int32_t>(data);
+    uint16_t keyLength = get<uint16_t>(data + 4);
+    data += 6;
+    if (end - data < keyLength) return false;
+    key.assign(data, keyLength);
+    data += keyLength;
+    return true;
+}
+
+// Reserves a response header, to be finished by endResponse once the payload is written.
+static size_t beginResponse(std::string& output, uint32_t id, uint8_t status) {
+    size_t start = output.size();
+    put<uint32_t>(output, 0);
+    put<uint32_t>(output, id);
+    put<uint8_t>(output, status);
+    return start;
+}
+
+static void endResponse(std::string& output, size_t start) {
+    uint32_t length = static_cast<uint32_t>(output.size() - start - 4);
+    std::memcpy(&output[start], &length, sizeof(length));
+}
+
+// Tell the listening socket and the wake eventfd apart from connections in epoll events
+static char listenTag, wakeTag;
+
+static sockaddr_un socketAddress(const std::string& path) {
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path))
+        throw std::runtime_error("Socket path too long: " + path);
+    std::strcpy(address.sun_path, path.c_str());
+    return address;
+}
+
+DatabaseServer::DatabaseServer(IndexedDatabase& database, const std::string& path, int workers)
+    : database(database), path(path), workerCount(workers < 1 ? 1 : workers), listenFd(-1), wakeFd(-1),
+      connections(0), requests(0), batches(0) {}
+
+DatabaseServer::~DatabaseServer() {
+    stop();
+}
+
+// Binds the socket and starts the workers.
+void DatabaseServer::start() {
+    sockaddr_un address = socketAddress(path);
+    listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd < 0)
+        throw std::runtime_error(std::string("socket: ") + std::strerror(errno));
+    unlink(path.c_str());
+    if (bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || listen(listenFd, 512) < 0) {
+        std::string error = std::strerror(errno);
+        close(listenFd);
+        listenFd = -1;
+        throw std::runtime_error("Cannot listen on " + path + ": " + error);
+    }
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeFd < 0) {
+        std::string error = std::strerror(errno);
+        releaseDescriptors();
+        unlink(path.c_str());
+        throw std::runtime_error("eventfd: " + error);
+    }
+
+    // Every worker's epoll set watches the listening socket and the wake eventfd
+    for (int i = 0; i < workerCount; i++) {
+        int epollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (epollFd >= 0)
+            epollFds.push_back(epollFd);
+        epoll_event listenEvent = epoll_event(), wakeEvent = epoll_event();
+        listenEvent.events = EPOLLIN | EPOLLEXCLUSIVE;
+        listenEvent.data.ptr = &listenTag;
+        wakeEvent.events = EPOLLIN;
+        wakeEvent.data.ptr = &wakeTag;
+        if (epollFd < 0 || epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &listenEvent) < 0 ||
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &wakeEvent) < 0) {
+            std::string error = std::strerror(errno);
+            releaseDescriptors();
+            unlink(path.c_str());
+            throw std::runtime_error("epoll: " + error);
+        }
+    }
+    for (size_t i = 0; i < epollFds.size(); i++)
+        workers.push_back(std::thread(&DatabaseServer::workerLoop, this, epollFds[i]));
+}
+
+// Wakes the workers, waits for them to close their connections and removes the socket.
+void DatabaseServer::stop() {
+    if (listenFd < 0) return;
+    uint64_t one = 1;
+    if (write(wakeFd, &one, sizeof(one)) < 0) {}                                       // Never consumed, so every worker sees it
+    for (size_t i = 0; i < workers.size(); i++)
+        workers[i].join();
+    workers.clear();
+    releaseDescriptors();
+    unlink(path.c_str());
+    if (!retired.empty()) {
+        database.flushWriteBuffer();                                                    // Same contents, and no op left to point at them
+        releaseRetired();
+    }
+}
+
+// Closes the listening socket, the wake eventfd and the epoll sets.
+void DatabaseServer::releaseDescriptors() {
+    for (size_t i = 0; i < epollFds.size(); i++)
+        close(epollFds[i]);
+    epollFds.clear();
+    if (wakeFd >= 0)
+        close(wakeFd);
+    close(listenFd);
+    listenFd = wakeFd = -1;
+}
+
+ServerStats DatabaseServer::getStats() const {
+    ServerStats stats = { connections.load(), requests.load(), batches.load() };
+    return stats;
+}
+
+// Event loop of one worker. The listening socket is shared with EPOLLEXCLUSIVE, so a new
+// connection wakes one worker, which accepts it and serves it from then on.
+void DatabaseServer::workerLoop(int epollFd) {
+    epoll_event event;
+    std::vector<Connection*> open;
+    epoll_event events[64];
+    bool running = true;
+    while (running) {
+        int ready = epoll_wait(epollFd, events, 64, -1);
+        for (int i = 0; i < ready; i++) {
+            if (events[i].data.ptr == &wakeTag) {
+                running = false;
+            } else if (events[i].data.ptr == &listenTag) {
+                int fd;
+                while ((fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                    Connection* connection = new Connection();
+                    connection->fd = fd;
+                    connection->written = 0;
+                    event.events = EPOLLIN;
+                    event.data.ptr = connection;
+                    epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+                    open.push_back(connection);
+                    connections++;
+                }
+            } else {
+                Connection* connection = static_cast<Connection*>(events[i].data.ptr);
+                bool alive = true;
+                if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                    alive = readRequests(*connection);
+                if (alive)
+                    alive = writeResponses(*connection);
+                if (alive) {
+                    // Stop reading while responses are pending, so a client that sends without
+                    // reading cannot grow the output without bound
+                    event.events = connection->output.empty() ? EPOLLIN : EPOLLOUT;
+                    event.data.ptr = connection;
+                    epoll_ctl(epollFd, EPOLL_CTL_MOD, connection->fd, &event);
+                } else {
+                    close(connection->fd);
+                    open.erase(std::find(open.begin(), open.end(), connection));
+                    delete connection;
+                }
+            }
+        }
+    }
+
+    for (size_t i = 0; i < open.size(); i++) {
+        close(open[i]->fd);
+        delete open[i];
+    }
+}
+
+// Reads everything the connection has sent and runs its complete requests as one batch.
+// Returns false once the connection should be closed.
+bool DatabaseServer::readRequests(Connection& connection) {
+    char chunk[65536];
+    bool closed = false;
+    for (;;) {
+        ssize_t count = read(connection.fd, chunk, sizeof(chunk));
+        if (count > 0) {
+            connection.input.append(chunk, count);
+            if (count < static_cast<ssize_t>(sizeof(chunk))) break;
+        } else if (count == 0) {
+            closed = true;
+            break;
+        } else if (errno == EINTR) {
+            continue;
+        } else {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) return false;
+            break;
+        }
+    }
+
+    size_t offset = 0;
+    const std::string& input = connection.input;
+    if (input.size() >= 4 + 5) {
+        std::lock_guard<std::mutex> guard(databaseLock);
+        long long handled = 0;
+        while (input.size() - offset >= 4) {
+            uint32_t length = get<uint32_t>(input.data() + offset);
+            if (length < 5 || length > protocol::MAX_FRAME) return false;
+            if (input.size() - offset - 4 < length) break;
+            execute(input.data() + offset + 4, length, connection.output);
+            offset += 4 + length;
+            handled++;
+        }
+        if (handled) {
+            requests += handled;
+            batches++;
+        }
+    }
+    connection.input.erase(0, offset);
+    return !closed || !connection.output.empty();
+}
+
+// Writes pending responses; returns false if the connection failed.
+bool DatabaseServer::writeResponses(Connection& connection) {
+    while (connection.written < connection.output.size()) {
+        ssize_t count = send(connection.fd, connection.output.data() + connection.written,
+                             connection.output.size() - connection.written, MSG_NOSIGNAL);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        connection.written += count;
+    }
+    connection.output.clear();
+    connection.written = 0;
+    return true;
+}
+
+// Runs one request frame (id, opcode and payload) and appends its response; the caller holds
+// the database lock.
+void DatabaseServer::execute(const char* frame, uint32_t length, std::string& output) {
+    uint32_t id = get<uint32_t>(frame);
+    uint8_t opcode = static_cast<uint8_t>(frame[4]);
+    const char* data = frame + 5;
+    const char* end = frame + length;
+    int value;
+    std::string key;
+
+    if (opcode == protocol::OP_RANGE) {
+        if (end - data != 8) {
+            endResponse(output, beginResponse(output, id, protocol::STATUS_BAD_REQUEST));
+            return;
+        }
+        std::vector<Record*> records = database.rangeQuery(get<int32_t>(data), get<int32_t>(data + 4));
+        for (size_t i = 0; i < records.size(); i++)
+            if (records[i]->key.size() > protocol::MAX_KEY) {
+                endResponse(output, beginResponse(output, id, protocol::STATUS_BAD_REQUEST));   // Would be cut short on the wire
+                return;
+            }
+        size_t start = beginResponse(output, id, protocol::STATUS_OK);
+        put<uint32_t>(output, static_cast<uint32_t>(records.size()));
+        for (size_t i = 0; i < records.size(); i++)
+            putRecord(output, records[i]->value, records[i]->key);
+        endResponse(output, start);
+        return;
+    }
+
+    if (!getRecord(data, end, value, key) || data != end ||
+        (opcode != protocol::OP_INSERT && opcode != protocol::OP_SEARCH && opcode != protocol::OP_DELETE)) {
+        endResponse(output, beginResponse(output, id, protocol::STATUS_BAD_REQUEST));
+        return;
+    }
+
+    if (opcode == protocol::OP_INSERT) {
+        // The tree ignores duplicate values; checking first keeps the record from leaking
+        bool exists = database.containsValue(value);
+        if (!exists)
+            database.insert(new Record(key, value));
+        endResponse(output, beginResponse(output, id, exists ? protocol::STATUS_EXISTS : protocol::STATUS_OK));
+        return;
+    }
+
+    Record* record = database.find(key, value);
+    bool found = record != nullptr;
+    if (opcode == protocol::OP_DELETE && found) {
+        database.deleteRecord(key, value);                                              // Unlinks the record but does not free it
+        retired.push_back(record);
+        releaseRetired();
+    }
+    size_t start = beginResponse(output, id, found ? protocol::STATUS_OK : protocol::STATUS_NOT_FOUND);
+    if (opcode == protocol::OP_SEARCH && found)
+        putRecord(output, value, key);
+    endResponse(output, start);
+}
+
+// Frees the records this server deleted once nothing in the database can reach them: at once
+// without a write buffer, otherwise after the buffer holding their ops has been merged. The
+// caller holds the database lock.
+void DatabaseServer::releaseRetired() {
+    if (database.getBufferedOperations() != 0) return;
+    for (size_t i = 0; i < retired.size(); i++)
+        delete retired[i];
+    retired.clear();
+}
+
+DatabaseClient::DatabaseClient(const std::string& path) : nextId(0), consumed(0) {
+    sockaddr_un address = socketAddress(path);
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+        std::string error = std::strerror(errno);
+        if (fd >= 0) close(fd);
+        throw std::runtime_error("Cannot connect to " + path + ": " + error);
+    }
+}
+
+DatabaseClient::~DatabaseClient() {
+    close(fd);
+}
+
+uint32_t DatabaseClient::queue(uint8_t opcode, int value, const std::string& key) {
+    if (key.size() > protocol::MAX_KEY)
+        throw std::runtime_error("Key too long");
+    size_t start = output.size();
+    put<uint32_t>(output, 0);
+    put<uint32_t>(output, nextId);
+    put<uint8_t>(output, opcode);
+    putRecord(output, value, key);
+    endResponse(output, start);
+    pending.push_back(opcode);
+    return nextId++;
+}
+
+uint32_t DatabaseClient::queueInsert(const std::string& key, int value) {
+    return queue(protocol::OP_INSERT, value, key);
+}
+
+uint32_t DatabaseClient::queueSearch(const std::string& key, int value) {
+    return queue(protocol::OP_SEARCH, value, key);
+}
+
+uint32_t DatabaseClient::queueDelete(const std::string& key, int value) {
+    return queue(protocol::OP_DELETE, value, key);
+}
+
+uint32_t DatabaseClient::queueRange(int start, int end) {
+    put<uint32_t>(output, 4 + 1 + 8);
+    put<uint32_t>(output, nextId);
+    put<uint8_t>(output, protocol::OP_RANGE);
+    put<int32_t>(output, start);
+    put<int32_t>(output, end);
+    pending.push_back(protocol::OP_RANGE);
+    return nextId++;
+}
+
+// Sends every queued request in one write.
+void DatabaseClient::flush() {
+    size_t sent = 0;
+    while (sent < output.size()) {
+        ssize_t count = send(fd, output.data() + sent, output.size() - sent, MSG_NOSIGNAL);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error(std::string("send: ") + std::strerror(errno));
+        }
+        sent += count;
+    }
+    output.clear();
+}
+
+Response DatabaseClient::receive() {
+    for (;;) {
+        size_t available = input.size() - consumed;
+        if (available >= 4) {
+            uint32_t length = get<uint32_t>(input.data() + consumed);
+            if (available - 4 >= length) {
+                const char* data = input.data() + consumed + 4;
+                const char* end = data + length;
+                Response response;
+                response.id = get<uint32_t>(data);
+                response.status = static_cast<uint8_t>(data[4]);
+                data += 5;
+                uint8_t opcode = pending.empty() ? 0 : pending.front();
+                if (!pending.empty()) pending.pop_front();
+                int value;
+                std::string key;
+                if (opcode == protocol::OP_RANGE && end - data >= 4) {
+                    uint32_t count = get<uint32_t>(data);
+                    data += 4;
+                    for (uint32_t i = 0; i < count && getRecord(data, end, value, key); i++)
+                        response.records.push_back(std::make_pair(key, value));
+                } else if (opcode == protocol::OP_SEARCH && getRecord(data, end, value, key)) {
+                    response.records.push_back(std::make_pair(key, value));
+                }
+                consumed += 4 + length;
+                if (consumed == input.size()) {
+                    input.clear();
+                    consumed = 0;
+                }
+                return response;
+            }
+        }
+
+        char chunk[65536];
+        ssize_t count = read(fd, chunk, sizeof(chunk));
+        if (count < 0 && errno == EINTR) continue;
+        if (count <= 0)
+            throw std::runtime_error("Connection closed by server");
+        if (consumed) {
+            input.erase(0, consumed);
+            consumed = 0;
+        }
+        input.append(chunk, count);
+    }
+}
+
+Response DatabaseClient::roundTrip(uint32_t id) {
+    flush();
+    Response response = receive();
+    if (response.id != id)
+        throw std::runtime_error("Response out of order");
+    return response;
+}
+
+uint8_t DatabaseClient::insert(const std::string& key, int value) {
+    return roundTrip(queueInsert(key, value)).status;
+}
+
+bool DatabaseClient::search(const std::string& key, int value) {
+    return roundTrip(queueSearch(key, value)).status == protocol::STATUS_OK;
+}
+
+uint8_t DatabaseClient::deleteRecord(const std::string& key, int value) {
+    return roundTrip(queueDelete(key, value)).status;
+}
+
+std::vector<std::pair<std::string, int> > DatabaseClient::rangeQuery(int start, int end) {
+    return roundTrip(queueRange(start, end)).records;
+}
@@ -0,0 +1,130 @@
+#ifndef DB_SERVER_HPP
+#define DB_SERVER_HPP
+
+#include "AVL_Database.hpp"
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Binary protocol over a Unix stream socket, integers in host byte order.
+//   Request:  u32 length | u32 id | u8 opcode | payload        (length counts the bytes after it)
+//     INSERT, SEARCH, DELETE payload: i32 value | u16 key length | key
+//     RANGE payload:                  i32 start | i32 end
+//   Response: u32 length | u32 id | u8 status | payload
+//     SEARCH with STATUS_OK:          i32 value | u16 key length | key
+//     RANGE with STATUS_OK:           u32 count | count x (i32 value | u16 key length | key)
+//     RANGE answers STATUS_BAD_REQUEST if a record in the range has a key over MAX_KEY bytes
+// Requests on a connection may be pipelined; responses come back in request order.
+namespace protocol {
+    const uint8_t OP_INSERT = 1;
+    const uint8_t OP_SEARCH = 2;
+    const uint8_t OP_DELETE = 3;
+    const uint8_t OP_RANGE = 4;
+
+    const uint8_t STATUS_OK = 0;
+    const uint8_t STATUS_NOT_FOUND = 1;             // Search or delete of a record that is not there
+    const uint8_t STATUS_EXISTS = 2;                // Insert of a value that is already there
+    const uint8_t STATUS_BAD_REQUEST = 3;
+
+    const uint32_t MAX_FRAME = 1 << 20;             // Longer requests close the connection
+    const size_t MAX_KEY = 0xFFFF;                  // Longest key the u16 length can carry
+}
+
+// Request and response counters of a running server
+struct ServerStats {
+    long long connections;
+    long long requests;
+    long long batches;                              // Groups of pipelined requests run under one lock
+};
+
+// Serves one IndexedDatabase on a Unix-domain socket. Every worker thread runs its own epoll
+// loop, accepts connections itself and keeps them. Each read drains all pipelined requests a
+// connection has sent, runs them under one acquisition of the database lock and answers them
+// with one write.
+class DatabaseServer {
+private:
+    struct Connection {
+        int fd;
+        std::string input;
+        std::string output;
+        size_t written;
+    };
+
+    IndexedDatabase& database;
+    std::mutex databaseLock;                        // IndexedDatabase is not thread-safe
+    std::vector<Record*> retired;                   // Deleted records buffered ops may still point at
+    std::string path;
+    int workerCount;
+    int listenFd;
+    int wakeFd;                                     // eventfd that wakes every worker to stop
+    std::vector<int> epollFds;                      // One per worker, set up by start
+    std::vector<std::thread> workers;
+    std::atomic<long long> connections;
+    std::atomic<long long> requests;
+    std::atomic<long long> batches;
+
+    void releaseDescriptors();
+    void workerLoop(int epollFd);
+    bool readRequests(Connection& connection);
+    bool writeResponses(Connection& connection);
+    void execute(const char* frame, uint32_t length, std::string& output);
+    void releaseRetired();
+
+    DatabaseServer(const DatabaseServer&);
+    DatabaseServer& operator=(const DatabaseServer&);
+
+public:
+    DatabaseServer(IndexedDatabase& database, const std::string& path, int workers = 1);
+    ~DatabaseServer();
+    void start();                                   // Throws std::runtime_error if the socket or polling cannot be set up
+    void stop();
+    ServerStats getStats() const;
+};
+
+// A decoded response; records holds the found record of a search or the records of a range
+struct Response {
+    uint32_t id;
+    uint8_t status;
+    std::vector<std::pair<std::string, int> > records;
+};
+
+// Blocking client. Requests are queued and sent together by flush, so a batch is pipelined;
+// the insert/search/deleteRecord/rangeQuery helpers do a single round trip each.
+class DatabaseClient {
+private:
+    int fd;
+    uint32_t nextId;
+    std::string output;
+    std::string input;
+    size_t consumed;
+    std::deque<uint8_t> pending;                    // Opcodes of requests not yet answered, oldest first
+
+    uint32_t queue(uint8_t opcode, int value, const std::string& key);
+    Response roundTrip(uint32_t id);
+
+    DatabaseClient(const DatabaseClient&);
+    DatabaseClient& operator=(const DatabaseClient&);
+
+public:
+    explicit DatabaseClient(const std::string& path);  // Throws std::runtime_error if it cannot connect
+    ~DatabaseClient();
+
+    uint32_t queueInsert(const std::string& key, int value);    // Queueing throws std::runtime_error for keys over MAX_KEY
+    uint32_t queueSearch(const std::string& key, int value);
+    uint32_t queueDelete(const std::string& key, int value);
+    uint32_t queueRange(int start, int end);
+    void flush();                                   // Nothing is read meanwhile, so keep batches to a few thousand
+    Response receive();                             // Next response, in request order
+
+    uint8_t insert(const std::string& key, int value);
+    bool search(const std::string& key, int value);
+    uint8_t deleteRecord(const std::string& key, int value);
+    std::vector<std::pair<std::string, int> > rangeQuery(int start, int end);
+};
+
+#endif // DB_SERVER_HPP
@@ -0,0 +1,212 @@
+// calc_bench.cpp
+// Compares the runtime LinkedCalc evaluator with the compile-time StaticCalc path
+// on the same fixed formula, then measures tokenizer throughput on a long expression and
+// exact big-number arithmetic on operands of 10^3 to 10^5 digits.
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "linked_calc.cpp"
+#include "linked_calc_static.hpp"
+#include "linked_calc_simd.hpp"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+using namespace std;
+
+#define BENCH_FORMULA "12.5*4+1024/8-3.75*2+99.125-7/2*6"
+
+// Random valid expression of about length bytes
+static string makeExpression(size_t length) {
+    mt19937 random(47);
+    string expr = "1";
+    while (expr.size() < length) {
+        char operation = "+-*/"[random() % 4];
+        expr += operation;
+        if (operation == '*' || operation == '/') {
+            expr += to_string(random() % 9 + 1) + "." + to_string(random() % 10);      // Keeps every term finite
+        } else {
+            expr += to_string(random() % 10000);
+            if (random() % 2) {
+                expr += "." + to_string(random() % 1000);
+            }
+        }
+    }
+    return expr;
+}
+
+// Cycle counter where there is one, nanoseconds elsewhere
+static unsigned long long ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// Best of several runs of validate over expr, in bytes per tick
+template <typename Validate>
+static double bytesPerTick(const string& expr, Validate validate) {
+    double best = 0.0;
+    for (int run = 0; run < 5; run++) {
+        unsigned long long start = ticks();
+        if (!validate()) {
+            cerr << "Tokenizer rejected the benchmark expression" << endl;
+            exit(1);
+        }
+        double rate = double(expr.size()) / double(ticks() - start);
+        best = rate > best ? rate : best;
+    }
+    return best;
+}
+
+static void benchTokenizer(size_t length) {
+    string expr = makeExpression(length);
+    vector<uint32_t> operators;
+    operators.reserve(expr.size() / 2);
+
+    cout << endl << "tokenizer on " << expr.size() << " bytes, bytes per "
+#if defined(__x86_64__) || defined(__i386__)
+         << "TSC cycle" << endl;
+#else
+         << "ns" << endl;
+#endif
+    cout << "static_calc::validate: "
+         << bytesPerTick(expr, [&] { return static_calc::validate(expr.data(), expr.size()); }) << endl;
+    cout << "tokenize scalar:       "
+         << bytesPerTick(expr, [&] { return simd_calc::tokenize(expr.data(), expr.size(), operators, simd_calc::Isa::Scalar); }) << endl;
+#if defined(__x86_64__) || defined(__i386__)
+    cout << "tokenize sse2:         "
+         << bytesPerTick(expr, [&] { return simd_calc::tokenize(expr.data(), expr.size(), operators, simd_calc::Isa::Sse2); }) << endl;
+    if (__builtin_cpu_supports("avx2")) {
+        cout << "tokenize avx2:         "
+             << bytesPerTick(expr, [&] { return simd_calc::tokenize(expr.data(), expr.size(), operators, simd_calc::Isa::Avx2); }) << endl;
+    }
+#endif
+
+    auto start = chrono::steady_clock::now();
+    float staticResult = static_calc::evaluate(expr.data(), expr.size());
+    auto mid = chrono::steady_clock::now();
+    simd_calc::tokenize(expr.data(), expr.size(), operators);
+    float simdResult = simd_calc::evaluate(expr.data(), expr.size(), operators);
+    auto end = chrono::steady_clock::now();
+    cout << "static_calc::evaluate: " << chrono::duration<double, milli>(mid - start).count() << " ms" << endl;
+    cout << "tokenize + evaluate:   " << chrono::duration<double, milli>(end - mid).count() << " ms"
+         << (simdResult == staticResult ? "" : "  (results differ)") << endl;
+
+    // insert walks the list, so building a LinkedCalc is quadratic; keep this one short
+    string shortExpr = makeExpression(16 * 1024);
+    LinkedCalc<char> calc;
+    for (char c : shortExpr) {
+        calc.insert(c);
+    }
+    cout << "validateExpression on " << shortExpr.size() << " bytes: "
+         << bytesPerTick(shortExpr, [&] { return calc.validateExpression(); }) << endl;
+}
+
+// Random number of exactly the given number of digits
+static string randomDigits(size_t digits, mt19937& random) {
+    string result(digits, '0');
+    for (char& c : result) {
+        c = static_cast<char>('0' + random() % 10);
+    }
+    result[0] = static_cast<char>('1' + random() % 9);
+    return result;
+}
+
+static big_calc::BigInteger parseInteger(const string& digits) {
+    big_calc::DecimalParser parser;
+    for (char c : digits) {
+        parser.digit(c - '0');
+    }
+    return parser.finish().getUnscaled();
+}
+
+// Average milliseconds of run over enough repetitions to last about 0.2 s
+template <typename Run>
+static double averageMs(Run run) {
+    int repetitions = 0;
+    auto start = chrono::steady_clock::now();
+    double elapsed = 0.0;
+    do {
+        run();
+        repetitions++;
+        elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    } while (elapsed < 200.0);
+    return elapsed / repetitions;
+}
+
+static void benchExact() {
+    mt19937 random(48);
+    cout << endl << "exact arithmetic, Karatsuba above " << big_calc::KARATSUBA_THRESHOLD << " limbs, ms per operation" << endl;
+    cout << "digits        parse   schoolbook    karatsuba  divide 2n/n" << endl;
+    for (size_t digits : {1000, 10000, 100000}) {
+        string aDigits = randomDigits(digits, random);
+        big_calc::BigInteger a = parseInteger(aDigits);
+        big_calc::BigInteger b = parseInteger(randomDigits(digits, random));
+        big_calc::BigInteger product = a * b;
+        double parseMs = averageMs([&] { parseInteger(aDigits); });
+        double schoolbookMs = averageMs([&] { big_calc::BigInteger::multiply(a, b, SIZE_MAX); });
+        double karatsubaMs = averageMs([&] { big_calc::BigInteger::multiply(a, b); });
+        double divideMs = averageMs([&] { big_calc::BigInteger::divide(product, b); });
+        cout << left << setw(8) << digits << right << fixed << setprecision(3) << setw(11) << parseMs << setw(13)
+             << schoolbookMs << setw(13) << karatsubaMs << setw(13) << divideMs << endl;
+    }
+
+    // Whole expressions through the node list; insert walks the list, so stay at 10^4 digits
+    for (size_t digits : {1000, 10000}) {
+        string expr = randomDigits(digits, random) + "*" + randomDigits(digits, random) + "-" + randomDigits(digits, random) + ".5";
+        LinkedCalc<char> calc;
+        for (char c : expr) {
+            calc.insert(c);
+        }
+        double exactMs = averageMs([&] { calc.evaluateExact(); });
+        cout << "evaluateExact, " << digits << "-digit operands: " << exactMs << " ms (evaluateExpression gives "
+             << calc.evaluateExpression() << ")" << endl;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    long iterations = (argc > 1) ? atol(argv[1]) : 1000000;
+
+    LinkedCalc<char> calc;
+    for (const char* c = BENCH_FORMULA; *c != '\0'; c++) {
+        calc.insert(*c);
+    }
+    if (!calc.validateExpression()) {
+        cerr << "Benchmark formula is invalid" << endl;
+        return 1;
+    }
+
+    volatile float sink = 0.0f;                                                         // Keeps results observable
+
+    auto start = chrono::steady_clock::now();
+    for (long i = 0; i < iterations; i++) {
+        sink = calc.evaluateExpression();
+    }
+    auto mid = chrono::steady_clock::now();
+    StaticCalc<BENCH_FORMULA> compiled;
+    for (long i = 0; i < iterations; i++) {
+        sink = compiled();
+    }
+    auto end = chrono::steady_clock::now();
+
+    double runtimeNs = chrono::duration<double, nano>(mid - start).count() / iterations;
+    double staticNs = chrono::duration<double, nano>(end - mid).count() / iterations;
+
+    cout << "formula:            " << BENCH_FORMULA << endl;
+    cout << "iterations:         " << iterations << endl;
+    cout << "runtime result:     " << calc.evaluateExpression() << endl;
+    cout << "static result:      " << compiled() << endl;
+    cout << "evaluateExpression: " << runtimeNs << " ns/eval" << endl;
+    cout << "StaticCalc:         " << staticNs << " ns/eval" << endl;
+    (void)sink;
+
+    benchTokenizer(8 << 20);
+    benchExact();
+    return 0;
+}
@@ -4,6 +4,8 @@ Project Description: This project implements a basic calculator using a singly l
 */
 
 #include "linked_calc.hpp"
+#include <cmath>
+#include <stdexcept>
 
 // Default constructor definition
 template <typename T>
@@ -179,3 +181,59 @@ float LinkedCalc<T>::evaluateExpression() {
     return totalResult; // Return the final evaluated result of the expression
 }
 
+// Read the number starting at current into an exact decimal, leaving current on the node after it
+template <typename T>
+big_calc::BigDecimal LinkedCalc<T>::parseExact(Node<T>*& current) {
+    big_calc::DecimalParser parser;
+    while (current != nullptr && (isDigit(current->data) || current->data == '.')) {
+        if (current->data == '.') {
+            parser.point();
+        } else {
+            parser.digit(current->data - '0'); // Digits go into base 10^9 limbs nine at a time
+        }
+        current = current->next;
+    }
+    return parser.finish();
+}
+
+// Function to evaluate the expression exactly, with the same precedence as evaluateExpression
+// Addition, subtraction and multiplication are exact; a division keeps divisionDigits decimal places
+template <typename T>
+big_calc::BigDecimal LinkedCalc<T>::evaluateExact(std::size_t divisionDigits) {
+    Node<T>* tempNode = head;
+    big_calc::BigDecimal totalResult;                                   // Holds the cumulative result of the expression
+    big_calc::BigDecimal currentNumber = parseExact(tempNode);          // Product or quotient being built
+    char lastOperation = '+';
+
+    while (tempNode != nullptr) {
+        char operation = tempNode->data;
+        tempNode = tempNode->next;
+        big_calc::BigDecimal nextNumber = parseExact(tempNode);
+
+        if (operation == '*') {
+            currentNumber = currentNumber * nextNumber;
+        } else if (operation == '/') {
+            if (nextNumber.isZero()) {
+                throw std::runtime_error("Division by zero."); // Throw an error if division by zero is attempted
+            }
+            currentNumber = big_calc::BigDecimal::divide(currentNumber, nextNumber, divisionDigits);
+        } else {
+            if (lastOperation == '+') {
+                totalResult = totalResult + currentNumber;
+            } else if (lastOperation == '-') {
+                totalResult = totalResult - currentNumber;
+            }
+            lastOperation = operation;
+            currentNumber = nextNumber;
+        }
+    }
+
+    // Final operation to handle the last number in the expression
+    if (lastOperation == '+') {
+        totalResult = totalResult + currentNumber;
+    } else if (lastOperation == '-') {
+        totalResult = totalResult - currentNumber;
+    }
+
+    return totalResult;
+}
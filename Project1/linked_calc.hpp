@@ -2,6 +2,7 @@
 #define LINKED_CALC_HPP
 
 #include <iostream>
+#include "linked_calc_bignum.hpp"
 
 // Node structure
 template <typename T>
@@ -21,11 +22,13 @@ public:
     void insert(const T& value);
     bool validateExpression();
     float evaluateExpression();
+    big_calc::BigDecimal evaluateExact(std::size_t divisionDigits = 32);
 
 private:
     Node<T>* head;
     bool isDigit(const T& c);
     float convertToFloat(Node<T>*& current);
+    big_calc::BigDecimal parseExact(Node<T>*& current);
 };
 
 
@@ -0,0 +1,449 @@
+#ifndef LINKED_CALC_BIGNUM_HPP
+#define LINKED_CALC_BIGNUM_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Exact arithmetic for LinkedCalc::evaluateExact.
+// BigInteger keeps a magnitude in base 10^9 limbs, least significant first, so parsing and
+// printing decimal digits never needs a base conversion. Products use schoolbook
+// multiplication below KARATSUBA_THRESHOLD limbs and Karatsuba above it. BigDecimal is a
+// BigInteger with a count of digits after the decimal point; addition, subtraction and
+// multiplication are exact, and division stops after a requested number of decimal places.
+
+namespace big_calc {
+
+typedef uint32_t Limb;
+
+const Limb BASE = 1000000000;
+const int BASE_DIGITS = 9;
+const std::size_t KARATSUBA_THRESHOLD = 32;                                             // Limbs; measured with calc_bench
+
+// Limb array helpers. Lengths are in limbs and arrays are least significant first.
+
+// dst[0, dstLength) += src[0, srcLength), carrying into dst; srcLength <= dstLength
+inline void addInto(Limb* dst, std::size_t dstLength, const Limb* src, std::size_t srcLength) {
+    Limb carry = 0;
+    std::size_t i = 0;
+    for (; i < srcLength; i++) {
+        Limb sum = dst[i] + src[i] + carry;
+        carry = sum >= BASE;
+        dst[i] = carry ? sum - BASE : sum;
+    }
+    for (; carry && i < dstLength; i++) {
+        carry = ++dst[i] == BASE;
+        if (carry) {
+            dst[i] = 0;
+        }
+    }
+}
+
+// dst[0, dstLength) -= src[0, srcLength); the result must not be negative
+inline void subtractInto(Limb* dst, std::size_t dstLength, const Limb* src, std::size_t srcLength) {
+    Limb borrow = 0;
+    std::size_t i = 0;
+    for (; i < srcLength; i++) {
+        Limb subtrahend = src[i] + borrow;
+        borrow = dst[i] < subtrahend;
+        dst[i] = borrow ? dst[i] + BASE - subtrahend : dst[i] - subtrahend;
+    }
+    for (; borrow && i < dstLength; i++) {
+        borrow = dst[i] == 0;
+        dst[i] = borrow ? BASE - 1 : dst[i] - 1;
+    }
+}
+
+// out[0, aLength + bLength) = a * b; out must start zeroed
+inline void multiplySchoolbook(const Limb* a, std::size_t aLength, const Limb* b, std::size_t bLength, Limb* out) {
+    for (std::size_t i = 0; i < aLength; i++) {
+        uint64_t carry = 0;
+        uint64_t ai = a[i];
+        for (std::size_t j = 0; j < bLength; j++) {
+            uint64_t t = out[i + j] + ai * b[j] + carry;                                // < 2^64: (BASE-1)^2 + 2 * BASE
+            carry = t / BASE;
+            out[i + j] = static_cast<Limb>(t - carry * BASE);
+        }
+        out[i + bLength] = static_cast<Limb>(carry);
+    }
+}
+
+// out[0, aLength + bLength) = a * b; out must start zeroed
+inline void multiplyInto(const Limb* a, std::size_t aLength, const Limb* b, std::size_t bLength, Limb* out,
+                         std::size_t threshold) {
+    if (aLength < bLength) {
+        std::swap(a, b);
+        std::swap(aLength, bLength);
+    }
+    if (bLength == 0) {
+        return;
+    }
+    if (bLength < threshold || bLength < 4) {                                          // Below four limbs the halves would not shrink
+        multiplySchoolbook(a, aLength, b, bLength, out);
+        return;
+    }
+    if (aLength >= 2 * bLength) {
+        // Unbalanced: multiply b by slices of a as long as b, so every product stays balanced
+        std::vector<Limb> partial(2 * bLength);
+        for (std::size_t offset = 0; offset < aLength; offset += bLength) {
+            std::size_t slice = std::min(bLength, aLength - offset);
+            std::fill(partial.begin(), partial.end(), 0);
+            multiplyInto(a + offset, slice, b, bLength, partial.data(), threshold);
+            addInto(out + offset, aLength + bLength - offset, partial.data(), slice + bLength);
+        }
+        return;
+    }
+
+    // Karatsuba: a = a1 * B^m + a0, b = b1 * B^m + b0, and b1 is not empty because aLength < 2 * bLength
+    std::size_t m = aLength / 2;
+    const Limb* a1 = a + m;
+    const Limb* b1 = b + m;
+    std::size_t a1Length = aLength - m;
+    std::size_t b1Length = bLength - m;
+
+    multiplyInto(a, m, b, m, out, threshold);                                           // z0 = a0 * b0 in out[0, 2m)
+    multiplyInto(a1, a1Length, b1, b1Length, out + 2 * m, threshold);                   // z2 = a1 * b1 in out[2m, ...)
+
+    std::vector<Limb> aSum(a1Length + 1, 0);                                            // a0 + a1
+    std::copy(a1, a1 + a1Length, aSum.begin());
+    addInto(aSum.data(), aSum.size(), a, m);
+    std::vector<Limb> bSum(std::max(m, b1Length) + 1, 0);                               // b0 + b1
+    std::copy(b, b + m, bSum.begin());
+    addInto(bSum.data(), bSum.size(), b1, b1Length);
+
+    std::vector<Limb> middle(aSum.size() + bSum.size(), 0);                             // z1 = (a0 + a1)(b0 + b1) - z0 - z2
+    multiplyInto(aSum.data(), aSum.size(), bSum.data(), bSum.size(), middle.data(), threshold);
+    subtractInto(middle.data(), middle.size(), out, 2 * m);
+    subtractInto(middle.data(), middle.size(), out + 2 * m, a1Length + b1Length);
+
+    std::size_t middleLength = middle.size();
+    while (middleLength > 0 && middle[middleLength - 1] == 0) {
+        middleLength--;
+    }
+    addInto(out + m, aLength + bLength - m, middle.data(), middleLength);
+}
+
+// Signed integer of any size
+class BigInteger {
+public:
+    BigInteger() : negative(false) {}
+
+    BigInteger(uint64_t value) : negative(false) {
+        while (value > 0) {
+            limbs.push_back(static_cast<Limb>(value % BASE));
+            value /= BASE;
+        }
+    }
+
+    // Takes limbs least significant first, dropping leading zeros
+    static BigInteger fromLimbs(std::vector<Limb> limbs, bool negative = false) {
+        BigInteger result;
+        result.limbs.swap(limbs);
+        result.negative = negative;
+        result.trim();
+        return result;
+    }
+
+    bool isZero() const { return limbs.empty(); }
+    bool isNegative() const { return negative; }
+    const std::vector<Limb>& getLimbs() const { return limbs; }
+
+    // Compares absolute values: negative, zero or positive like strcmp
+    static int compareMagnitude(const BigInteger& a, const BigInteger& b) {
+        if (a.limbs.size() != b.limbs.size()) {
+            return a.limbs.size() < b.limbs.size() ? -1 : 1;
+        }
+        for (std::size_t i = a.limbs.size(); i-- > 0;) {
+            if (a.limbs[i] != b.limbs[i]) {
+                return a.limbs[i] < b.limbs[i] ? -1 : 1;
+            }
+        }
+        return 0;
+    }
+
+    BigInteger operator-() const {
+        BigInteger result = *this;
+        result.negative = !negative && !isZero();
+        return result;
+    }
+
+    friend BigInteger operator+(const BigInteger& a, const BigInteger& b) {
+        if (a.negative == b.negative) {
+            const BigInteger& longer = a.limbs.size() >= b.limbs.size() ? a : b;
+            const BigInteger& shorter = a.limbs.size() >= b.limbs.size() ? b : a;
+            std::vector<Limb> sum(longer.limbs);
+            sum.push_back(0);
+            addInto(sum.data(), sum.size(), shorter.limbs.data(), shorter.limbs.size());
+            return fromLimbs(sum, a.negative);
+        }
+        // Signs differ: subtract the smaller magnitude from the larger and keep its sign
+        int order = compareMagnitude(a, b);
+        if (order == 0) {
+            return BigInteger();
+        }
+        const BigInteger& larger = order > 0 ? a : b;
+        const BigInteger& smaller = order > 0 ? b : a;
+        std::vector<Limb> difference(larger.limbs);
+        subtractInto(difference.data(), difference.size(), smaller.limbs.data(), smaller.limbs.size());
+        return fromLimbs(difference, larger.negative);
+    }
+
+    friend BigInteger operator-(const BigInteger& a, const BigInteger& b) {
+        return a + -b;
+    }
+
+    // Product using schoolbook multiplication while either operand is below threshold limbs
+    static BigInteger multiply(const BigInteger& a, const BigInteger& b, std::size_t threshold = KARATSUBA_THRESHOLD) {
+        if (a.isZero() || b.isZero()) {
+            return BigInteger();
+        }
+        std::vector<Limb> product(a.limbs.size() + b.limbs.size(), 0);
+        multiplyInto(a.limbs.data(), a.limbs.size(), b.limbs.data(), b.limbs.size(), product.data(), threshold);
+        return fromLimbs(product, a.negative != b.negative);
+    }
+
+    friend BigInteger operator*(const BigInteger& a, const BigInteger& b) {
+        return multiply(a, b);
+    }
+
+    // Quotient rounded toward zero; throws std::runtime_error when divisor is zero
+    static BigInteger divide(const BigInteger& dividend, const BigInteger& divisor) {
+        if (divisor.isZero()) {
+            throw std::runtime_error("Division by zero.");
+        }
+        bool negative = dividend.negative != divisor.negative;
+        if (compareMagnitude(dividend, divisor) < 0) {
+            return BigInteger();
+        }
+
+        std::size_t n = divisor.limbs.size();
+        std::size_t m = dividend.limbs.size() - n;
+        std::vector<Limb> quotient(m + 1, 0);
+        if (n == 1) {
+            uint64_t remainder = 0;
+            uint64_t d = divisor.limbs[0];
+            for (std::size_t i = dividend.limbs.size(); i-- > 0;) {
+                uint64_t current = remainder * BASE + dividend.limbs[i];
+                quotient[i] = static_cast<Limb>(current / d);
+                remainder = current % d;
+            }
+            return fromLimbs(quotient, negative);
+        }
+
+        // Knuth's algorithm D. Scaling both operands so the divisor's top limb is at least
+        // BASE / 2 makes each estimated quotient limb at most two too large.
+        Limb scale = static_cast<Limb>(BASE / (uint64_t(divisor.limbs[n - 1]) + 1));
+        std::vector<Limb> u = scaled(dividend.limbs, scale);                            // m + n + 1 limbs
+        std::vector<Limb> v = scaled(divisor.limbs, scale);
+        v.pop_back();                                                                   // Scaling never lengthens the divisor
+
+        for (std::size_t j = m + 1; j-- > 0;) {
+            uint64_t numerator = uint64_t(u[j + n]) * BASE + u[j + n - 1];
+            uint64_t estimate = numerator / v[n - 1];
+            uint64_t remainder = numerator % v[n - 1];
+            while (estimate >= BASE || estimate * v[n - 2] > remainder * BASE + u[j + n - 2]) {
+                estimate--;
+                remainder += v[n - 1];
+                if (remainder >= BASE) {
+                    break;
+                }
+            }
+
+            // u[j, j + n] -= estimate * v
+            uint64_t carry = 0;
+            int64_t borrow = 0;
+            for (std::size_t i = 0; i < n; i++) {
+                uint64_t product = estimate * v[i] + carry;
+                carry = product / BASE;
+                int64_t digit = int64_t(u[i + j]) - int64_t(product - carry * BASE) - borrow;
+                borrow = digit < 0;
+                u[i + j] = static_cast<Limb>(digit < 0 ? digit + BASE : digit);
+            }
+            int64_t top = int64_t(u[j + n]) - int64_t(carry) - borrow;
+            if (top < 0) {
+                // The estimate was one too large: add v back
+                estimate--;
+                Limb addCarry = 0;
+                for (std::size_t i = 0; i < n; i++) {
+                    Limb sum = u[i + j] + v[i] + addCarry;
+                    addCarry = sum >= BASE;
+                    u[i + j] = addCarry ? sum - BASE : sum;
+                }
+                top += addCarry;
+            }
+            u[j + n] = static_cast<Limb>(top);
+            quotient[j] = static_cast<Limb>(estimate);
+        }
+        return fromLimbs(quotient, negative);
+    }
+
+    // this * 10^digits
+    BigInteger shiftDecimal(std::size_t digits) const {
+        if (isZero() || digits == 0) {
+            return *this;
+        }
+        Limb factor = 1;
+        for (std::size_t i = 0; i < digits % BASE_DIGITS; i++) {
+            factor *= 10;
+        }
+        std::vector<Limb> shifted(digits / BASE_DIGITS, 0);
+        std::vector<Limb> multiplied = scaled(limbs, factor);
+        shifted.insert(shifted.end(), multiplied.begin(), multiplied.end());
+        return fromLimbs(shifted, negative);
+    }
+
+    // Decimal digits with a leading '-' when negative
+    std::string toString() const {
+        if (isZero()) {
+            return "0";
+        }
+        std::string result = negative ? "-" : "";
+        result += std::to_string(limbs.back());
+        for (std::size_t i = limbs.size() - 1; i-- > 0;) {
+            std::string limb = std::to_string(limbs[i]);
+            result.append(BASE_DIGITS - limb.size(), '0');
+            result += limb;
+        }
+        return result;
+    }
+
+private:
+    std::vector<Limb> limbs;
+    bool negative;
+
+    void trim() {
+        while (!limbs.empty() && limbs.back() == 0) {
+            limbs.pop_back();
+        }
+        if (limbs.empty()) {
+            negative = false;
+        }
+    }
+
+    // limbs * factor with one extra limb for the carry; factor < BASE
+    static std::vector<Limb> scaled(const std::vector<Limb>& limbs, Limb factor) {
+        std::vector<Limb> result(limbs.size() + 1);
+        uint64_t carry = 0;
+        for (std::size_t i = 0; i < limbs.size(); i++) {
+            uint64_t t = uint64_t(limbs[i]) * factor + carry;
+            carry = t / BASE;
+            result[i] = static_cast<Limb>(t - carry * BASE);
+        }
+        result[limbs.size()] = static_cast<Limb>(carry);
+        return result;
+    }
+};
+
+// unscaled / 10^scale
+class BigDecimal {
+public:
+    BigDecimal() : scale(0) {}
+    BigDecimal(const BigInteger& unscaled, std::size_t scale) : unscaled(unscaled), scale(scale) {}
+
+    bool isZero() const { return unscaled.isZero(); }
+    const BigInteger& getUnscaled() const { return unscaled; }
+    std::size_t getScale() const { return scale; }
+
+    friend BigDecimal operator+(const BigDecimal& a, const BigDecimal& b) {
+        std::size_t common = std::max(a.scale, b.scale);
+        return BigDecimal(a.unscaled.shiftDecimal(common - a.scale) + b.unscaled.shiftDecimal(common - b.scale), common);
+    }
+
+    friend BigDecimal operator-(const BigDecimal& a, const BigDecimal& b) {
+        return a + BigDecimal(-b.unscaled, b.scale);
+    }
+
+    friend BigDecimal operator*(const BigDecimal& a, const BigDecimal& b) {
+        return BigDecimal(a.unscaled * b.unscaled, a.scale + b.scale);
+    }
+
+    // Quotient cut off (toward zero) after digits decimal places; throws std::runtime_error
+    // when divisor is zero
+    static BigDecimal divide(const BigDecimal& dividend, const BigDecimal& divisor, std::size_t digits) {
+        // dividend / divisor = (A / 10^a) / (B / 10^b), and the result is Q / 10^digits with
+        // Q = A * 10^(b + digits - a) / B, moving the power of ten to B when it is negative
+        std::size_t up = divisor.scale + digits;
+        BigInteger numerator = dividend.unscaled;
+        BigInteger denominator = divisor.unscaled;
+        if (up >= dividend.scale) {
+            numerator = numerator.shiftDecimal(up - dividend.scale);
+        } else {
+            denominator = denominator.shiftDecimal(dividend.scale - up);
+        }
+        return BigDecimal(BigInteger::divide(numerator, denominator), digits);
+    }
+
+    // Plain decimal notation without trailing zeros after the point, e.g. "-12.5"
+    std::string toString() const {
+        std::string digits = unscaled.toString();
+        bool negative = unscaled.isNegative();
+        if (negative) {
+            digits.erase(0, 1);
+        }
+        if (digits.size() <= scale) {
+            digits.insert(0, scale + 1 - digits.size(), '0');
+        }
+        std::size_t integerDigits = digits.size() - scale;
+        std::size_t end = digits.size();
+        while (end > integerDigits && digits[end - 1] == '0') {
+            end--;
+        }
+        std::string result = negative ? "-" : "";
+        result.append(digits, 0, integerDigits);
+        if (end > integerDigits) {
+            result += '.';
+            result.append(digits, integerDigits, end - integerDigits);
+        }
+        return result;
+    }
+
+private:
+    BigInteger unscaled;
+    std::size_t scale;                                                                  // Digits after the decimal point
+};
+
+// Builds a BigDecimal from a stream of digits and at most one decimal point, nine digits to a
+// limb, so a number can be read straight from a LinkedCalc node list without copying it
+class DecimalParser {
+public:
+    DecimalParser() : chunk(0), chunkDigits(0), scale(0), afterPoint(false) {}
+
+    void digit(int value) {
+        chunk = chunk * 10 + static_cast<Limb>(value);
+        if (++chunkDigits == BASE_DIGITS) {
+            chunks.push_back(chunk);
+            chunk = 0;
+            chunkDigits = 0;
+        }
+        if (afterPoint) {
+            scale++;
+        }
+    }
+
+    void point() { afterPoint = true; }
+
+    BigDecimal finish() {
+        // The chunks were cut from the most significant end, so they are nine-digit groups of
+        // the number without its last chunkDigits digits: reverse them into limbs, then shift
+        // left by chunkDigits and add the leftover digits
+        std::reverse(chunks.begin(), chunks.end());
+        BigInteger whole = BigInteger::fromLimbs(chunks).shiftDecimal(chunkDigits) + BigInteger(chunk);
+        BigDecimal result(whole, scale);
+        *this = DecimalParser();
+        return result;
+    }
+
+private:
+    std::vector<Limb> chunks;                                                           // Complete nine-digit groups, in reading order
+    Limb chunk;
+    int chunkDigits;
+    std::size_t scale;
+    bool afterPoint;
+};
+
+} // namespace big_calc
+
+#endif // LINKED_CALC_BIGNUM_HPP
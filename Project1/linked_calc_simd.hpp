@@ -0,0 +1,233 @@
+#ifndef LINKED_CALC_SIMD_HPP
+#define LINKED_CALC_SIMD_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#include "linked_calc_static.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LINKED_CALC_SIMD_X86 1
+#endif
+
+// Fast path for LinkedCalc expressions held in one contiguous buffer.
+// Characters are classified 64 at a time into digit, operator and decimal point bitmasks
+// (AVX2 or SSE2 where the CPU has them, plain loops elsewhere), the grammar of
+// LinkedCalc::validateExpression is checked on the masks, and the operator offsets are kept
+// so evaluate() can compute the same float as LinkedCalc::evaluateExpression without
+// classifying any character again.
+
+namespace simd_calc {
+
+enum class Isa { Scalar, Sse2, Avx2 };
+
+// Bitmasks of one 64-byte block, bit i for byte i
+struct BlockMasks {
+    uint64_t digits;
+    uint64_t operators;
+    uint64_t dots;
+};
+
+inline BlockMasks classifyScalar(const char* block) {
+    BlockMasks masks = {0, 0, 0};
+    for (int i = 0; i < 64; i++) {
+        char c = block[i];
+        uint64_t bit = uint64_t(1) << i;
+        if (c >= '0' && c <= '9') {
+            masks.digits |= bit;
+        } else if (c == '+' || c == '-' || c == '*' || c == '/') {
+            masks.operators |= bit;
+        } else if (c == '.') {
+            masks.dots |= bit;
+        }
+    }
+    return masks;
+}
+
+#ifdef LINKED_CALC_SIMD_X86
+// One 16-byte lane: digits are the bytes with c - '0' <= 9 unsigned
+inline void classifyLane(__m128i v, uint64_t shift, BlockMasks& masks) {
+    __m128i offset = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+    __m128i digits = _mm_cmpeq_epi8(_mm_min_epu8(offset, _mm_set1_epi8(9)), offset);
+    __m128i operators = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('+')), _mm_cmpeq_epi8(v, _mm_set1_epi8('-'))),
+                                     _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('*')), _mm_cmpeq_epi8(v, _mm_set1_epi8('/'))));
+    masks.digits |= uint64_t(uint16_t(_mm_movemask_epi8(digits))) << shift;
+    masks.operators |= uint64_t(uint16_t(_mm_movemask_epi8(operators))) << shift;
+    masks.dots |= uint64_t(uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('.'))))) << shift;
+}
+
+inline BlockMasks classifySse2(const char* block) {
+    BlockMasks masks = {0, 0, 0};
+    for (int lane = 0; lane < 4; lane++) {
+        classifyLane(_mm_loadu_si128(reinterpret_cast<const __m128i*>(block + lane * 16)), lane * 16, masks);
+    }
+    return masks;
+}
+
+__attribute__((target("avx2"))) inline BlockMasks classifyAvx2(const char* block) {
+    BlockMasks masks = {0, 0, 0};
+    for (int half = 0; half < 2; half++) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + half * 32));
+        __m256i offset = _mm256_sub_epi8(v, _mm256_set1_epi8('0'));
+        __m256i digits = _mm256_cmpeq_epi8(_mm256_min_epu8(offset, _mm256_set1_epi8(9)), offset);
+        __m256i operators = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('+')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('-'))),
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('*')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('/'))));
+        int shift = half * 32;
+        masks.digits |= uint64_t(uint32_t(_mm256_movemask_epi8(digits))) << shift;
+        masks.operators |= uint64_t(uint32_t(_mm256_movemask_epi8(operators))) << shift;
+        masks.dots |= uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('.'))))) << shift;
+    }
+    return masks;
+}
+#endif
+
+// Widest instruction set this CPU supports
+inline Isa bestIsa() {
+#ifdef LINKED_CALC_SIMD_X86
+    return __builtin_cpu_supports("avx2") ? Isa::Avx2 : Isa::Sse2;
+#else
+    return Isa::Scalar;
+#endif
+}
+
+inline BlockMasks classify(const char* block, Isa isa) {
+#ifdef LINKED_CALC_SIMD_X86
+    if (isa == Isa::Avx2) {
+        return classifyAvx2(block);
+    }
+    if (isa == Isa::Sse2) {
+        return classifySse2(block);
+    }
+#endif
+    (void)isa;
+    return classifyScalar(block);
+}
+
+// Positions where a scan started at each bit of starts stops after skipping the bits of skip.
+// The addition carries every start through its run of skipped bits; carry is set when a run
+// reaches the end of the block and clear otherwise, and feeds the next block.
+inline uint64_t skipRuns(uint64_t starts, uint64_t skip, bool& carry) {
+    uint64_t sum;
+    carry = __builtin_add_overflow(starts, skip, &sum);
+    return sum & ~skip;
+}
+
+// Grows offsets by count entries and returns where they start
+inline uint32_t* reserveOffsets(std::vector<uint32_t>& offsets, std::size_t count) {
+    std::size_t size = offsets.size();
+    offsets.resize(size + count);
+    return offsets.data() + size;
+}
+
+// Validates expr[0, length) with the grammar of LinkedCalc::validateExpression and, if it is
+// valid, leaves the offset of every operator in operators. A whole block is checked with a
+// few bit operations rather than a character at a time: skipping the decimal points after
+// an operator (or the start) must land on a digit, and skipping the digits after a decimal
+// point must not land on another decimal point.
+inline bool tokenize(const char* expr, std::size_t length, std::vector<uint32_t>& operators, Isa isa = bestIsa()) {
+    operators.clear();
+    if (length == 0 || length > UINT32_MAX) {
+        return false;                                                                   // Empty, or too long for the offsets
+    }
+
+    bool afterOperator = true;                                                          // Start counts as an operator
+    bool afterDot = false;
+    char tail[64];
+    for (std::size_t base = 0; base < length; base += 64) {
+        const char* block = expr + base;
+        uint64_t valid = ~uint64_t(0);
+        if (length - base < 64) {
+            std::memset(tail, 0, sizeof(tail));                                         // Bytes past the end classify as nothing
+            std::memcpy(tail, block, length - base);
+            block = tail;
+            valid = (uint64_t(1) << (length - base)) - 1;
+        }
+
+        BlockMasks masks = classify(block, isa);
+        if ((masks.digits | masks.operators | masks.dots) != valid) {
+            return false;                                                               // Invalid character
+        }
+
+        bool carry;
+        uint64_t numberStarts = skipRuns(masks.operators << 1 | uint64_t(afterOperator), masks.dots, carry);
+        if (numberStarts & (masks.operators | ~valid)) {
+            return false;                                                               // Operator or end without a preceding number
+        }
+        afterOperator = carry || masks.operators >> 63;
+
+        uint64_t afterDigits = skipRuns(masks.dots << 1 | uint64_t(afterDot), masks.digits, carry);
+        if (afterDigits & masks.dots) {
+            return false;                                                               // Two decimal points in one number
+        }
+        afterDot = carry || masks.dots >> 63;
+
+        uint32_t* out = reserveOffsets(operators, __builtin_popcountll(masks.operators));
+        for (uint64_t bits = masks.operators; bits != 0; bits &= bits - 1) {
+            *out++ = static_cast<uint32_t>(base + __builtin_ctzll(bits));
+        }
+    }
+    return !afterOperator;                                                              // Must end with a number
+}
+
+// Reads the number in expr[begin, end) the way LinkedCalc::evaluateExpression builds one
+inline float parseNumber(const char* expr, std::size_t begin, std::size_t end) {
+    float number = 0.0f;
+    bool foundDecimal = false;
+    int decimalCount = 0;
+    for (std::size_t i = begin; i < end; i++) {
+        if (expr[i] == '.') {
+            foundDecimal = true;
+        } else if (foundDecimal) {
+            decimalCount++;
+            number += (expr[i] - '0') / static_calc::pow10(decimalCount);
+        } else {
+            number = number * 10 + (expr[i] - '0');
+        }
+    }
+    return number;
+}
+
+// Evaluates an expression tokenize() accepted, from its operator offsets. Multiplication and
+// division apply to the running term at once and addition and subtraction close it, as in
+// LinkedCalc::evaluateExpression, so both give the same float.
+inline float evaluate(const char* expr, std::size_t length, const std::vector<uint32_t>& operators) {
+    float totalResult = 0.0f;
+    char lastOperation = '+';
+    float currentNumber = parseNumber(expr, 0, operators.empty() ? length : operators[0]);
+    for (std::size_t k = 0; k < operators.size(); k++) {
+        char operation = expr[operators[k]];
+        std::size_t end = k + 1 < operators.size() ? operators[k + 1] : length;
+        float nextNumber = parseNumber(expr, operators[k] + 1, end);
+        if (operation == '*') {
+            currentNumber *= nextNumber;
+        } else if (operation == '/') {
+            if (nextNumber == 0) {
+                throw std::runtime_error("Division by zero.");
+            }
+            currentNumber /= nextNumber;
+        } else {
+            if (lastOperation == '+') {
+                totalResult += currentNumber;
+            } else {
+                totalResult -= currentNumber;
+            }
+            lastOperation = operation;
+            currentNumber = nextNumber;
+        }
+    }
+
+    if (lastOperation == '+') {
+        totalResult += currentNumber;
+    } else {
+        totalResult -= currentNumber;
+    }
+    return totalResult;
+}
+
+} // namespace simd_calc
+
+#endif // LINKED_CALC_SIMD_HPP
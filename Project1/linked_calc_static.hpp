@@ -0,0 +1,160 @@
+#ifndef LINKED_CALC_STATIC_HPP
+#define LINKED_CALC_STATIC_HPP
+
+#include <cstddef>
+#include <stdexcept>
+
+// Compile-time evaluation of fixed LinkedCalc formulas.
+// An expression written as a string literal is validated and evaluated while compiling,
+// using the same grammar as LinkedCalc::validateExpression and the same arithmetic as
+// LinkedCalc::evaluateExpression, so StaticCalc<"1.5+2*3">{}() is a plain float constant.
+// An invalid expression fails the static_assert, and a division by zero stops constant evaluation.
+
+// String literal wrapper that can be passed as a template argument
+template <std::size_t N>
+struct FixedExpression {
+    char data[N];
+
+    constexpr FixedExpression(const char (&str)[N]) : data() {
+        for (std::size_t i = 0; i < N; i++) {
+            data[i] = str[i];
+        }
+    }
+
+    constexpr std::size_t size() const { return N - 1; }                                // Length without the terminator
+};
+
+namespace static_calc {
+
+constexpr bool isDigit(char c) {
+    return (c >= '0' && c <= '9');
+}
+
+constexpr bool isOperator(char c) {
+    return (c == '+' || c == '-' || c == '/' || c == '*');
+}
+
+// Same power of ten as std::pow(10, n) for the exponents a float can hold
+constexpr double pow10(int n) {
+    double result = 1.0;
+    for (int i = 0; i < n; i++) {
+        result *= 10.0;
+    }
+    return result;
+}
+
+// Mirrors LinkedCalc::validateExpression over a character array
+constexpr bool validate(const char* expr, std::size_t length) {
+    if (length == 0) {
+        return false;                                                                   // Empty expression is invalid
+    }
+
+    bool foundDigit = false;
+    bool foundDecimal = false;
+    for (std::size_t i = 0; i < length; i++) {
+        if (isOperator(expr[i])) {
+            if (!foundDigit) {
+                return false;                                                           // Operator without a preceding number
+            }
+            foundDigit = false;
+            foundDecimal = false;
+        } else if (isDigit(expr[i])) {
+            foundDigit = true;
+        } else if (expr[i] == '.') {
+            if (foundDecimal) {
+                return false;                                                           // Two decimal points in one number
+            }
+            foundDecimal = true;
+        } else {
+            return false;                                                               // Invalid character
+        }
+    }
+    return foundDigit;                                                                  // Must end with a number
+}
+
+// Mirrors LinkedCalc::evaluateExpression step for step so both paths round identically
+constexpr float evaluate(const char* expr, std::size_t length) {
+    float totalResult = 0.0f;
+    float currentNumber = 0.0f;
+    char lastOperation = '+';
+    bool foundDecimal = false;
+    int decimalCount = 0;
+
+    std::size_t i = 0;
+    while (i < length) {
+        char c = expr[i];
+        if (isDigit(c)) {
+            if (foundDecimal) {
+                decimalCount++;
+                currentNumber += (c - '0') / pow10(decimalCount);
+            } else {
+                currentNumber = currentNumber * 10 + (c - '0');
+            }
+        } else if (c == '.') {
+            foundDecimal = true;
+        } else if (c == '*' || c == '/') {
+            char operation = c;
+            i++;                                                                        // Move to the operand
+            float nextNumber = 0.0f;
+            foundDecimal = false;
+            decimalCount = 0;
+
+            while (i < length && (isDigit(expr[i]) || expr[i] == '.')) {
+                if (isDigit(expr[i])) {
+                    if (foundDecimal) {
+                        decimalCount++;
+                        nextNumber += (expr[i] - '0') / pow10(decimalCount);
+                    } else {
+                        nextNumber = nextNumber * 10 + (expr[i] - '0');
+                    }
+                } else {
+                    foundDecimal = true;
+                }
+                i++;
+            }
+
+            if (operation == '*') {
+                currentNumber *= nextNumber;
+            } else {
+                if (nextNumber == 0) {
+                    throw std::runtime_error("Division by zero.");                      // Not a constant expression: compile error
+                }
+                currentNumber /= nextNumber;
+            }
+            continue;
+        } else {
+            if (lastOperation == '+') {
+                totalResult += currentNumber;
+            } else if (lastOperation == '-') {
+                totalResult -= currentNumber;
+            }
+            lastOperation = c;
+            currentNumber = 0.0f;
+            foundDecimal = false;
+            decimalCount = 0;
+        }
+        i++;
+    }
+
+    if (lastOperation == '+') {
+        totalResult += currentNumber;
+    } else if (lastOperation == '-') {
+        totalResult -= currentNumber;
+    }
+    return totalResult;
+}
+
+} // namespace static_calc
+
+// Callable for one fixed formula; evaluation is folded into a constant at compile time
+template <FixedExpression Expr>
+class StaticCalc {
+    static_assert(static_calc::validate(Expr.data, Expr.size()), "StaticCalc: invalid expression");
+
+public:
+    static constexpr float value = static_calc::evaluate(Expr.data, Expr.size());
+
+    constexpr float operator()() const { return value; }
+};
+
+#endif // LINKED_CALC_STATIC_HPP
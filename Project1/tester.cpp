@@ -1,6 +1,11 @@
 #include <iostream>
 #include <cassert>
 #include "linked_calc.cpp" // Include the implementation file
+#include "linked_calc_static.hpp"
+#include "linked_calc_simd.hpp"
+#include <random>
+#include <string>
+#include <vector>
 using namespace std;
 void runEvaluateExpressionTests() {
     // Test 1: Simple addition
@@ -103,6 +108,141 @@ void runEvaluateExpressionTests() {
     calc10.insert('*');
     assert(!calc10.validateExpression());
     cout<<"Test 10 passed"<<endl;
+
+    // Test 11: Compile-time evaluation matches the runtime result
+    LinkedCalc<char> calc11;
+    const char expr11[] = "1.25+6/4*3-0.5";
+    for (const char* c = expr11; *c != '\0'; c++) {
+        calc11.insert(*c);
+    }
+    assert(calc11.validateExpression());
+    static_assert(StaticCalc<"1.25+6/4*3-0.5">::value == 5.25f, "static evaluation");
+    assert(StaticCalc<"1.25+6/4*3-0.5">{}() == calc11.evaluateExpression());
+    cout<<"Test 11 passed"<<endl;
+
+    // Test 12: Compile-time validation uses the same grammar
+    static_assert(static_calc::validate("3.5*2", 5), "valid expression");
+    static_assert(!static_calc::validate("3+*2", 4), "consecutive operators");
+    static_assert(!static_calc::validate("3..2", 4), "consecutive decimals");
+    static_assert(!static_calc::validate("3+5*", 4), "trailing operator");
+    cout<<"Test 12 passed"<<endl;
+
+    // Test 13: Block tokenizer accepts exactly what validateExpression accepts, on every instruction set
+    vector<simd_calc::Isa> isas = {simd_calc::Isa::Scalar};
+#if defined(__x86_64__) || defined(__i386__)
+    isas.push_back(simd_calc::Isa::Sse2);
+    if (__builtin_cpu_supports("avx2")) {
+        isas.push_back(simd_calc::Isa::Avx2);
+    }
+#endif
+    vector<string> cases13 = {"3.5*2", "3+*2", "3..2", "3+5*", "5.", ".5", ".", "+1", "1 + 2", "12a",
+                              string(63, '7') + "+1", string(64, '7') + "+1", string(63, '1') + "++1",
+                              string(62, '2') + ".4+" + string(70, '3') + ".1", string(62, '2') + ".4" + string(70, '3') + ".1",
+                              string(200, '9') + "*", string(130, '8') + "/" + string(130, '4') + "-.5"};
+    mt19937 random13(13);
+    const char alphabet13[] = "0123456789+-*/.";
+    for (int i = 0; i < 2000; i++) {
+        string expr(random13() % 150 + 1, '0');
+        for (char& c : expr) {
+            c = random13() % 3 ? alphabet13[random13() % 10] : alphabet13[random13() % 15];
+        }
+        cases13.push_back(expr);
+    }
+    vector<uint32_t> operators13;
+    for (const string& expr : cases13) {
+        LinkedCalc<char> calc13;
+        for (char c : expr) {
+            calc13.insert(c);
+        }
+        bool expected = calc13.validateExpression();
+        assert(static_calc::validate(expr.data(), expr.size()) == expected);
+        for (simd_calc::Isa isa : isas) {
+            assert(simd_calc::tokenize(expr.data(), expr.size(), operators13, isa) == expected);
+        }
+    }
+    cout<<"Test 13 passed"<<endl;
+
+    // Test 14: Evaluating from the operator offsets gives the same float as evaluateExpression
+    mt19937 random14(14);
+    for (int i = 0; i < 500; i++) {
+        string expr;
+        int terms = random14() % 12 + 1;
+        for (int t = 0; t < terms; t++) {
+            if (t > 0) {
+                expr += "+-*/"[random14() % 4];
+            }
+            expr += to_string(random14() % 1000 + 1);
+            if (random14() % 2) {
+                expr += "." + to_string(random14() % 100);
+            }
+        }
+        LinkedCalc<char> calc14;
+        for (char c : expr) {
+            calc14.insert(c);
+        }
+        vector<uint32_t> operators14;
+        assert(simd_calc::tokenize(expr.data(), expr.size(), operators14));
+        assert(simd_calc::evaluate(expr.data(), expr.size(), operators14) == calc14.evaluateExpression());
+    }
+    vector<uint32_t> operators14;
+    assert(simd_calc::tokenize("8/0.0", 5, operators14));
+    try {
+        simd_calc::evaluate("8/0.0", 5, operators14);
+        assert(false);
+    } catch (const runtime_error&) {
+    }
+    cout<<"Test 14 passed"<<endl;
+
+    // Test 15: Exact mode keeps every digit
+    auto exact = [](const string& expr, size_t divisionDigits = 32) {
+        LinkedCalc<char> calc;
+        for (char c : expr) {
+            calc.insert(c);
+        }
+        return calc.evaluateExact(divisionDigits).toString();
+    };
+    assert(exact("123456789012345678901234567890*987654321098765432109876543210")
+           == "121932631137021795226185032733622923332237463801111263526900");
+    assert(exact("0.1+0.2") == "0.3");
+    assert(exact("10/4") == "2.5");
+    assert(exact("5-7.25") == "-2.25");
+    assert(exact("1/3") == "0." + string(32, '3'));
+    assert(exact("2/3", 5) == "0.66666");
+    assert(exact("99999999999999999999.5*0.02-1.25/3", 40) == "1999999999999999999.5733333333333333333333333333333333333334");
+    assert(exact("1.25+6/4*3-0.5") == "5.25");
+    try {
+        exact("8/0.0");
+        assert(false);
+    } catch (const runtime_error&) {
+    }
+    cout<<"Test 15 passed"<<endl;
+
+    // Test 16: Karatsuba agrees with schoolbook multiplication, and division undoes both
+    mt19937 random16(16);
+    auto randomInteger = [&random16](size_t limbs) {
+        vector<big_calc::Limb> value(limbs);
+        for (big_calc::Limb& limb : value) {
+            limb = random16() % big_calc::BASE;
+        }
+        value.back() = value.back() % (big_calc::BASE - 1) + 1;
+        return big_calc::BigInteger::fromLimbs(value);
+    };
+    for (size_t limbs : {1, 7, 40, 41, 97, 300, 1000}) {
+        big_calc::BigInteger a = randomInteger(limbs);
+        big_calc::BigInteger b = randomInteger(limbs / 3 + 1);
+        big_calc::BigInteger c = randomInteger(limbs);
+        big_calc::BigInteger schoolbook = big_calc::BigInteger::multiply(a, c, SIZE_MAX);
+        assert(big_calc::BigInteger::compareMagnitude(big_calc::BigInteger::multiply(a, c, 2), schoolbook) == 0);
+        assert(big_calc::BigInteger::compareMagnitude(a * c, schoolbook) == 0);
+        assert(big_calc::BigInteger::compareMagnitude(big_calc::BigInteger::multiply(a, b, 2),
+                                                      big_calc::BigInteger::multiply(a, b, SIZE_MAX)) == 0);
+        big_calc::BigInteger remainder = randomInteger(limbs / 3 + 1);
+        if (big_calc::BigInteger::compareMagnitude(remainder, b) >= 0) {
+            remainder = big_calc::BigInteger();
+        }
+        assert(big_calc::BigInteger::divide(a * b + remainder, b).toString() == a.toString());
+    }
+    cout<<"Test 16 passed"<<endl;
 }
 
 int main() {
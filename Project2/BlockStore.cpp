@@ -0,0 +1,41 @@
+// BlockStore.cpp
+#include "BlockStore.hpp"
+#include <stdexcept>
+
+BlockStore::BlockStore(size_t blocksPerSlab)
+    : blocksPerSlab(blocksPerSlab), nextUnused(0), inUse(0) {}
+
+BlockStore::~BlockStore() {
+    for (auto slab : slabs) {
+        delete[] slab;
+    }
+}
+
+// Hands out a recycled block if there is one, otherwise the next block of the newest slab
+uint32_t BlockStore::allocate() {
+    uint32_t block;
+    if (!freeBlocks.empty()) {
+        block = freeBlocks.back();
+        freeBlocks.pop_back();
+    } else {
+        if (nextUnused == slabs.size() * blocksPerSlab) {
+            if (nextUnused + blocksPerSlab > NO_BLOCK) {
+                throw std::runtime_error("Block store is full");
+            }
+            slabs.push_back(new char[blocksPerSlab * BLOCK_SIZE]);                                 // One allocation per slab
+        }
+        block = static_cast<uint32_t>(nextUnused++);
+    }
+    inUse++;
+    return block;
+}
+
+void BlockStore::release(uint32_t block) {
+    freeBlocks.push_back(block);
+    inUse--;
+}
+
+const char* BlockStore::zeroBlock() {
+    static const char zeros[BLOCK_SIZE] = {};
+    return zeros;
+}
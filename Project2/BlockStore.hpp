@@ -0,0 +1,53 @@
+// BlockStore.hpp
+#ifndef BLOCKSTORE_HPP
+#define BLOCKSTORE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Pool of fixed-size blocks holding file contents. Blocks are carved out of large slabs
+// and recycled through a free list, so file I/O does not hit the allocator per block.
+// Blocks are named by 32-bit ids; NO_BLOCK marks a hole in a sparse file.
+class BlockStore {
+private:
+    std::vector<char*> slabs;
+    std::vector<uint32_t> freeBlocks;
+    size_t blocksPerSlab;
+    size_t nextUnused;                                  // Blocks below this id have been handed out at least once
+    size_t inUse;
+
+public:
+    static constexpr size_t BLOCK_SIZE = 4096;
+    static constexpr uint32_t NO_BLOCK = UINT32_MAX;
+
+    explicit BlockStore(size_t blocksPerSlab = 256);
+    ~BlockStore();
+
+    BlockStore(const BlockStore&) = delete;
+    BlockStore& operator=(const BlockStore&) = delete;
+
+    uint32_t allocate();                                // Contents are unspecified
+    void release(uint32_t block);
+
+    char* data(uint32_t block) {
+        return slabs[block / blocksPerSlab] + (block % blocksPerSlab) * BLOCK_SIZE;
+    }
+
+    size_t blocksInUse() const { return inUse; }
+    size_t bytesReserved() const { return slabs.size() * blocksPerSlab * BLOCK_SIZE; }
+
+    static const char* zeroBlock();                     // BLOCK_SIZE zero bytes, used to read holes
+};
+
+// Contents of one file: a block map where entry i covers bytes [i * BLOCK_SIZE, (i + 1) * BLOCK_SIZE).
+// Missing or NO_BLOCK entries are holes that read as zeros. Bytes of an allocated block past
+// size are always zero, so growing the file never exposes stale data.
+struct FileContents {
+    uint64_t size;
+    std::vector<uint32_t> blocks;
+
+    FileContents() : size(0) {}
+};
+
+#endif // BLOCKSTORE_HPP
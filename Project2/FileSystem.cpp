@@ -8,138 +8,3028 @@ Description: This C++ program implements an in-memory file system using a tree s
 #include "FileSystem.hpp"
 #include <stdexcept>
 #include <sstream>
+#include <functional>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <thread>
+#include <cstdlib>
+#include <new>
+#include <fstream>
+#include <numeric>
+#include <bit>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-FileSystemNode::FileSystemNode(std::string name, bool isDir) 
-    : name(name), isDirectory(isDir), parent(nullptr) {}
+ChildIndex::ChildIndex(size_t expected) : occupied(0), live(0) {
+    size_t capacity = 16;
+    while (capacity < expected * 4) {                                                               // Start at most a quarter full
+        capacity *= 2;
+    }
+    table.assign(capacity, Entry{NodePool::NO_NODE, 0});
+}
+
+// Interned names are equal only if they share an address, so the address is the hash
+size_t ChildIndex::hashOf(std::string_view name, bool isDir) {
+    uint64_t h = reinterpret_cast<uintptr_t>(name.data()) * 0x9E3779B97F4A7C15ULL;
+    return static_cast<size_t>(h ^ (h >> 32)) * 2 + (isDir ? 1 : 0);                               // Files and directories may share a name
+}
+
+// Returns the slot holding the entry for (name, isDir), or the empty slot ending its probe sequence
+size_t ChildIndex::probe(const NodePool& pool, std::string_view name, bool isDir) const {
+    size_t hash = hashOf(name, isDir);
+    size_t mask = table.size() - 1;
+    size_t i = hash & mask;
+    while (table[i].node != NodePool::NO_NODE) {
+        if (table[i].node != TOMBSTONE && table[i].hash == uint32_t(hash)) {
+            const FileSystemNode* entry = pool.at(table[i].node);
+            if (entry->isDirectory == isDir && entry->name.data() == name.data()) {
+                break;
+            }
+        }
+        i = (i + 1) & mask;                                                                         // Linear probing
+    }
+    return i;
+}
+
+void ChildIndex::rehash(size_t capacity) {
+    std::vector<Entry> old(capacity, Entry{NodePool::NO_NODE, 0});
+    old.swap(table);
+    occupied = 0;
+    size_t mask = table.size() - 1;
+    for (const Entry& entry : old) {
+        if (entry.node != NodePool::NO_NODE && entry.node != TOMBSTONE) {                           // Stored hashes, no node loads
+            size_t i = entry.hash & mask;
+            while (table[i].node != NodePool::NO_NODE) {
+                i = (i + 1) & mask;
+            }
+            table[i] = entry;
+            occupied++;
+        }
+    }
+}
+
+uint32_t ChildIndex::find(const NodePool& pool, std::string_view name, bool isDir) const {
+    return table[probe(pool, name, isDir)].node;
+}
+
+// Adds a node whose (name, type) is not in the index yet
+void ChildIndex::insert(const NodePool& pool, uint32_t node) {
+    if ((occupied + 1) * 2 > table.size()) {                                                        // Keep the load, tombstones included, under 1/2
+        size_t capacity = 16;
+        while (capacity < (live + 1) * 4) {
+            capacity *= 2;
+        }
+        rehash(capacity);
+    }
+    const FileSystemNode* entry = pool.at(node);
+    size_t hash = hashOf(entry->name, entry->isDirectory);
+    size_t mask = table.size() - 1;
+    size_t i = hash & mask;
+    while (table[i].node != NodePool::NO_NODE && table[i].node != TOMBSTONE) {
+        i = (i + 1) & mask;
+    }
+    if (table[i].node == NodePool::NO_NODE) {
+        occupied++;                                                                                 // Reused tombstones are already counted
+    }
+    table[i] = Entry{node, uint32_t(hash)};
+    live++;
+}
+
+void ChildIndex::erase(const NodePool& pool, uint32_t node) {
+    const FileSystemNode* entry = pool.at(node);
+    size_t i = probe(pool, entry->name, entry->isDirectory);
+    if (table[i].node == node) {
+        table[i].node = TOMBSTONE;
+        live--;
+    }
+}
+
+// Rehashes once so that this many live entries fit under the load limit of insert
+void ChildIndex::reserve(size_t entries) {
+    if (entries * 2 > table.size()) {
+        size_t capacity = 16;
+        while (capacity < entries * 4) {
+            capacity *= 2;
+        }
+        rehash(capacity);
+    }
+}
+
+// Appends, moving to the heap when the inline slots are full and doubling from there
+void ChildList::push_back(uint32_t node) {
+    if (count == capacity) {
+        reserve(size_t(capacity) * 2);
+    }
+    data()[count++] = node;
+}
+
+// Moves to a heap array of at least size entries
+void ChildList::reserve(size_t size) {
+    if (size <= capacity) {
+        return;
+    }
+    uint32_t* grown = new uint32_t[size];
+    std::memcpy(grown, data(), count * sizeof(uint32_t));
+    if (capacity > 2) {
+        delete[] heap;
+    }
+    heap = grown;
+    capacity = static_cast<uint32_t>(size);
+}
+
+FileSystemNode::FileSystemNode(std::string_view name, bool isDir, uint32_t self)
+    : name(name), id(0), index(nullptr), parent(NodePool::NO_NODE), self(self), slot(0), childCount(0), files(0), directories(0), bytes(0), isDirectory(isDir) {}
 
+// Children are freed by FileSystem::destroySubtree, not recursively from here
 FileSystemNode::~FileSystemNode() {
-    for (auto child : children) {
-        delete child;
+    if (isDirectory) {
+        delete index;
+    } else {
+        delete contents;                                                                            // Blocks go back to the store in FileSystem::rm
+    }
+}
+
+// Finds a child by interned name and type
+FileSystemNode* FileSystemNode::findChild(const NodePool& pool, std::string_view name, bool isDir) const {
+    if (index != nullptr) {
+        uint32_t found = index->find(pool, name, isDir);
+        return found != NodePool::NO_NODE ? pool.at(found) : nullptr;
+    }
+    for (auto child : children) {                                                                   // Small directories are scanned
+        if (child != NodePool::NO_NODE) {
+            FileSystemNode* node = pool.at(child);
+            if (node->isDirectory == isDir && node->name.data() == name.data()) {
+                return node;
+            }
+        }
+    }
+    return nullptr;
+}
+
+// Appends a child in insertion order and indexes it once the directory is large
+void FileSystemNode::addChild(const NodePool& pool, FileSystemNode* child) {
+    child->parent = self;
+    child->slot = static_cast<uint32_t>(children.size());
+    children.push_back(child->self);
+    childCount++;
+    if (index != nullptr) {
+        index->insert(pool, child->self);
+    } else if (childCount > INDEX_THRESHOLD) {
+        index = new ChildIndex(childCount);
+        for (auto existing : children) {
+            if (existing != NodePool::NO_NODE) {
+                index->insert(pool, existing);
+            }
+        }
+    }
+}
+
+// Grows the children list and index once for extra children about to be added
+void FileSystemNode::reserveChildren(const NodePool& pool, size_t extra) {
+    children.reserve(children.size() + extra);
+    if (index == nullptr && childCount + extra > INDEX_THRESHOLD) {
+        index = new ChildIndex(childCount + extra);
+        for (auto existing : children) {
+            if (existing != NodePool::NO_NODE) {
+                index->insert(pool, existing);
+            }
+        }
+    } else if (index != nullptr) {
+        index->reserve(childCount + extra);
+    }
+}
+
+// Unlinks a child in O(1): its slot becomes a hole that is compacted away later
+bool FileSystemNode::removeChild(const NodePool& pool, FileSystemNode* child) {
+    children[child->slot] = NodePool::NO_NODE;
+    childCount--;
+    if (index != nullptr) {
+        index->erase(pool, child->self);
+    }
+    child->parent = NodePool::NO_NODE;
+
+    while (!children.empty() && children.back() == NodePool::NO_NODE) {                             // Trailing holes cost nothing to drop
+        children.pop_back();
+    }
+    if (children.size() - childCount > childCount) {                                                // Mostly holes: compact, amortised O(1)
+        compact(pool);
+        return true;
+    }
+    return false;
+}
+
+// Closes the holes left by removeChild while keeping insertion order
+void FileSystemNode::compact(const NodePool& pool) {
+    size_t next = 0;
+    for (size_t i = 0; i < children.size(); i++) {
+        uint32_t child = children[i];
+        if (child != NodePool::NO_NODE) {
+            pool.at(child)->slot = static_cast<uint32_t>(next);
+            children[next++] = child;
+        }
+    }
+    children.shrink(next);
+    if (index != nullptr && childCount < INDEX_THRESHOLD / 2) {                                     // Shrunk well below the threshold
+        delete index;
+        index = nullptr;
+    }
+}
+
+NodePool::NodePool() : nextUnused(1), inUse(0) {
+    slabs = static_cast<FileSystemNode**>(std::calloc(MAX_SLABS, sizeof(FileSystemNode*)));         // Untouched pages cost no memory
+    if (slabs == nullptr) {
+        throw std::bad_alloc();
+    }
+}
+
+// Nodes still alive are not destroyed here, FileSystem frees its tree first
+NodePool::~NodePool() {
+    for (size_t i = 0; i < MAX_SLABS && slabs[i] != nullptr; i++) {
+        ::operator delete(slabs[i]);
+    }
+    std::free(slabs);
+}
+
+// Constructs a node in a recycled slot if there is one, otherwise in the next slot of the newest slab
+uint32_t NodePool::create(std::string_view name, bool isDir) {
+    uint32_t node;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!freeNodes.empty()) {
+            node = freeNodes.back();
+            freeNodes.pop_back();
+        } else {
+            if (nextUnused == UINT32_MAX) {
+                throw std::runtime_error("Node pool is full");
+            }
+            node = nextUnused++;
+            if (slabs[node >> SLAB_BITS] == nullptr) {
+                slabs[node >> SLAB_BITS] = static_cast<FileSystemNode*>(::operator new(SLAB_NODES * sizeof(FileSystemNode)));
+            }
+        }
+        inUse++;
+    }
+    new (at(node)) FileSystemNode(name, isDir, node);
+    return node;
+}
+
+void NodePool::destroy(uint32_t node) {
+    at(node)->~FileSystemNode();
+    std::lock_guard<std::mutex> guard(lock);
+    freeNodes.push_back(node);
+    inUse--;
+}
+
+size_t NodePool::nodesInUse() {
+    std::lock_guard<std::mutex> guard(lock);
+    return inUse;
+}
+
+size_t NodePool::bytesReserved() {
+    std::lock_guard<std::mutex> guard(lock);
+    return ((nextUnused + SLAB_NODES - 1) / SLAB_NODES) * SLAB_NODES * sizeof(FileSystemNode);
+}
+
+size_t DentryCache::KeyHash::operator()(const Key& key) const {
+    uint64_t h = (reinterpret_cast<uintptr_t>(key.name) ^ (key.parentId << 1) ^ (key.isDirectory ? 1 : 0)) * 0x9E3779B97F4A7C15ULL;
+    return static_cast<size_t>(h ^ (h >> 29));
+}
+
+DentryCache::DentryCache(size_t capacity)
+    : shards(new Shard[SHARDS]), capacity(capacity / SHARDS + 1), hits(0), misses(0) {
+    for (size_t i = 0; i < SHARDS; i++) {
+        shards[i].slots.reserve(this->capacity);
+    }
+}
+
+FileSystemNode* DentryCache::lookup(const FileSystemNode* parent, std::string_view name, bool isDir) {
+    Key key = {parent->id, name.data(), isDir};
+    Shard& shard = shardFor(key);
+    std::lock_guard<std::mutex> guard(shard.lock);
+    auto it = shard.slots.find(key);
+    if (it == shard.slots.end()) {
+        misses++;
+        return nullptr;
+    }
+    hits++;
+    Entry& entry = shard.entries[it->second];
+    entry.referenced = true;                                                                        // Second chance for the CLOCK hand
+    return entry.node;
+}
+
+void DentryCache::insert(const FileSystemNode* parent, FileSystemNode* child) {
+    Key key = {parent->id, child->name.data(), child->isDirectory};
+    Shard& shard = shardFor(key);
+    std::lock_guard<std::mutex> guard(shard.lock);
+    if (shard.slots.count(key) != 0) {
+        return;
+    }
+
+    size_t slot;
+    if (!shard.freeSlots.empty()) {                                                                 // Reuse a slot freed by erase
+        slot = shard.freeSlots.back();
+        shard.freeSlots.pop_back();
+    } else if (shard.entries.size() < capacity) {
+        slot = shard.entries.size();
+        shard.entries.push_back(Entry());
+    } else {
+        while (shard.entries[shard.hand].referenced) {                                              // CLOCK: clear bits until an unreferenced entry
+            shard.entries[shard.hand].referenced = false;
+            shard.hand = (shard.hand + 1) % shard.entries.size();
+        }
+        slot = shard.hand;
+        shard.slots.erase(shard.entries[slot].key);
+        shard.hand = (shard.hand + 1) % shard.entries.size();
+    }
+
+    shard.entries[slot].key = key;
+    shard.entries[slot].node = child;
+    shard.entries[slot].referenced = false;
+    shard.slots[key] = slot;
+}
+
+void DentryCache::erase(const FileSystemNode* parent, const FileSystemNode* child) {
+    Key key = {parent->id, child->name.data(), child->isDirectory};
+    Shard& shard = shardFor(key);
+    std::lock_guard<std::mutex> guard(shard.lock);
+    auto it = shard.slots.find(key);
+    if (it == shard.slots.end()) {
+        return;
+    }
+    Entry& entry = shard.entries[it->second];
+    entry.node = nullptr;
+    entry.referenced = false;
+    shard.freeSlots.push_back(it->second);
+    shard.slots.erase(it);
+}
+
+// Splits a path into its components; empty components ("a//b", trailing "/") are skipped
+static std::vector<std::string> splitPath(const std::string& path) {
+    std::vector<std::string> parts;
+    size_t start = 0;
+    while (start <= path.size()) {
+        size_t end = path.find('/', start);
+        if (end == std::string::npos) {
+            end = path.size();
+        }
+        if (end > start) {
+            parts.push_back(path.substr(start, end - start));
+        }
+        start = end + 1;
+    }
+    return parts;
+}
+
+static bool isDotEntry(const std::string& name) {
+    return name == "." || name == "..";
+}
+
+static void lockNode(FileSystemNode* node, bool exclusive) {
+    if (exclusive) {
+        node->lock.lock();
+    } else {
+        node->lock.lockShared();
     }
 }
 
-FileSystem::FileSystem() {
-    root = new FileSystemNode("/", true);                                                           // Create root directory
-    currentDirectory = root;                                                                        // Set current directory to root
+static void unlockNode(FileSystemNode* node, bool exclusive) {
+    if (exclusive) {
+        node->lock.unlock();
+    } else {
+        node->lock.unlockShared();
+    }
+}
+
+// Owns the lock on a node returned locked by FileSystem::walk/resolve and releases it on scope exit
+class NodeLock {
+private:
+    FileSystemNode* node;
+    bool exclusive;
+
+public:
+    NodeLock(FileSystemNode* node, bool exclusive) : node(node), exclusive(exclusive) {}
+    ~NodeLock() {
+        if (node != nullptr) {
+            unlockNode(node, exclusive);
+        }
+    }
+
+    NodeLock(const NodeLock&) = delete;
+    NodeLock& operator=(const NodeLock&) = delete;
+};
+
+// Marks a session as inside an operation, so nodes it may be looking at are not freed under it.
+// The epoch is read again after it is published: a retire that moved it on in between may
+// have missed the publication, so the operation takes the newer epoch and counts as starting
+// after that retire's unlink.
+class OperationGuard {
+private:
+    std::atomic<uint64_t>& activeEpoch;
+
+public:
+    OperationGuard(std::atomic<uint64_t>& activeEpoch, const std::atomic<uint64_t>& reclaimEpoch)
+        : activeEpoch(activeEpoch) {
+        uint64_t epoch = reclaimEpoch.load();
+        activeEpoch.store(epoch);
+        for (uint64_t current; (current = reclaimEpoch.load()) != epoch; epoch = current) {
+            activeEpoch.store(current);
+        }
+    }
+    ~OperationGuard() {
+        activeEpoch.store(0);
+    }
+};
+
+FileSystem::FileSystem()
+    : nextNodeId(1), dentries(DENTRY_CACHE_SIZE), snapshotEpoch(0), lastSnapshotEpoch(0), reclaimEpoch(1), detachCount(0),
+      journal(-1), stopReclaimer(false), pendingSubtrees(0), pendingNodes(0), reclaimedSubtrees(0), reclaimedNodes(0) {
+    root = nodes.at(nodes.create(names.intern("/"), true));                                         // Create root directory
+    root->id = nextNodeId++;
+    nameIndex.insert(root);
+    primary = new FileSystemSession(*this);                                                         // Starts in the root directory
 }
 
 FileSystem::~FileSystem() {
-    delete root;
+    if (journal >= 0) {
+        ::close(journal);
+    }
+    delete primary;
+    {
+        std::lock_guard<std::mutex> guard(reclaimLock);
+        stopReclaimer = true;
+    }
+    reclaimReady.notify_one();
+    if (reclaimer.joinable()) {
+        reclaimer.join();                                                                           // Finishes the queue first
+    }
+    destroySubtree(root);
 }
 
-// Creates a new directory in the current directory
-void FileSystem::mkdir(const std::string& name) {
-    for (auto child : currentDirectory->children) {                                                 // Check if directory already exists
-        if (child->name == name && child->isDirectory) {
-            throw std::runtime_error("File already exists");
+FileSystemSession::FileSystemSession(FileSystem& fs) : fs(fs), cwd(fs.root), activeEpoch(0), cwdPath("/") {
+    fs.registerSession(this);
+}
+
+FileSystemSession::~FileSystemSession() {
+    fs.unregisterSession(this);
+}
+
+void FileSystem::registerSession(FileSystemSession* session) {
+    std::lock_guard<std::mutex> guard(sessionsLock);
+    sessions.push_back(session);
+}
+
+void FileSystem::unregisterSession(FileSystemSession* session) {
+    std::lock_guard<std::mutex> guard(sessionsLock);
+    sessions.erase(std::find(sessions.begin(), sessions.end(), session));
+}
+
+// Frees subtrees that rm or a batch has already unlinked. Lone nodes that no running operation
+// can be looking at are freed at once; anything else goes to the reclaimer thread.
+void FileSystem::retire(FileSystemSession& session, std::span<FileSystemNode* const> subtrees) {
+    if (subtrees.empty()) {
+        return;
+    }
+    session.activeEpoch.store(0);                                                                   // Our own operation holds nothing else
+    std::vector<FileSystemNode*> leaves;
+    std::vector<FileSystemNode*> queued;
+    for (auto subtree : subtrees) {
+        (subtree->childCount == 0 ? leaves : queued).push_back(subtree);
+    }
+    // Counted before the epoch moves, so lookups in the name index that start after it check
+    // whether what they find below these subtrees is still attached; a leaf is caught by its
+    // missing parent instead
+    pendingSubtrees += queued.size();
+    uint64_t epoch = ++reclaimEpoch;
+    if (operationsBefore(epoch)) {
+        pendingSubtrees += leaves.size();
+        queued.insert(queued.end(), leaves.begin(), leaves.end());
+        leaves.clear();
+    }
+    if (!leaves.empty()) {
+        pendingNodes += leaves.size();
+        unindexNodes(leaves);
+        releaseNodes(leaves);
+        reclaimedSubtrees += leaves.size();
+    }
+    if (queued.empty()) {
+        return;
+    }
+    std::lock_guard<std::mutex> guard(reclaimLock);
+    for (auto subtree : queued) {
+        reclaimQueue.push_back(PendingSubtree{subtree, epoch});
+    }
+    if (!reclaimer.joinable()) {
+        reclaimer = std::thread(&FileSystem::reclaimLoop, this);
+    }
+    reclaimReady.notify_one();
+}
+
+// Body of the reclaimer thread: frees queued subtrees in order until asked to stop with
+// nothing left to do
+void FileSystem::reclaimLoop() {
+    std::unique_lock<std::mutex> guard(reclaimLock);
+    for (;;) {
+        reclaimReady.wait(guard, [this] { return stopReclaimer || !reclaimQueue.empty(); });
+        if (reclaimQueue.empty()) {
+            return;
+        }
+        PendingSubtree pending = reclaimQueue.front();
+        reclaimQueue.pop_front();
+        guard.unlock();
+        while (operationsBefore(pending.epoch)) {                                                   // They may still be walking inside it
+            std::this_thread::yield();
         }
+        reclaimSubtree(pending.node);
+        guard.lock();
+        pendingSubtrees--;
+        reclaimedSubtrees++;
+        reclaimDone.notify_all();
     }
-    FileSystemNode* newDir = new FileSystemNode(name, true);                                        // Create new directory node
-    newDir->parent = currentDirectory;                                                              // Set current directory as parent
-    currentDirectory->children.push_back(newDir);                                                   // Add new directory to children
 }
 
-// Creates a new file in the current directory
-void FileSystem::touch(const std::string& name) {
-    for (auto child : currentDirectory->children) {                                                 // Check if file already exists
-        if (child->name == name && !child->isDirectory) {
-            throw std::runtime_error("File already exists");
+// Whether some session is inside an operation that began before epoch
+bool FileSystem::operationsBefore(uint64_t epoch) {
+    std::lock_guard<std::mutex> guard(sessionsLock);
+    for (auto other : sessions) {
+        uint64_t active = other->activeEpoch.load();
+        if (active != 0 && active < epoch) {
+            return true;
         }
     }
-    FileSystemNode* newFile = new FileSystemNode(name, false);                                      // Create new file node
-    newFile->parent = currentDirectory;                                                             // Set current directory as parent
-    currentDirectory->children.push_back(newFile);                                                  // Add new file to children
+    return false;
 }
 
-// Lists the contents of the current directory
-std::string FileSystem::ls() {
-    std::stringstream ss;
-    for (auto child : currentDirectory->children) {
-        ss << child->name << (child->isDirectory ? "/" : "") << "\n";                               // Append directory/file names with formatting
-    }
-    return ss.str();
-}
-
-// Changes the current directory based on the path provided
-void FileSystem::cd(const std::string& path) {
-    if (path == "/") {                                                                              // Go to root
-        currentDirectory = root;
-    } else if (path == "..") {                                                                      // Go to parent directory
-        if (currentDirectory->parent != nullptr) {
-            currentDirectory = currentDirectory->parent;
-        }
-    } else {                                                                                        // Go to a specified child directory
-        bool found = false;
-        for (auto child : currentDirectory->children) {
-            if (child->name == path && child->isDirectory) {
-                currentDirectory = child;
-                found = true;
-                break;
+ReclaimStats FileSystem::reclaimStats() {
+    return ReclaimStats{pendingSubtrees, pendingNodes, reclaimedSubtrees, reclaimedNodes};
+}
+
+void FileSystem::waitForReclaim() {
+    std::unique_lock<std::mutex> guard(reclaimLock);
+    reclaimDone.wait(guard, [this] { return pendingSubtrees == 0; });
+}
+
+// Creates a node, gives it a fresh id and links it under dir, which the caller holds exclusively.
+// Bulk callers creating many nodes at once add them to the name index and to their
+// ancestors' usage themselves.
+FileSystemNode* FileSystem::createNode(FileSystemNode* dir, std::string_view name, bool isDir, bool bulk) {
+    FileSystemNode* node = nodes.at(nodes.create(name, isDir));
+    node->id = nextNodeId++;
+    {
+        std::unique_lock<std::mutex> shadowGuard(snapshotLock, std::defer_lock);
+        if (snapshotEpoch != 0) {
+            shadowGuard.lock();                                                                     // Slots and shadows change together
+            dropUnusedShadows();
+        }
+        dir->addChild(nodes, node);                                                                 // Add to children and set parent
+        if (snapshotEpoch != 0) {
+            shadowAdd(dir, node);
+        }
+    }
+    if (!bulk) {
+        {
+            std::shared_lock<std::shared_mutex> detach(detachLock);
+            addUsage(dir, isDir ? 0 : 1, isDir ? 1 : 0, 0);
+        }
+        std::unique_lock<std::shared_mutex> indexGuard(indexLock);
+        nameIndex.insert(node);
+    }
+    return node;
+}
+
+// Adds to the usage totals of node and every directory above it. The caller holds detachLock,
+// so the chain cannot be cut by rm halfway and rm sees each change either fully or not at all.
+void FileSystem::addUsage(FileSystemNode* node, int64_t files, int64_t directories, int64_t bytes) {
+    for (; node != nullptr; node = parentOf(node)) {
+        node->files.fetch_add(static_cast<uint32_t>(files), std::memory_order_relaxed);            // Wraps for removals
+        node->directories.fetch_add(static_cast<uint32_t>(directories), std::memory_order_relaxed);
+        node->bytes.fetch_add(static_cast<uint64_t>(bytes), std::memory_order_relaxed);
+    }
+}
+
+// Totals for node and everything below it, node included
+DiskUsage FileSystem::usageOf(const FileSystemNode* node) const {
+    if (!node->isDirectory) {
+        return DiskUsage{1, 0, node->bytes.load(std::memory_order_relaxed)};
+    }
+    return DiskUsage{node->files.load(std::memory_order_relaxed), node->directories.load(std::memory_order_relaxed) + 1,
+                     node->bytes.load(std::memory_order_relaxed)};
+}
+
+// Sets a file's size and passes the change up to every directory above it; the caller holds
+// the file's lock exclusively and must not hold blocksLock
+void FileSystem::resize(FileSystemNode* file, uint64_t size) {
+    std::shared_lock<std::shared_mutex> detach(detachLock);
+    addUsage(file, 0, 0, static_cast<int64_t>(size - file->contents->size));
+    file->contents->size = size;
+}
+
+// Looks up one child of dir through the dentry cache; the caller holds dir's lock.
+// name comes from NameTable::find, a name that was never interned matches nothing.
+FileSystemNode* FileSystem::lookup(FileSystemNode* dir, std::string_view name, bool isDir) {
+    if (name.data() == nullptr) {
+        return nullptr;
+    }
+    FileSystemNode* node = dentries.lookup(dir, name, isDir);
+    if (node == nullptr) {
+        node = dir->findChild(nodes, name, isDir);
+        if (node != nullptr) {
+            dentries.insert(dir, node);
+        }
+    }
+    return node;
+}
+
+// Looks up a child of either type, preferring the one created first
+FileSystemNode* FileSystem::lookupAny(FileSystemNode* dir, std::string_view name) {
+    FileSystemNode* file = lookup(dir, name, false);
+    FileSystemNode* subdir = lookup(dir, name, true);
+    if (file == nullptr || (subdir != nullptr && subdir->slot < file->slot)) {
+        return subdir;
+    }
+    return file;
+}
+
+// Absolute paths start at the root, everything else at the session's current directory
+FileSystemNode* FileSystem::startOf(FileSystemSession& session, const std::string& path) {
+    return (!path.empty() && path[0] == '/') ? root : session.cwd.load();
+}
+
+// Follows the first count components from dir as directories with lock coupling: the next
+// directory is locked before the current one is released. Missing directories are created
+// when createMissing is set. Returns the last directory locked (exclusively if requested),
+// or nullptr with nothing locked if a component does not exist.
+FileSystemNode* FileSystem::walk(FileSystemNode* dir, const std::vector<std::string>& parts, size_t count, bool createMissing, bool exclusive) {
+    std::vector<const std::string*> steps;                                                          // "." is a no-op, drop it up front
+    for (size_t i = 0; i < count; i++) {
+        if (parts[i] != ".") {
+            steps.push_back(&parts[i]);
+        }
+    }
+
+    bool held = steps.empty() ? exclusive : createMissing;                                          // Mode dir is locked in
+    lockNode(dir, held);
+    for (size_t i = 0; i < steps.size(); i++) {
+        bool nextMode = (i + 1 == steps.size()) ? exclusive : createMissing;                        // Written only if it may gain a child
+        if (*steps[i] == "..") {
+            FileSystemNode* parent = parentOf(dir);
+            if (parent == nullptr) {                                                                // ".." of the root is the root
+                parent = dir;
             }
+            unlockNode(dir, held);                                                                  // Never lock upwards while holding a child
+            lockNode(parent, nextMode);
+            dir = parent;
+            held = nextMode;
+            continue;
         }
-        if (!found) {
-            throw std::runtime_error("Directory not found");
+        FileSystemNode* next = lookup(dir, names.find(*steps[i]), true);
+        if (next == nullptr) {
+            if (!createMissing) {
+                unlockNode(dir, held);
+                return nullptr;
+            }
+            next = createNode(dir, names.intern(*steps[i]), true);
+        }
+        lockNode(next, nextMode);
+        unlockNode(dir, held);
+        dir = next;
+        held = nextMode;
+    }
+    return dir;
+}
+
+// Resolves a path to a file or directory and returns it share-locked, or nullptr if it does
+// not exist. A trailing "/" only matches directories.
+FileSystemNode* FileSystem::resolve(FileSystemSession& session, const std::string& path) {
+    std::vector<std::string> parts = splitPath(path);
+    FileSystemNode* start = startOf(session, path);
+    if (parts.empty() || isDotEntry(parts.back())) {
+        return walk(start, parts, parts.size(), false, false);
+    }
+    FileSystemNode* dir = walk(start, parts, parts.size() - 1, false, false);
+    if (dir == nullptr) {
+        return nullptr;
+    }
+    NodeLock dirLock(dir, false);
+    std::string_view name = names.find(parts.back());
+    FileSystemNode* node = (path[path.size() - 1] == '/') ? lookup(dir, name, true) : lookupAny(dir, name);
+    if (node != nullptr) {
+        node->lock.lockShared();                                                                    // Coupled: dir stays locked until now
+    }
+    return node;
+}
+
+// Resolves a path that must name an existing file and returns it locked
+FileSystemNode* FileSystem::resolveFile(FileSystemSession& session, const std::string& path, bool exclusive) {
+    std::vector<std::string> parts = splitPath(path);
+    if (parts.empty() || isDotEntry(parts.back()) || path[path.size() - 1] == '/') {
+        throw std::runtime_error("File not found");
+    }
+    FileSystemNode* dir = walk(startOf(session, path), parts, parts.size() - 1, false, false);
+    if (dir == nullptr) {
+        throw std::runtime_error("File not found");
+    }
+    NodeLock dirLock(dir, false);
+    FileSystemNode* file = lookup(dir, names.find(parts.back()), false);
+    if (file == nullptr) {
+        throw std::runtime_error("File not found");
+    }
+    lockNode(file, exclusive);
+    return file;
+}
+
+// True while the node is reachable from the root; the caller holds detachLock
+bool FileSystem::isAttached(FileSystemNode* node) {
+    while (node != root) {
+        node = parentOf(node);
+        if (node == nullptr) {
+            return false;                                                                           // Reached the top of a removed subtree
         }
     }
+    return true;
 }
 
-// Removes a file or directory in the current directory
-void FileSystem::rm(const std::string& name) {
-    for (auto it = currentDirectory->children.begin(); it != currentDirectory->children.end(); ++it) {
-        if ((*it)->name == name) {                                                                  // Find the file or directory by name
-            delete *it;                                                                             // Delete the node
-            currentDirectory->children.erase(it);                                                   // Remove from children vector
+// Full path of a node; directories end with "/". Empty if the node has been removed.
+// One pass up to the root sizes the path, a second fills it in from the end: O(depth).
+std::string FileSystem::pathOf(FileSystemNode* node) {
+    if (node == root) return "/";                                                                   // Root directory path
+
+    std::shared_lock<std::shared_mutex> guard(detachLock);                                          // Parent links are stable
+    size_t length = node->isDirectory ? 1 : 0;
+    FileSystemNode* current = node;
+    while (current != root) {                                                                       // Measure by traversing up to the root
+        if (current == nullptr) {
+            return "";
+        }
+        length += current->name.size() + 1;
+        current = parentOf(current);
+    }
+
+    std::string path(length, '/');
+    size_t end = node->isDirectory ? length - 1 : length;
+    for (current = node; current != root; current = parentOf(current)) {
+        end -= current->name.size();
+        std::memcpy(&path[end], current->name.data(), current->name.size());
+        end--;                                                                                      // Separator, already '/'
+    }
+    return path;
+}
+
+// Creates a new directory; with parents set, missing parents are created and an existing directory is not an error
+void FileSystem::mkdir(FileSystemSession& session, const std::string& path, bool parents) {
+    if (path.empty()) {
+        throw std::runtime_error("Invalid directory name");
+    }
+    OperationGuard operation(session.activeEpoch, reclaimEpoch);
+    std::shared_lock<std::shared_mutex> structure(structureLock);
+    std::vector<std::string> parts = splitPath(path);
+    if (parts.empty() || isDotEntry(parts.back())) {                                                // Names an existing directory
+        FileSystemNode* dir = walk(startOf(session, path), parts, parts.size(), parents, false);
+        if (dir == nullptr) {
+            throw std::runtime_error("Directory not found");
+        }
+        unlockNode(dir, false);
+        if (!parents) {
+            throw std::runtime_error("File already exists");
+        }
+        return;
+    }
+
+    FileSystemNode* dir = walk(startOf(session, path), parts, parts.size() - 1, parents, true);
+    if (dir == nullptr) {
+        throw std::runtime_error("Directory not found");
+    }
+    NodeLock dirLock(dir, true);
+    std::string_view name = names.intern(parts.back());
+    if (lookup(dir, name, true) != nullptr) {                                                       // Check if directory already exists
+        if (parents) {
             return;
         }
+        throw std::runtime_error("File already exists");
     }
-    throw std::runtime_error("File or directory not found");
+    createNode(dir, name, true);                                                                    // Create new directory node
 }
 
-// Prints the full path of the current directory
-std::string FileSystem::pwd() {
-    if (currentDirectory == root) return "/";                                                       // Root directory path
-    
-    std::string path;
-    FileSystemNode* node = currentDirectory;
-    while (node != root) {                                                                          // Build path by traversing up to the root
-        path = "/" + node->name + path;
-        node = node->parent;
+// Creates a new file; its parent directory must exist
+void FileSystem::touch(FileSystemSession& session, const std::string& path) {
+    std::vector<std::string> parts = splitPath(path);
+    if (parts.empty() || isDotEntry(parts.back()) || path[path.size() - 1] == '/') {
+        throw std::runtime_error("Invalid file name");
+    }
+    OperationGuard operation(session.activeEpoch, reclaimEpoch);
+    std::shared_lock<std::shared_mutex> structure(structureLock);
+    FileSystemNode* dir = walk(startOf(session, path), parts, parts.size() - 1, false, true);
+    if (dir == nullptr) {
+        throw std::runtime_error("Directory not found");
     }
-    return path + "/";
+    NodeLock dirLock(dir, true);
+    std::string_view name = names.intern(parts.back());
+    if (lookup(dir, name, false) != nullptr) {                                                      // Check if file already exists
+        throw std::runtime_error("File already exists");
+    }
+    createNode(dir, name, false);                                                                   // Create new file node
 }
 
-// Recursive helper function to find a node by name starting from a given node
-FileSystemNode* FileSystem::findNode(FileSystemNode* startNode, const std::string& name) {
-    if (startNode->name == name) {
-        return startNode;
+// Collects listing lines in one reusable buffer and passes them to the sink in large chunks,
+// applying the offset/limit paging of ListOptions
+class ListingWriter {
+private:
+    const OutputSink& sink;
+    const ListOptions& options;
+    std::string buffer;
+    size_t skipped;
+    bool stopped;
+
+    static const size_t CHUNK_SIZE = 64 * 1024;
+
+public:
+    size_t written;
+
+    ListingWriter(const OutputSink& sink, const ListOptions& options)
+        : sink(sink), options(options), skipped(0), stopped(false), written(0) {
+        buffer.reserve(CHUNK_SIZE + 256);
     }
-    for (auto child : startNode->children) {
-        FileSystemNode* found = findNode(child, name);                                              // Recursive search in children
-        if (found) {
-            return found;
+
+    // Adds one entry; returns false once no more entries are wanted
+    bool entry(size_t depth, std::string_view name, bool isDirectory) {
+        if (skipped < options.offset) {
+            skipped++;
+            return true;
+        }
+        if (stopped || written >= options.limit) {
+            return false;
         }
+        format(buffer, depth, name, isDirectory);
+        written++;
+        if (buffer.size() >= CHUNK_SIZE) {
+            flush();
+        }
+        return !stopped && written < options.limit;
     }
-    return nullptr;
+
+    // Adds entries already formatted by format, one per line
+    bool lines(std::string_view text) {
+        while (!text.empty()) {
+            size_t length = text.find('\n') + 1;
+            if (skipped < options.offset) {
+                skipped++;
+            } else if (stopped || written >= options.limit) {
+                return false;
+            } else {
+                buffer.append(text.substr(0, length));
+                written++;
+                if (buffer.size() >= CHUNK_SIZE) {
+                    flush();
+                }
+            }
+            text.remove_prefix(length);
+        }
+        return !stopped && written < options.limit;
+    }
+
+    // Appends one listing line: indentation, the name, "/" after directories
+    static void format(std::string& out, size_t depth, std::string_view name, bool isDirectory) {
+        out.append(depth * 2, ' ');
+        out.append(name);
+        if (isDirectory) {
+            out.push_back('/');
+        }
+        out.push_back('\n');
+    }
+
+    void flush() {
+        if (!buffer.empty() && !stopped) {
+            stopped = !sink(buffer.data(), buffer.size());
+        }
+        buffer.clear();
+    }
+};
+
+// Lists the contents of the current directory
+std::string FileSystem::ls() {
+    return primary->ls();
 }
 
-// Public find function to start the search from the root
-FileSystemNode* FileSystem::find(const std::string& name) {
-    return findNode(root, name);
+size_t FileSystem::ls(const OutputSink& sink, const ListOptions& options) {
+    return ls(*primary, sink, options);
 }
 
-// Recursive helper function to display the tree structure from a given node
-std::string FileSystem::displayTree(FileSystemNode* node, std::string indent) {
-    std::stringstream ss;
-    ss << indent << node->name << (node->isDirectory ? "/" : "") << "\n";                          // Display node with indentation
-    if (node->isDirectory) {
-        for (auto child : node->children) {
-            ss << displayTree(child, indent + "  ");                                               // Recursive call with increased indent
+// Streams the current directory listing to a sink; returns the number of entries written
+size_t FileSystem::ls(FileSystemSession& session, const OutputSink& sink, const ListOptions& options) {
+    OperationGuard operation(session.activeEpoch, reclaimEpoch);
+    FileSystemNode* dir = session.cwd;
+    dir->lock.lockShared();
+    NodeLock dirLock(dir, false);
+    ListingWriter writer(sink, options);
+    for (auto index : dir->children) {
+        if (index == NodePool::NO_NODE) continue;                                                   // Skip holes left by rm
+        FileSystemNode* child = nodes.at(index);
+        if (!writer.entry(0, child->name, child->isDirectory)) {
+            break;
         }
     }
-    return ss.str();
+    writer.flush();
+    return writer.written;
 }
 
-// Displays the entire tree structure starting from the root
-std::string FileSystem::tree() {
-    return displayTree(root, "");                                                                  // Call helper function with root and initial indentation
-}
\ No newline at end of file
+size_t FileSystem::ls(std::ostream& out, const ListOptions& options) {
+    return ls([&out](const char* data, size_t length) {
+        out.write(data, length);
+        return bool(out);
+    }, options);
+}
+
+// Changes the current directory to an absolute or relative path
+void FileSystem::cd(FileSystemSession& session, const std::string& path) {
+    if (path.empty()) {
+        throw std::runtime_error("Directory not found");
+    }
+    OperationGuard operation(session.activeEpoch, reclaimEpoch);
+    std::shared_lock<std::shared_mutex> structure(structureLock);                                   // A batch checks every cwd before removing
+    uint64_t detached = detachCount;
+    std::vector<std::string> parts = splitPath(path);
+    FileSystemNode* dir = walk(startOf(session, path), parts, parts.size(), false, false);
+    if (dir == nullptr) {
+        throw std::runtime_error("Directory not found");
+    }
+    NodeLock dirLock(dir, false);
+    std::shared_lock<std::shared_mutex> guard(detachLock);                                          // rm cannot detach it while we switch
+    if (detachCount != detached && !isAttached(dir)) {                                              // The walk began attached, so only an rm since then matters
+        throw std::runtime_error("Directory not found");                                            // Removed while we walked
+    }
+    session.cwd = dir;
+
+    if (path[0] == '/') {                                                                           // Bring the cached pwd along
+        session.cwdPath.resize(1);
+        session.cwdStarts.clear();
+    }
+    for (const std::string& part : parts) {                                                         // Same steps walk took, there is no rename
+        if (part == ".") {
+            continue;
+        }
+        if (part == "..") {
+            if (!session.cwdStarts.empty()) {                                                       // ".." of the root is the root
+                session.cwdPath.resize(session.cwdStarts.back());
+                session.cwdStarts.pop_back();
+            }
+            continue;
+        }
+        session.cwdStarts.push_back(static_cast<uint32_t>(session.cwdPath.size()));
+        session.cwdPath.append(part);
+        session.cwdPath.push_back('/');
+    }
+}
+
+// Removes a file or directory; no session's current directory or its ancestors can be removed
+void FileSystem::rm(FileSystemSession& session, const std::string& path) {
+    std::vector<std::string> parts = splitPath(path);
+    if (parts.empty() || isDotEntry(parts.back())) {                                                // Find what the path names, then remove it by name
+        std::string target;
+        {
+            OperationGuard operation(session.activeEpoch, reclaimEpoch);
+            FileSystemNode* node = walk(startOf(session, path), parts, parts.size(), false, false);
+            if (node == nullptr) {
+                throw std::runtime_error("File or directory not found");
+            }
+            NodeLock nodeLock(node, false);
+            target = pathOf(node);
+        }
+        if (target == "/") {
+            throw std::runtime_error("Cannot remove the current directory");
+        }
+        if (target.empty()) {
+            throw std::runtime_error("File or directory not found");
+        }
+        rm(session, target);
+        return;
+    }
+
+    OperationGuard operation(session.activeEpoch, reclaimEpoch);
+    FileSystemNode* node;
+    {
+        std::shared_lock<std::shared_mutex> structure(structureLock);
+        FileSystemNode* parent = walk(startOf(session, path), parts, parts.size() - 1, false, true);
+        if (parent == nullptr) {
+            throw std::runtime_error("File or directory not found");
+        }
+        NodeLock parentLock(parent, true);
+        std::string_view name = names.find(parts.back());
+        node = (path[path.size() - 1] == '/') ? lookup(parent, name, true) : lookupAny(parent, name);
+        if (node == nullptr) {
+            throw std::runtime_error("File or directory not found");
+        }
+
+        std::unique_lock<std::shared_mutex> detach(detachLock);                                     // No cd or pathOf runs while we unlink
+        detachCount++;
+        if (node->isDirectory) {
+            std::lock_guard<std::mutex> guard(sessionsLock);
+            for (auto other : sessions) {
+                for (FileSystemNode* dir = other->cwd; dir != nullptr; dir = parentOf(dir)) {
+                    if (dir == node) {
+                        throw std::runtime_error(other == &session ? "Cannot remove the current directory" : "Directory is in use");
+                    }
+                }
+            }
+        }
+        dentries.erase(parent, node);                                                               // Entries below node are keyed by dead ids
+        DiskUsage usage = usageOf(node);
+        addUsage(parent, -int64_t(usage.files), -int64_t(usage.directories), -int64_t(usage.bytes));
+        std::unique_lock<std::mutex> shadowGuard(snapshotLock, std::defer_lock);
+        if (snapshotEpoch != 0) {
+            shadowGuard.lock();
+            dropUnusedShadows();
+        }
+        size_t slot = node->slot;
+        bool compacted = parent->removeChild(nodes, node);                                          // Unlink from children
+        if (snapshotEpoch != 0) {
+            shadowRemove(parent, slot, compacted);
+        }
+    }
+    retire(session, std::span<FileSystemNode* const>(&node, 1));                                    // Freed once nobody can see it
+}
+
+// Returns the blocks from firstBlock onwards to the store and drops them from the block map;
+// the caller holds blocksLock
+void FileSystem::releaseBlocks(FileContents* contents, size_t firstBlock) {
+    for (size_t i = firstBlock; i < contents->blocks.size(); i++) {
+        if (contents->blocks[i] != BlockStore::NO_BLOCK) {
+            blocks.release(contents->blocks[i]);
+        }
+    }
+    if (firstBlock < contents->blocks.size()) {
+        contents->blocks.resize(firstBlock);
+    }
+}
+
+// Writes length bytes at offset, growing the file; skipped-over ranges become holes.
+// The caller holds the file's lock exclusively.
+size_t FileSystem::writeContents(FileSystemNode* file, uint64_t offset, const char* data, size_t length) {
+    if (length == 0) {
+        return 0;
+    }
+    if (file->contents == nullptr) {
+        file->contents = new FileContents();
+    }
+    FileContents* contents = file->contents;
+
+    const size_t blockSize = BlockStore::BLOCK_SIZE;
+    uint64_t end = offset + length;
+    size_t lastBlock = (end - 1) / blockSize;
+    if (contents->blocks.size() <= lastBlock) {
+        contents->blocks.resize(lastBlock + 1, BlockStore::NO_BLOCK);                              // New entries start as holes
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(blocksLock);
+        size_t done = 0;
+        while (done < length) {
+            uint64_t position = offset + done;
+            size_t within = position % blockSize;
+            size_t chunk = std::min(blockSize - within, length - done);
+            uint32_t& block = contents->blocks[position / blockSize];
+            if (block == BlockStore::NO_BLOCK) {
+                block = blocks.allocate();
+                if (chunk < blockSize) {
+                    std::memset(blocks.data(block), 0, blockSize);                                 // Unwritten bytes read as zeros
+                }
+            }
+            std::memcpy(blocks.data(block) + within, data + done, chunk);
+            done += chunk;
+        }
+    }
+    if (end > contents->size) {
+        resize(file, end);
+    }
+    return length;
+}
+
+// Views of the file bytes in [offset, offset + length); the caller holds the file's lock
+std::vector<std::span<const char>> FileSystem::viewContents(FileSystemNode* file, uint64_t offset, size_t length) {
+    std::vector<std::span<const char>> views;
+    FileContents* contents = file->contents;
+    if (contents == nullptr || offset >= contents->size) {
+        return views;
+    }
+    length = static_cast<size_t>(std::min<uint64_t>(length, contents->size - offset));
+
+    const size_t blockSize = BlockStore::BLOCK_SIZE;
+    std::lock_guard<std::mutex> guard(blocksLock);                                                  // Slab table may grow under other writers
+    size_t done = 0;
+    while (done < length) {
+        uint64_t position = offset + done;
+        size_t index = position / blockSize;
+        size_t within = position % blockSize;
+        size_t chunk = std::min(blockSize - within, length - done);
+        bool hole = index >= contents->blocks.size() || contents->blocks[index] == BlockStore::NO_BLOCK;
+        const char* base = hole ? BlockStore::zeroBlock() : blocks.data(contents->blocks[index]);
+        views.push_back(std::span<const char>(base + within, chunk));
+        done += chunk;
+    }
+    return views;
+}
+
+size_t FileSystem::write(FileSystemSession& session, const std::string& path, uint64_t offset, const char* data, size_t length) {
+    OperationGuard operation(session.activeEpoch, reclaimEpoch);
+    FileSystemNode* file = resolveFile(session, path, true);
+    NodeLock fileLock(file, true);
+    return writeContents(file, offset, data, length);
+}
+
+// Appends to the end of a file; the size is read and extended under one lock
+size_t FileSystem::append(FileSystemSession& session, const std::string& path, const char* data, size_t length) {
+    OperationGuard operation(session.activeEpoch, reclaimEpoch);
+    FileSystemNode* file = resolveFile(session, path, true);
+    NodeLock fileLock(file, true);
+    uint64_t size = (file->contents != nullptr) ? file->contents->size : 0;
+    return writeContents(file, size, data, length);
+}
+
+// Copies up to length bytes starting at offset; returns the number of bytes read
+size_t FileSystem::read(FileSystemSession& session, const std::string& path, uint64_t offset, char* buffer, size_t length) {
+    OperationGuard operation(session.activeEpoch, reclaimEpoch);
+    FileSystemNode* file = resolveFile(session, path, false);
+    NodeLock fileLock(file, false);
+    size_t done = 0;
+    for (auto view : viewContents(file, offset, length)) {
+        std::memcpy(buffer + done, view.data(), view.size());
+        done += view.size();
+    }
+    return done;
+}
+
+// Returns views of the file bytes in [offset, offset + length) without copying them.
+// Holes are served from a shared zero block. Views are valid until the file is next
+// written, truncated or removed.
+std::vector<std::span<const char>> FileSystem::readView(FileSystemSession& session, const std::string& path, uint64_t offset, size_t length) {
+    OperationGuard operation(session.activeEpoch, reclaimEpoch);
+    FileSystemNode* file = resolveFile(session, path, false);
+    NodeLock fileLock(file, false);
+    return viewContents(file, offset, length);
+}
+
+// Sets the file size; shrinking frees whole blocks past the end, growing adds a hole
+void FileSystem::truncate(FileSystemSession& session, const std::string& path, uint64_t size) {
+    OperationGuard operation(session.activeEpoch, reclaimEpoch);
+    FileSystemNode* file = resolveFile(session, path, true);
+    NodeLock fileLock(file, true);
+    if (file->contents == nullptr) {
+        if (size == 0) {
+            return;
+        }
+        file->contents = new FileContents();
+    }
+    FileContents* contents = file->contents;
+
+    if (size < contents->size) {
+        const size_t blockSize = BlockStore::BLOCK_SIZE;
+        size_t keep = static_cast<size_t>((size + blockSize - 1) / blockSize);                     // Blocks still holding data
+        std::lock_guard<std::mutex> guard(blocksLock);
+        releaseBlocks(contents, keep);
+        size_t within = size % blockSize;
+        if (within != 0 && keep <= contents->blocks.size() && contents->blocks[keep - 1] != BlockStore::NO_BLOCK) {
+            std::memset(blocks.data(contents->blocks[keep - 1]) + within, 0, blockSize - within);  // Keep the tail zeroed
+        }
+    }
+    if (size != contents->size) {
+        resize(file, size);
+    }
+}
+
+// Describes a file or directory
+FileStat FileSystem::stat(FileSystemSession& session, const std::string& path) {
+    OperationGuard operation(session.activeEpoch, reclaimEpoch);
+    FileSystemNode* node = resolve(session, path);
+    if (node == nullptr) {
+        throw std::runtime_error("File or directory not found");
+    }
+    NodeLock nodeLock(node, false);
+    FileStat result;
+    result.name = node->name;
+    result.path = pathOf(node);
+    result.isDirectory = node->isDirectory;
+    result.entries = node->childCount;
+    result.size = (!node->isDirectory && node->contents != nullptr) ? node->contents->size : 0;
+    return result;
+}
+
+// Counts files, directories and bytes at and below a path in O(1): every node keeps these
+// totals for its subtree, updated along the parent chain by each change below it
+DiskUsage FileSystem::du(FileSystemSession& session, const std::string& path) {
+    OperationGuard operation(session.activeEpoch, reclaimEpoch);
+    FileSystemNode* node = resolve(session, path);
+    if (node == nullptr) {
+        throw std::runtime_error("File or directory not found");
+    }
+    NodeLock nodeLock(node, false);
+    return usageOf(node);
+}
+
+// Prints the full path of the current directory. cd keeps it cached: the directories on it
+// cannot be removed while they are a session's cwd, and nothing is ever renamed.
+std::string FileSystem::pwd(FileSystemSession& session) {
+    return session.cwdPath;
+}
+
+size_t FileSystem::pwd(FileSystemSession& session, char* buffer, size_t size) {
+    const std::string& path = session.cwdPath;
+    if (path.size() < size) {
+        std::memcpy(buffer, path.c_str(), path.size() + 1);                                         // With the terminating NUL
+    }
+    return path.size();
+}
+
+// Lists a node and all of its descendants, parents before children
+static std::vector<FileSystemNode*> collectSubtree(const NodePool& pool, FileSystemNode* node) {
+    std::vector<FileSystemNode*> subtree(1, node);                                                  // Explicit list, deep trees are fine
+    for (size_t i = 0; i < subtree.size(); i++) {
+        for (auto child : subtree[i]->children) {
+            if (child != NodePool::NO_NODE) {
+                subtree.push_back(pool.at(child));
+            }
+        }
+    }
+    return subtree;
+}
+
+// Frees a detached subtree. The children of a wide directory are shared out between
+// worker threads; the directory itself goes last, once no worker can still reach it.
+void FileSystem::reclaimSubtree(FileSystemNode* node) {
+    size_t workers = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), MAX_RECLAIM_WORKERS);
+    if (!node->isDirectory || node->childCount < PARALLEL_RECLAIM_FANOUT || workers == 1) {
+        reclaimSubtrees(std::vector<FileSystemNode*>(1, node));
+        return;
+    }
+    std::vector<std::vector<FileSystemNode*>> shares(workers);
+    size_t next = 0;
+    for (auto child : node->children) {
+        if (child != NodePool::NO_NODE) {
+            shares[next++ % workers].push_back(nodes.at(child));
+        }
+    }
+    std::vector<std::thread> helpers;
+    for (size_t i = 1; i < workers; i++) {
+        helpers.emplace_back(&FileSystem::reclaimSubtrees, this, std::cref(shares[i]));
+    }
+    reclaimSubtrees(shares[0]);
+    for (auto& helper : helpers) {
+        helper.join();
+    }
+    pendingNodes++;
+    unindexNodes(std::span<FileSystemNode* const>(&node, 1));
+    releaseNodes(std::span<FileSystemNode* const>(&node, 1));
+}
+
+// Frees the subtrees under roots without recursion. Every node is dropped from the name index
+// before any is freed, so a lookup in the index never reaches a node whose parent is gone.
+// Both passes work in batches so other operations are never held up for long.
+void FileSystem::reclaimSubtrees(const std::vector<FileSystemNode*>& roots) {
+    std::vector<FileSystemNode*> found;
+    std::vector<FileSystemNode*> stack(roots.rbegin(), roots.rend());
+    size_t unindexed = 0;
+    while (!stack.empty()) {
+        FileSystemNode* node = stack.back();
+        stack.pop_back();
+        found.push_back(node);
+        for (auto child : node->children) {
+            if (child != NodePool::NO_NODE) {
+                stack.push_back(nodes.at(child));
+            }
+        }
+        if (found.size() - unindexed == RECLAIM_BATCH || stack.empty()) {
+            pendingNodes += found.size() - unindexed;
+            unindexNodes(std::span<FileSystemNode* const>(found).subspan(unindexed));
+            unindexed = found.size();
+        }
+    }
+    for (size_t i = 0; i < found.size(); i += RECLAIM_BATCH) {
+        releaseNodes(std::span<FileSystemNode* const>(found).subspan(i, std::min(RECLAIM_BATCH, found.size() - i)));
+    }
+}
+
+// Drops detached nodes from the name index
+void FileSystem::unindexNodes(std::span<FileSystemNode* const> batch) {
+    std::unique_lock<std::shared_mutex> guard(indexLock);
+    if (batch.size() * std::bit_width(nameIndex.size()) <= nameIndex.size()) {
+        for (auto node : batch) {
+            nameIndex.erase(node);
+        }
+        return;
+    }
+    std::vector<FileSystemNode*> sorted(batch.begin(), batch.end());                                // Large batch: one pass over the index
+    std::sort(sorted.begin(), sorted.end(), NameOrder());
+    auto position = nameIndex.lower_bound(sorted.front());
+    for (auto node : sorted) {
+        while (position != nameIndex.end() && NameOrder()(*position, node)) {
+            ++position;
+        }
+        if (position != nameIndex.end() && *position == node) {
+            position = nameIndex.erase(position);
+        }
+    }
+}
+
+// Frees the file blocks of detached, unindexed nodes and returns the nodes to the pool
+void FileSystem::releaseNodes(std::span<FileSystemNode* const> batch) {
+    {
+        std::lock_guard<std::mutex> guard(blocksLock);
+        for (auto node : batch) {
+            if (!node->isDirectory && node->contents != nullptr) {
+                releaseBlocks(node->contents, 0);
+            }
+        }
+    }
+    if (snapshotEpoch != 0) {
+        std::shared_lock<std::shared_mutex> structure(structureLock);                               // Not while the shared tree is built
+        std::lock_guard<std::mutex> guard(snapshotLock);
+        dropUnusedShadows();
+        for (size_t i = 0; snapshotEpoch != 0 && i < batch.size(); i++) {
+            shadowOf(batch[i]).reset();                                                             // Snapshots keep their own references
+        }
+    }
+    for (auto node : batch) {
+        nodes.destroy(node->self);
+    }
+    pendingNodes -= batch.size();
+    reclaimedNodes += batch.size();
+}
+
+// Returns a node and all of its descendants to the pool, leaving the indexes alone
+void FileSystem::destroySubtree(FileSystemNode* node) {
+    for (auto current : collectSubtree(nodes, node)) {
+        nodes.destroy(current->self);
+    }
+}
+
+// Matches a name against a pattern where '*' is any run of characters and '?' any one character
+static bool globMatch(std::string_view pattern, std::string_view name) {
+    size_t p = 0;
+    size_t n = 0;
+    size_t starPattern = std::string_view::npos;
+    size_t starName = 0;
+    while (n < name.size()) {
+        if (p < pattern.size() && pattern[p] == '*') {
+            starPattern = p++;                                                                      // Remember the star, first try matching nothing
+            starName = n;
+        } else if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == name[n])) {
+            p++;
+            n++;
+        } else if (starPattern != std::string_view::npos) {
+            p = starPattern + 1;                                                                    // Let the last star swallow one more character
+            n = ++starName;
+        } else {
+            return false;
+        }
+    }
+    while (p < pattern.size() && pattern[p] == '*') {
+        p++;
+    }
+    return p == pattern.size();
+}
+
+// Finds the first node created with the given name, or nullptr
+FileSystemNode* FileSystem::find(const std::string& name) {
+    std::shared_lock<std::shared_mutex> guard(indexLock);
+    for (auto it = nameIndex.lower_bound(NameOrder::Key(name, 0)); it != nameIndex.end() && (*it)->name == name; ++it) {
+        if (isVisible(*it)) {                                                                       // Skips removed nodes not yet reclaimed
+            return *it;
+        }
+    }
+    return nullptr;
+}
+
+// Finds every node with the given name, in creation order
+std::vector<FileSystemNode*> FileSystem::findAll(const std::string& name) {
+    std::shared_lock<std::shared_mutex> guard(indexLock);
+    std::vector<FileSystemNode*> result;
+    for (auto it = nameIndex.lower_bound(NameOrder::Key(name, 0)); it != nameIndex.end() && (*it)->name == name; ++it) {
+        if (isVisible(*it)) {
+            result.push_back(*it);
+        }
+    }
+    return result;
+}
+
+// Finds every node whose name starts with prefix, sorted by name
+std::vector<FileSystemNode*> FileSystem::findPrefix(const std::string& prefix) {
+    std::shared_lock<std::shared_mutex> guard(indexLock);
+    std::vector<FileSystemNode*> result;
+    for (auto it = nameIndex.lower_bound(NameOrder::Key(prefix, 0)); it != nameIndex.end(); ++it) {
+        if (!(*it)->name.starts_with(prefix)) {
+            break;                                                                                  // Past the last name with this prefix
+        }
+        if (isVisible(*it)) {
+            result.push_back(*it);
+        }
+    }
+    return result;
+}
+
+// Finds every node whose name matches a '*'/'?' pattern, sorted by name.
+// Only names sharing the pattern's literal prefix are examined.
+std::vector<FileSystemNode*> FileSystem::glob(const std::string& pattern) {
+    std::string prefix = pattern.substr(0, pattern.find_first_of("*?"));
+    std::shared_lock<std::shared_mutex> guard(indexLock);
+    std::vector<FileSystemNode*> result;
+    for (auto it = nameIndex.lower_bound(NameOrder::Key(prefix, 0)); it != nameIndex.end(); ++it) {
+        if (!(*it)->name.starts_with(prefix)) {
+            break;
+        }
+        if (globMatch(pattern, (*it)->name) && isVisible(*it)) {
+            result.push_back(*it);
+        }
+    }
+    return result;
+}
+
+// Displays the entire tree structure starting from the root
+std::string FileSystem::tree() {
+    std::string result;
+    tree([&result](const char* data, size_t length) {
+        result.append(data, length);
+        return true;
+    });
+    return result;
+}
+
+// Streams the tree in preorder without recursion; returns the number of entries written.
+// Every directory on the stack stays share-locked until its children have been listed.
+size_t FileSystem::tree(FileSystemSession& session, const OutputSink& sink, const ListOptions& options) {
+    struct Frame {
+        FileSystemNode* dir;
+        size_t next;                                                                                // Next child slot to visit
+    };
+
+    OperationGuard operation(session.activeEpoch, reclaimEpoch);
+    ListingWriter writer(sink, options);
+    std::vector<Frame> stack;
+    root->lock.lockShared();
+    if (writer.entry(0, root->name, root->isDirectory) && options.maxDepth > 0) {
+        stack.push_back(Frame{root, 0});
+    } else {
+        root->lock.unlockShared();
+    }
+    while (!stack.empty()) {
+        Frame& top = stack.back();
+        const ChildList& children = top.dir->children;
+        while (top.next < children.size() && children[top.next] == NodePool::NO_NODE) {
+            top.next++;                                                                             // Skip holes left by rm
+        }
+        if (top.next == children.size()) {
+            top.dir->lock.unlockShared();
+            stack.pop_back();
+            continue;
+        }
+        FileSystemNode* child = nodes.at(children[top.next++]);
+        size_t depth = stack.size();
+        if (!writer.entry(depth, child->name, child->isDirectory)) {
+            break;
+        }
+        if (child->isDirectory && depth < options.maxDepth) {                                       // childCount is only read under its lock
+            child->lock.lockShared();
+            stack.push_back(Frame{child, 0});                                                       // Invalidates top, which is not used again
+        }
+    }
+    for (auto& frame : stack) {                                                                     // Stopped early
+        frame.dir->lock.unlockShared();
+    }
+    writer.flush();
+    return writer.written;
+}
+
+size_t FileSystem::tree(const OutputSink& sink, const ListOptions& options) {
+    return tree(*primary, sink, options);
+}
+
+size_t FileSystem::tree(std::ostream& out, const ListOptions& options) {
+    return tree([&out](const char* data, size_t length) {
+        out.write(data, length);
+        return bool(out);
+    }, options);
+}
+
+// Shared state of one parallel walk. Each worker walks its piece depth first, keeping a frame
+// per directory on its stack with a copy of that directory's child list, so no lock is held
+// between nodes. Work stealing is driven by the thieves: an idle worker raises hungry, and a
+// busy worker that sees it hands over the unvisited children of its shallowest frame, the
+// oldest and largest piece of work it has, as a new strand.
+class ParallelWalk {
+private:
+    struct Frame {
+        FileSystemNode* dir;
+        std::vector<uint32_t> children;                                                             // Holes already dropped
+        size_t next;
+        size_t depth;
+        size_t split;                                                                               // Strand given the rest, NO_SPLIT if none
+    };
+
+    struct Task {
+        Frame frame;
+        size_t strand;
+    };
+
+    static const size_t NO_SPLIT = SIZE_MAX;
+    static const size_t MIN_SHARE = 64;
+    static const size_t SHARE_INTERVAL = 32;                                                        // Nodes visited between looks at hungry
+
+    const NodePool& pool;
+    const WalkVisitor& visitor;
+    const WalkOptions& options;
+    size_t workers;
+    std::mutex lock;                                                                                // tasks, idle, finished
+    std::condition_variable ready;
+    std::vector<Task> tasks;
+    size_t idle;
+    bool finished;
+    std::atomic<size_t> hungry;                                                                     // Workers waiting for a task
+    std::atomic<size_t> queued;                                                                     // tasks.size(), read without the lock
+    std::atomic<size_t> nextStrand;
+    std::atomic<bool> stopped;
+
+    // Copies a directory's children under a short shared lock
+    std::vector<uint32_t> childrenOf(FileSystemNode* dir) {
+        std::vector<uint32_t> children;
+        dir->lock.lockShared();
+        children.reserve(dir->childCount);
+        for (auto child : dir->children) {
+            if (child != NodePool::NO_NODE) {
+                children.push_back(child);
+            }
+        }
+        dir->lock.unlockShared();
+        return children;
+    }
+
+    // Hands the unvisited children of the shallowest frame that has any to a waiting worker.
+    // The innermost frame is only split while it has MIN_SHARE children left: those may all be
+    // files, not worth waking a thread for.
+    void share(std::vector<Frame>& stack) {
+        for (auto& frame : stack) {
+            size_t left = frame.children.size() - frame.next;
+            if (left == 0 || (&frame == &stack.back() && left < MIN_SHARE)) {
+                continue;
+            }
+            Task task{Frame{frame.dir, std::vector<uint32_t>(frame.children.begin() + frame.next, frame.children.end()), 0,
+                            frame.depth, NO_SPLIT},
+                      nextStrand++};
+            frame.children.resize(frame.next);
+            frame.split = task.strand;
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                tasks.push_back(std::move(task));
+                queued++;
+            }
+            ready.notify_one();
+            return;
+        }
+    }
+
+    // Waits for a task; false once every worker is idle with nothing queued
+    bool take(Task& task) {
+        std::unique_lock<std::mutex> guard(lock);
+        idle++;
+        hungry++;
+        while (tasks.empty() && !finished) {
+            if (idle == workers) {
+                finished = true;
+                ready.notify_all();
+                break;
+            }
+            ready.wait(guard);
+        }
+        hungry--;
+        if (tasks.empty()) {
+            return false;
+        }
+        idle--;
+        task = std::move(tasks.back());
+        tasks.pop_back();
+        queued--;
+        return true;
+    }
+
+    // Walks one strand; returns the number of nodes visited
+    size_t walkStrand(size_t worker, Task& task, std::vector<Frame>& stack) {
+        size_t visited = 0;
+        stack.clear();
+        stack.push_back(std::move(task.frame));
+        while (!stack.empty() && !stopped.load(std::memory_order_relaxed)) {
+            Frame& top = stack.back();
+            if (top.next == top.children.size()) {
+                if (top.split != NO_SPLIT && options.onSplit) {
+                    options.onSplit(worker, task.strand, top.split);
+                }
+                stack.pop_back();
+                continue;
+            }
+            FileSystemNode* child = pool.at(top.children[top.next++]);
+            size_t depth = top.depth + 1;
+            visited++;
+            WalkAction action = visitor(WalkEntry{child, depth, worker, task.strand});
+            if (action == WalkAction::STOP) {
+                stopped = true;
+                break;
+            }
+            if (action == WalkAction::CONTINUE && child->isDirectory && depth < options.maxDepth) {
+                stack.push_back(Frame{child, childrenOf(child), 0, depth, NO_SPLIT});              // Invalidates top
+            }
+            if (visited % SHARE_INTERVAL == 0 && hungry.load(std::memory_order_relaxed) > queued.load(std::memory_order_relaxed)) {
+                share(stack);
+            }
+        }
+        return visited;
+    }
+
+    size_t work(size_t worker) {
+        size_t visited = 0;
+        std::vector<Frame> stack;
+        Task task;
+        while (take(task)) {
+            visited += walkStrand(worker, task, stack);
+        }
+        return visited;
+    }
+
+public:
+    ParallelWalk(const NodePool& pool, const WalkVisitor& visitor, const WalkOptions& options, size_t workers)
+        : pool(pool), visitor(visitor), options(options), workers(workers), idle(0), finished(false), hungry(0),
+          queued(0), nextStrand(1), stopped(false) {}
+
+    // Visits start as strand 0, then its subtree on workers threads, the caller being worker 0.
+    // Returns the number of nodes visited.
+    size_t run(FileSystemNode* start) {
+        WalkAction action = visitor(WalkEntry{start, 0, 0, 0});
+        if (action != WalkAction::CONTINUE || !start->isDirectory || options.maxDepth == 0) {
+            return 1;
+        }
+        tasks.push_back(Task{Frame{start, childrenOf(start), 0, 0, NO_SPLIT}, 0});
+        queued = 1;
+
+        std::vector<size_t> visited(workers, 0);
+        std::vector<std::thread> helpers;
+        for (size_t i = 1; i < workers; i++) {
+            helpers.emplace_back([this, &visited, i] { visited[i] = work(i); });
+        }
+        visited[0] = work(0);
+        for (auto& helper : helpers) {
+            helper.join();
+        }
+        return 1 + std::accumulate(visited.begin(), visited.end(), size_t(0));
+    }
+};
+
+// Threads a walk may use: the requested number, or one per hardware thread
+static size_t walkThreads(size_t threads) {
+    return threads != 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Visits the node at path and everything below it on several threads. Nodes added or removed
+// meanwhile may or may not be seen; the ones seen stay allocated until the walk returns.
+// Small subtrees, going by their usage totals, are walked by the calling thread alone.
+size_t FileSystem::traverse(FileSystemSession& session, const std::string& path, const WalkVisitor& visitor, const WalkOptions& options) {
+    OperationGuard operation(session.activeEpoch, reclaimEpoch);                                    // Covers the helper threads too
+    FileSystemNode* start = resolve(session, path);
+    if (start == nullptr) {
+        throw std::runtime_error("File or directory not found");
+    }
+    DiskUsage usage = usageOf(start);
+    unlockNode(start, false);
+    size_t workers = (usage.files + usage.directories < PARALLEL_WALK_NODES) ? 1 : walkThreads(options.threads);
+    return ParallelWalk(nodes, visitor, options, workers).run(start);
+}
+
+// Paths of the nodes at and below path whose names match a '*'/'?' pattern, sorted
+std::vector<std::string> FileSystem::findIn(FileSystemSession& session, const std::string& path, const std::string& pattern, size_t threads) {
+    std::vector<std::vector<std::string>> found(walkThreads(threads));                              // One list per worker, no locking
+    WalkOptions options;
+    options.threads = threads;
+    traverse(session, path, [this, &found, &pattern](const WalkEntry& entry) {
+        if (globMatch(pattern, entry.node->name)) {
+            std::string match = pathOf(entry.node);
+            if (!match.empty()) {                                                                   // Removed during the walk
+                found[entry.worker].push_back(std::move(match));
+            }
+        }
+        return WalkAction::CONTINUE;
+    }, options);
+
+    std::vector<std::string> paths;
+    for (auto& list : found) {
+        paths.insert(paths.end(), std::make_move_iterator(list.begin()), std::make_move_iterator(list.end()));
+    }
+    std::sort(paths.begin(), paths.end());
+    return paths;
+}
+
+// Counts the files and directories at and below path whose names match a '*'/'?' pattern,
+// and the bytes in the matching files
+DiskUsage FileSystem::countIn(FileSystemSession& session, const std::string& path, const std::string& pattern, size_t threads) {
+    struct alignas(64) Count {                                                                      // A cache line each, so workers do not share one
+        DiskUsage usage{0, 0, 0};
+    };
+    std::vector<Count> counts(walkThreads(threads));
+    WalkOptions options;
+    options.threads = threads;
+    traverse(session, path, [&counts, &pattern](const WalkEntry& entry) {
+        if (globMatch(pattern, entry.node->name)) {
+            DiskUsage& usage = counts[entry.worker].usage;
+            if (entry.node->isDirectory) {
+                usage.directories++;
+            } else {
+                usage.files++;
+                usage.bytes += entry.node->bytes.load(std::memory_order_relaxed);
+            }
+        }
+        return WalkAction::CONTINUE;
+    }, options);
+
+    DiskUsage total{0, 0, 0};
+    for (auto& count : counts) {
+        total.files += count.usage.files;
+        total.directories += count.usage.directories;
+        total.bytes += count.usage.bytes;
+    }
+    return total;
+}
+
+// Writes the subtree at path in the format of tree, rendered on several threads. Every strand
+// of the walk is formatted into its own buffer, noting where strands split off from it; the
+// buffers are then written out in order, each split replaced by its strand.
+size_t FileSystem::exportTree(FileSystemSession& session, const std::string& path, const OutputSink& sink, const ListOptions& options, size_t threads) {
+    struct StrandText {
+        std::string text;
+        std::vector<std::pair<size_t, size_t>> splits;                                              // (offset in text, strand)
+    };
+
+    std::mutex strandsLock;
+    std::deque<StrandText> strands;                                                                 // By strand number; grows without moving
+    auto strandText = [&strands, &strandsLock](size_t strand) -> StrandText& {
+        std::lock_guard<std::mutex> guard(strandsLock);
+        if (strands.size() <= strand) {
+            strands.resize(strand + 1);
+        }
+        return strands[strand];
+    };
+
+    struct Current {
+        size_t strand = SIZE_MAX;
+        StrandText* text = nullptr;
+    };
+    std::vector<Current> current(walkThreads(threads));                                             // Each worker's strand, looked up once per strand
+
+    WalkOptions walkOptions;
+    walkOptions.threads = threads;
+    walkOptions.maxDepth = options.maxDepth;
+    walkOptions.onSplit = [&strandText](size_t, size_t strand, size_t handedOver) {
+        StrandText& text = strandText(strand);
+        text.splits.emplace_back(text.text.size(), handedOver);
+    };
+    traverse(session, path, [&current, &strandText](const WalkEntry& entry) {
+        Current& mine = current[entry.worker];
+        if (mine.strand != entry.strand) {
+            mine.strand = entry.strand;
+            mine.text = &strandText(entry.strand);
+        }
+        ListingWriter::format(mine.text->text, entry.depth, entry.node->name, entry.node->isDirectory);
+        return WalkAction::CONTINUE;
+    }, walkOptions);
+
+    struct Position {
+        size_t strand;
+        size_t offset;
+        size_t split;
+    };
+    ListingWriter writer(sink, options);
+    std::vector<Position> stack(1, Position{0, 0, 0});                                              // Splits can nest deeply
+    while (!stack.empty()) {
+        Position& top = stack.back();
+        const StrandText& strand = strands[top.strand];
+        size_t end = top.split < strand.splits.size() ? strand.splits[top.split].first : strand.text.size();
+        if (!writer.lines(std::string_view(strand.text).substr(top.offset, end - top.offset))) {
+            break;
+        }
+        if (top.split == strand.splits.size()) {
+            stack.pop_back();
+            continue;
+        }
+        size_t next = strand.splits[top.split].second;
+        top.offset = end;
+        top.split++;
+        stack.push_back(Position{next, 0, 0});                                                      // Invalidates top
+    }
+    writer.flush();
+    return writer.written;
+}
+
+// The single-user API acts through the primary session
+void FileSystem::mkdir(const std::string& path, bool parents) { mkdir(*primary, path, parents); }
+void FileSystem::touch(const std::string& path) { touch(*primary, path); }
+void FileSystem::cd(const std::string& path) { cd(*primary, path); }
+void FileSystem::rm(const std::string& path) { rm(*primary, path); }
+FileStat FileSystem::stat(const std::string& path) { return stat(*primary, path); }
+DiskUsage FileSystem::du(const std::string& path) { return du(*primary, path); }
+std::string FileSystem::pwd() { return pwd(*primary); }
+size_t FileSystem::pwd(char* buffer, size_t size) { return pwd(*primary, buffer, size); }
+
+size_t FileSystem::traverse(const std::string& path, const WalkVisitor& visitor, const WalkOptions& options) {
+    return traverse(*primary, path, visitor, options);
+}
+
+std::vector<std::string> FileSystem::findIn(const std::string& path, const std::string& pattern, size_t threads) {
+    return findIn(*primary, path, pattern, threads);
+}
+
+DiskUsage FileSystem::countIn(const std::string& path, const std::string& pattern, size_t threads) {
+    return countIn(*primary, path, pattern, threads);
+}
+
+size_t FileSystem::exportTree(const std::string& path, const OutputSink& sink, const ListOptions& options, size_t threads) {
+    return exportTree(*primary, path, sink, options, threads);
+}
+
+size_t FileSystem::write(const std::string& path, uint64_t offset, const char* data, size_t length) {
+    return write(*primary, path, offset, data, length);
+}
+
+size_t FileSystem::append(const std::string& path, const char* data, size_t length) {
+    return append(*primary, path, data, length);
+}
+
+size_t FileSystem::read(const std::string& path, uint64_t offset, char* buffer, size_t length) {
+    return read(*primary, path, offset, buffer, length);
+}
+
+std::vector<std::span<const char>> FileSystem::readView(const std::string& path, uint64_t offset, size_t length) {
+    return readView(*primary, path, offset, length);
+}
+
+void FileSystem::truncate(const std::string& path, uint64_t size) { truncate(*primary, path, size); }
+
+void FileSystemSession::mkdir(const std::string& path, bool parents) { fs.mkdir(*this, path, parents); }
+void FileSystemSession::touch(const std::string& path) { fs.touch(*this, path); }
+void FileSystemSession::cd(const std::string& path) { fs.cd(*this, path); }
+void FileSystemSession::rm(const std::string& path) { fs.rm(*this, path); }
+FileStat FileSystemSession::stat(const std::string& path) { return fs.stat(*this, path); }
+DiskUsage FileSystemSession::du(const std::string& path) { return fs.du(*this, path); }
+std::string FileSystemSession::pwd() { return fs.pwd(*this); }
+size_t FileSystemSession::pwd(char* buffer, size_t size) { return fs.pwd(*this, buffer, size); }
+
+std::string FileSystemSession::ls() {
+    std::string result;
+    ls([&result](const char* data, size_t length) {
+        result.append(data, length);
+        return true;
+    });
+    return result;
+}
+
+size_t FileSystemSession::ls(const OutputSink& sink, const ListOptions& options) {
+    return fs.ls(*this, sink, options);
+}
+
+// Paths of every node with the given name, in creation order
+std::vector<std::string> FileSystemSession::find(const std::string& name) {
+    OperationGuard operation(activeEpoch, fs.reclaimEpoch);                                         // Keeps the matches alive until their paths are built
+    std::vector<std::string> paths;
+    for (auto node : fs.findAll(name)) {
+        std::string path = fs.pathOf(node);
+        if (!path.empty()) {                                                                        // Removed since the index was read
+            paths.push_back(path);
+        }
+    }
+    return paths;
+}
+
+size_t FileSystemSession::write(const std::string& path, uint64_t offset, const char* data, size_t length) {
+    return fs.write(*this, path, offset, data, length);
+}
+
+size_t FileSystemSession::append(const std::string& path, const char* data, size_t length) {
+    return fs.append(*this, path, data, length);
+}
+
+size_t FileSystemSession::read(const std::string& path, uint64_t offset, char* buffer, size_t length) {
+    return fs.read(*this, path, offset, buffer, length);
+}
+
+void FileSystemSession::truncate(const std::string& path, uint64_t size) { fs.truncate(*this, path, size); }
+
+size_t FileSystemSession::traverse(const std::string& path, const WalkVisitor& visitor, const WalkOptions& options) {
+    return fs.traverse(*this, path, visitor, options);
+}
+
+std::vector<std::string> FileSystemSession::findIn(const std::string& path, const std::string& pattern, size_t threads) {
+    return fs.findIn(*this, path, pattern, threads);
+}
+
+DiskUsage FileSystemSession::countIn(const std::string& path, const std::string& pattern, size_t threads) {
+    return fs.countIn(*this, path, pattern, threads);
+}
+
+size_t FileSystemSession::exportTree(const std::string& path, const OutputSink& sink, const ListOptions& options, size_t threads) {
+    return fs.exportTree(*this, path, sink, options, threads);
+}
+
+std::string FileSystemSession::tree() {
+    std::string result;
+    tree([&result](const char* data, size_t length) {
+        result.append(data, length);
+        return true;
+    });
+    return result;
+}
+
+size_t FileSystemSession::tree(const OutputSink& sink, const ListOptions& options) {
+    return fs.tree(*this, sink, options);
+}
+
+// Frees a chain of nodes iteratively so dropping a deep snapshot cannot overflow the stack
+SnapshotNode::~SnapshotNode() {
+    std::vector<std::shared_ptr<SnapshotNode>> pending;
+    for (auto& child : children) {
+        if (child != nullptr && child.use_count() == 1) {                                           // Only this node still holds it
+            pending.push_back(std::move(child));
+        }
+    }
+    while (!pending.empty()) {
+        std::shared_ptr<SnapshotNode> node = std::move(pending.back());
+        pending.pop_back();
+        for (auto& child : node->children) {
+            if (child != nullptr && child.use_count() == 1) {
+                pending.push_back(std::move(child));
+            }
+        }
+    }                                                                                               // node is released childless here
+}
+
+// Builds the shared tree for every existing node; runs once, on the first snapshot
+void FileSystem::buildShadows() {
+    shadows.resize(nodes.bytesReserved() / sizeof(FileSystemNode));                                 // One entry per pool slot
+    std::vector<FileSystemNode*> stack(1, root);
+    while (!stack.empty()) {
+        FileSystemNode* node = stack.back();
+        stack.pop_back();
+        std::shared_ptr<SnapshotNode>& shadow = shadowOf(node);
+        shadow = std::make_shared<SnapshotNode>(node->name, node->isDirectory, snapshotEpoch);
+        shadow->children.resize(node->children.size());
+        FileSystemNode* parent = parentOf(node);
+        if (parent != nullptr) {
+            shadowOf(parent)->children[node->slot] = shadow;                                        // Parents are built first
+        }
+        for (auto child : node->children) {
+            if (child != NodePool::NO_NODE) {
+                stack.push_back(nodes.at(child));
+            }
+        }
+    }
+}
+
+// Returns node's shadow, ready to modify. A shadow from an older epoch may be shared with a
+// snapshot, so it is copied along with every ancestor up to the first one that is private.
+// A copy duplicates the directory's child pointers, so the first change below a directory
+// after a snapshot costs the fan-out of every ancestor it copies, not just the depth.
+SnapshotNode* FileSystem::writableShadow(FileSystemNode* node) {
+    std::vector<FileSystemNode*> path;
+    for (FileSystemNode* current = node; current != nullptr && shadowOf(current)->epoch != snapshotEpoch; current = parentOf(current)) {
+        path.push_back(current);
+    }
+    for (size_t i = path.size(); i-- > 0;) {                                                        // Copy top-down so each parent is private
+        FileSystemNode* current = path[i];
+        std::shared_ptr<SnapshotNode> copy = std::make_shared<SnapshotNode>(*shadowOf(current));   // Shares the children
+        copy->epoch = snapshotEpoch;
+        shadowOf(current) = copy;
+        FileSystemNode* parent = parentOf(current);
+        if (parent != nullptr) {
+            shadowOf(parent)->children[current->slot] = copy;
+        }
+    }
+    return shadowOf(node).get();
+}
+
+// Mirrors FileSystemNode::addChild in the shared tree
+void FileSystem::shadowAdd(FileSystemNode* dir, FileSystemNode* child) {
+    if (shadows.size() <= child->self) {
+        shadows.resize(nodes.bytesReserved() / sizeof(FileSystemNode));                             // The pool grew a slab
+    }
+    shadowOf(child) = std::make_shared<SnapshotNode>(child->name, child->isDirectory, snapshotEpoch);
+    SnapshotNode* shadow = writableShadow(dir);
+    shadow->children.resize(dir->children.size());
+    shadow->children[child->slot] = shadowOf(child);
+}
+
+// Mirrors FileSystemNode::removeChild in the shared tree
+void FileSystem::shadowRemove(FileSystemNode* dir, size_t slot, bool compacted) {
+    SnapshotNode* shadow = writableShadow(dir);
+    if (compacted) {                                                                                // Slots moved: copy the new layout
+        shadow->children.clear();
+        for (auto child : dir->children) {
+            shadow->children.push_back(shadows[child]);
+        }
+        return;
+    }
+    if (slot < shadow->children.size()) {
+        shadow->children[slot].reset();
+    }
+    shadow->children.resize(dir->children.size());                                                  // Trailing holes were dropped
+}
+
+// Takes a point-in-time view of the whole tree. Building the shared tree costs O(n), so the
+// first call pays it, as does the first after the last snapshot was dropped and the tree has
+// changed since; other calls are O(1) and only make the next mutations copy their paths.
+FileSystemSnapshot FileSystem::snapshot() {
+    std::unique_lock<std::shared_mutex> structure(structureLock);                                   // Waits out running mkdir/touch/rm
+    std::lock_guard<std::mutex> guard(snapshotLock);
+    if (snapshotEpoch == 0) {
+        snapshotEpoch = lastSnapshotEpoch + 1;
+        buildShadows();
+    }
+    std::shared_ptr<const void> pin = snapshotPin.lock();
+    if (pin == nullptr) {
+        pin = std::make_shared<char>(0);
+        snapshotPin = pin;
+    }
+    std::shared_ptr<const SnapshotNode> view = shadowOf(root);
+    return FileSystemSnapshot(view, snapshotEpoch++, pin);                                          // Everything now visible is frozen
+}
+
+// Stops keeping the shared tree up to date once every snapshot has been dropped, so mutations
+// go back to taking no snapshotLock at all. The caller holds snapshotLock.
+void FileSystem::dropUnusedShadows() {
+    if (snapshotEpoch == 0 || !snapshotPin.expired()) {
+        return;
+    }
+    lastSnapshotEpoch = snapshotEpoch;
+    snapshotEpoch = 0;
+    std::vector<std::shared_ptr<SnapshotNode>>().swap(shadows);                                     // Frees the shared tree
+}
+
+FileSystemSnapshot::FileSystemSnapshot(std::shared_ptr<const SnapshotNode> root, uint64_t version, std::shared_ptr<const void> pin)
+    : root(root), snapshotVersion(version), pin(pin) {}
+
+// Resolves a directory path inside the snapshot, relative paths start at its root
+const SnapshotNode* FileSystemSnapshot::resolveDirectory(const std::string& path) const {
+    std::vector<const SnapshotNode*> trail(1, root.get());                                          // Ancestors, for ".."
+    for (const std::string& part : splitPath(path)) {
+        if (part == ".") {
+            continue;
+        }
+        if (part == "..") {
+            if (trail.size() > 1) {
+                trail.pop_back();
+            }
+            continue;
+        }
+        const SnapshotNode* next = nullptr;
+        for (auto& child : trail.back()->children) {
+            if (child != nullptr && child->isDirectory && child->name == part) {
+                next = child.get();
+                break;
+            }
+        }
+        if (next == nullptr) {
+            throw std::runtime_error("Directory not found");
+        }
+        trail.push_back(next);
+    }
+    return trail.back();
+}
+
+// Lists a directory as it was when the snapshot was taken
+std::string FileSystemSnapshot::ls(const std::string& path) const {
+    std::string result;
+    for (auto& child : resolveDirectory(path)->children) {
+        if (child != nullptr) {
+            result += child->name + (child->isDirectory ? "/" : "") + "\n";
+        }
+    }
+    return result;
+}
+
+// Same layout as FileSystem::tree
+std::string FileSystemSnapshot::tree() const {
+    struct Frame {
+        const SnapshotNode* dir;
+        size_t next;
+    };
+
+    std::string result;
+    ListOptions options;
+    OutputSink sink = [&result](const char* data, size_t length) {
+        result.append(data, length);
+        return true;
+    };
+    ListingWriter writer(sink, options);                                                            // Keeps a reference to sink
+    writer.entry(0, root->name, root->isDirectory);
+    std::vector<Frame> stack(1, Frame{root.get(), 0});
+    while (!stack.empty()) {
+        Frame& top = stack.back();
+        if (top.next == top.dir->children.size()) {
+            stack.pop_back();
+            continue;
+        }
+        const SnapshotNode* child = top.dir->children[top.next++].get();
+        if (child == nullptr) {
+            continue;                                                                               // Hole
+        }
+        writer.entry(stack.size(), child->name, child->isDirectory);
+        if (child->isDirectory) {
+            stack.push_back(Frame{child, 0});
+        }
+    }
+    writer.flush();
+    return result;
+}
+
+// Walks the snapshot for nodes with the given name and returns their paths
+std::vector<std::string> FileSystemSnapshot::find(const std::string& name) const {
+    struct Frame {
+        const SnapshotNode* node;
+        std::string path;
+    };
+
+    std::vector<std::string> matches;
+    std::vector<Frame> stack(1, Frame{root.get(), "/"});
+    while (!stack.empty()) {
+        Frame frame = std::move(stack.back());
+        stack.pop_back();
+        if (frame.node->name == name) {
+            matches.push_back(frame.path);
+        }
+        for (size_t i = frame.node->children.size(); i-- > 0;) {                                    // Reverse push keeps tree order
+            const SnapshotNode* child = frame.node->children[i].get();
+            if (child != nullptr) {
+                stack.push_back(Frame{child, frame.path + child->name + (child->isDirectory ? "/" : "")});
+            }
+        }
+    }
+    return matches;
+}
+
+static const char IMAGE_MAGIC[8] = {'F', 'S', 'I', 'M', 'A', 'G', 'E', '\0'};
+static const uint32_t IMAGE_VERSION = 1;
+static const uint32_t NO_IMAGE_NODE = 0;                                                            // The root, which is never anyone's child
+
+// Writes the tree and all file contents to an image. Structural changes wait until the image
+// is written; files are share-locked as they are reached so their contents cannot change
+// between sizing the data section and copying it.
+void FileSystem::save(const std::string& path) {
+    struct FileLocks {
+        std::vector<FileSystemNode*> held;
+        ~FileLocks() {
+            for (auto file : held) {
+                file->lock.unlockShared();
+            }
+        }
+    } files;
+
+    std::unique_lock<std::shared_mutex> structure(structureLock);
+    std::vector<FileSystemNode*> order(1, root);                                                    // Breadth-first, so children are contiguous
+    std::vector<uint32_t> parents(1, 0);                                                            // Position of each one's parent
+    std::vector<ImageNode> records;
+    std::string heap;
+    std::unordered_map<const char*, uint32_t> heapOffsets;                                          // Interned names are stored once
+    heapOffsets.reserve(nodes.nodesInUse());
+    uint64_t dataSize = 0;
+    for (size_t i = 0; i < order.size(); i++) {
+        FileSystemNode* node = order[i];
+        auto stored = heapOffsets.emplace(node->name.data(), static_cast<uint32_t>(heap.size()));
+        if (stored.second) {
+            heap.append(node->name);
+        }
+        ImageNode record = {};
+        record.name = stored.first->second;
+        record.nameLength = static_cast<uint32_t>(node->name.size());
+        record.parent = parents[i];
+        record.isDirectory = node->isDirectory ? 1 : 0;
+        if (node->isDirectory) {
+            record.firstChild = static_cast<uint32_t>(order.size());
+            for (auto child : node->children) {
+                if (child != NodePool::NO_NODE) {
+                    order.push_back(nodes.at(child));
+                    parents.push_back(static_cast<uint32_t>(i));
+                }
+            }
+            record.childCount = static_cast<uint32_t>(order.size() - record.firstChild);
+            if (record.childCount == 0) {
+                record.firstChild = 0;
+            }
+        } else {
+            node->lock.lockShared();
+            files.held.push_back(node);
+            record.data = dataSize;
+            record.size = (node->contents != nullptr) ? node->contents->size : 0;
+            dataSize += record.size;
+        }
+        records.push_back(record);
+        if (order.size() >= UINT32_MAX || heap.size() >= UINT32_MAX) {
+            throw std::runtime_error("File system too large for an image");
+        }
+    }
+
+    auto byNameAndType = [&order](uint32_t a, uint32_t b) {
+        if (order[a]->name != order[b]->name) {
+            return order[a]->name < order[b]->name;
+        }
+        return order[a]->isDirectory < order[b]->isDirectory;
+    };
+    std::vector<uint32_t> sortedChildren(order.size(), 0);
+    for (const ImageNode& record : records) {
+        auto first = sortedChildren.begin() + record.firstChild;
+        std::iota(first, first + record.childCount, record.firstChild);
+        std::sort(first, first + record.childCount, byNameAndType);
+    }
+    std::vector<uint32_t> positions(nodes.bytesReserved() / sizeof(FileSystemNode), UINT32_MAX);   // By pool index
+    for (uint32_t i = 0; i < order.size(); i++) {
+        positions[order[i]->self] = i;
+    }
+    std::vector<uint32_t> byName;                                                                   // The name index is already sorted by name
+    byName.reserve(order.size());
+    {
+        std::shared_lock<std::shared_mutex> indexGuard(indexLock);
+        for (auto node : nameIndex) {
+            if (positions[node->self] != UINT32_MAX) {                                              // Not removed and waiting for the reclaimer
+                byName.push_back(positions[node->self]);
+            }
+        }
+    }
+    for (size_t first = 0, last; first < byName.size(); first = last) {                            // Equal names go by position, not id
+        for (last = first + 1; last < byName.size() && order[byName[last]]->name == order[byName[first]]->name; last++) {
+        }
+        std::sort(byName.begin() + first, byName.begin() + last);
+    }
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error("Cannot write image");
+    }
+    ImageHeader header = {};
+    std::memcpy(header.magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC));
+    header.version = IMAGE_VERSION;
+    header.nodeCount = static_cast<uint32_t>(order.size());
+    header.nameHeapSize = heap.size();
+    header.dataSize = dataSize;
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(ImageNode));
+    out.write(reinterpret_cast<const char*>(sortedChildren.data()), sortedChildren.size() * sizeof(uint32_t));
+    out.write(reinterpret_cast<const char*>(byName.data()), byName.size() * sizeof(uint32_t));
+    out.write(heap.data(), heap.size());
+    for (auto file : files.held) {
+        if (file->contents != nullptr) {
+            for (auto view : viewContents(file, 0, file->contents->size)) {
+                out.write(view.data(), view.size());
+            }
+        }
+    }
+    out.close();
+    if (!out) {
+        throw std::runtime_error("Cannot write image");
+    }
+}
+
+// Recreates the nodes and file contents of an image in this file system, which must be empty.
+// Nodes are created in the image's breadth-first order, so ids and listings keep its order,
+// and the image's name table is then already in name index order.
+void FileSystem::load(const std::string& path) {
+    FileSystemImage image(path);
+    std::unique_lock<std::shared_mutex> structure(structureLock);
+    if (root->childCount != 0) {
+        throw std::runtime_error("Cannot load an image into a non-empty file system");
+    }
+    std::vector<FileSystemNode*> created(image.nodeCount, root);
+    for (uint32_t i = 1; i < image.nodeCount; i++) {
+        const ImageNode& record = image.nodeAt(i);
+        FileSystemNode* dir = created[record.parent];
+        std::string_view name = names.intern(image.nameOf(record));
+        if (!dir->isDirectory || dir->findChild(nodes, name, record.isDirectory != 0) != nullptr) {
+            throw std::runtime_error("Corrupt file system image");
+        }
+        created[i] = createNode(dir, name, record.isDirectory != 0, true);
+        if (record.size != 0) {
+            writeContents(created[i], 0, image.data + record.data, record.size);
+        }
+    }
+    for (uint32_t i = image.nodeCount; i-- > 1;) {                                                 // Children come after their parents
+        FileSystemNode* node = created[i];
+        FileSystemNode* dir = created[image.nodeAt(i).parent];
+        dir->files.fetch_add(node->files + (node->isDirectory ? 0 : 1), std::memory_order_relaxed);
+        dir->directories.fetch_add(node->directories + (node->isDirectory ? 1 : 0), std::memory_order_relaxed);
+    }
+    std::unique_lock<std::shared_mutex> indexGuard(indexLock);
+    for (uint32_t i = 0; i < image.nodeCount; i++) {
+        uint32_t position = image.byName[i];
+        if (position >= image.nodeCount) {
+            throw std::runtime_error("Corrupt file system image");
+        }
+        if (position != 0) {
+            nameIndex.insert(nameIndex.end(), created[position]);                                  // Sorted input, amortised O(1)
+        }
+    }
+}
+
+FileSystemImage::FileSystemImage(const std::string& path) : cwd(0), cwdPath("/") {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open image");
+    }
+    struct stat info;
+    if (::fstat(fd, &info) != 0 || info.st_size < static_cast<off_t>(sizeof(ImageHeader))) {
+        ::close(fd);
+        throw std::runtime_error("Corrupt file system image");
+    }
+    length = static_cast<size_t>(info.st_size);
+    void* mapped = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);                                                                                    // The mapping keeps the file open
+    if (mapped == MAP_FAILED) {
+        throw std::runtime_error("Cannot map image");
+    }
+    base = static_cast<const char*>(mapped);
+
+    const ImageHeader* header = reinterpret_cast<const ImageHeader*>(base);
+    nodeCount = header->nodeCount;
+    nameHeapSize = header->nameHeapSize;
+    dataSize = header->dataSize;
+    uint64_t tables = sizeof(ImageHeader) + uint64_t(nodeCount) * (sizeof(ImageNode) + 2 * sizeof(uint32_t));
+    if (std::memcmp(header->magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC)) != 0 || header->version != IMAGE_VERSION ||
+        nodeCount == 0 || tables > length || nameHeapSize > length - tables || dataSize != length - tables - nameHeapSize) {
+        ::munmap(mapped, length);
+        throw std::runtime_error("Corrupt file system image");
+    }
+    nodes = reinterpret_cast<const ImageNode*>(base + sizeof(ImageHeader));
+    sortedChildren = reinterpret_cast<const uint32_t*>(nodes + nodeCount);
+    byName = sortedChildren + nodeCount;
+    nameHeap = reinterpret_cast<const char*>(byName + nodeCount);
+    data = nameHeap + nameHeapSize;
+    if (!nodes[0].isDirectory) {
+        ::munmap(mapped, length);
+        throw std::runtime_error("Corrupt file system image");
+    }
+}
+
+FileSystemImage::~FileSystemImage() {
+    ::munmap(const_cast<char*>(base), length);
+}
+
+// Returns a node after checking that following its fields stays inside the image. Parents
+// come before and children after a node, so no walk over checked nodes can loop.
+const ImageNode& FileSystemImage::nodeAt(uint32_t index) const {
+    if (index >= nodeCount) {
+        throw std::runtime_error("Corrupt file system image");
+    }
+    const ImageNode& node = nodes[index];
+    bool valid = uint64_t(node.name) + node.nameLength <= nameHeapSize &&
+                 (index == 0 ? node.parent == 0 : node.parent < index) &&
+                 (node.childCount == 0 || (node.isDirectory && node.firstChild > index &&
+                                           uint64_t(node.firstChild) + node.childCount <= nodeCount)) &&
+                 node.size <= dataSize && node.data <= dataSize - node.size;
+    if (!valid) {
+        throw std::runtime_error("Corrupt file system image");
+    }
+    return node;
+}
+
+// Binary search of a directory's sorted children; NO_IMAGE_NODE if there is no such child
+uint32_t FileSystemImage::lookup(uint32_t dir, std::string_view name, bool isDir) const {
+    const ImageNode& parent = nodeAt(dir);
+    const uint32_t* first = sortedChildren + parent.firstChild;
+    const uint32_t* last = first + parent.childCount;
+    auto key = std::make_pair(name, isDir);
+    const uint32_t* found = std::lower_bound(first, last, key, [this, &parent](uint32_t child, const std::pair<std::string_view, bool>& wanted) {
+        if (child < parent.firstChild || child >= parent.firstChild + parent.childCount) {
+            throw std::runtime_error("Corrupt file system image");                                  // Sorted entry outside the range
+        }
+        const ImageNode& node = nodeAt(child);
+        return std::make_pair(nameOf(node), node.isDirectory != 0) < wanted;
+    });
+    if (found == last) {
+        return NO_IMAGE_NODE;
+    }
+    const ImageNode& node = nodeAt(*found);
+    return (nameOf(node) == name && (node.isDirectory != 0) == isDir) ? *found : NO_IMAGE_NODE;
+}
+
+// Full path of a node, directories ending in "/", built in O(depth) like FileSystem::pathOf
+std::string FileSystemImage::pathOf(uint32_t index) const {
+    if (index == 0) {
+        return "/";
+    }
+    size_t length = nodeAt(index).isDirectory ? 1 : 0;
+    for (uint32_t current = index; current != 0; current = nodeAt(current).parent) {
+        length += nodeAt(current).nameLength + 1;
+    }
+    std::string path(length, '/');
+    size_t end = length - (nodeAt(index).isDirectory ? 1 : 0);
+    for (uint32_t current = index; current != 0; current = nodeAt(current).parent) {
+        const ImageNode& node = nodeAt(current);
+        end -= node.nameLength;
+        std::memcpy(&path[end], nameHeap + node.name, node.nameLength);
+        end--;                                                                                      // Leave the '/' in front of it
+    }
+    return path;
+}
+
+std::string FileSystemImage::ls() const {
+    std::string result;
+    ls([&result](const char* data, size_t length) {
+        result.append(data, length);
+        return true;
+    });
+    return result;
+}
+
+// Streams the current directory listing in the order the live file system had it
+size_t FileSystemImage::ls(const OutputSink& sink, const ListOptions& options) const {
+    const ImageNode& dir = nodeAt(cwd);
+    ListingWriter writer(sink, options);
+    for (uint32_t child = dir.firstChild; child < dir.firstChild + dir.childCount; child++) {
+        const ImageNode& node = nodeAt(child);
+        if (!writer.entry(0, nameOf(node), node.isDirectory != 0)) {
+            break;
+        }
+    }
+    writer.flush();
+    return writer.written;
+}
+
+// Changes the current directory; nothing changes if the path does not name a directory
+void FileSystemImage::cd(const std::string& path) {
+    if (path.empty()) {
+        throw std::runtime_error("Directory not found");
+    }
+    uint32_t dir = (path[0] == '/') ? 0 : cwd;
+    std::string dirPath = (path[0] == '/') ? std::string("/") : cwdPath;
+    for (const std::string& part : splitPath(path)) {
+        if (part == ".") {
+            continue;
+        }
+        if (part == "..") {
+            if (dir != 0) {                                                                         // ".." of the root is the root
+                dir = nodeAt(dir).parent;
+                dirPath.resize(dirPath.rfind('/', dirPath.size() - 2) + 1);
+            }
+            continue;
+        }
+        dir = lookup(dir, part, true);
+        if (dir == NO_IMAGE_NODE) {
+            throw std::runtime_error("Directory not found");
+        }
+        dirPath.append(part);
+        dirPath.push_back('/');
+    }
+    cwd = dir;
+    cwdPath = std::move(dirPath);
+}
+
+// Paths of every node with the given name, found by binary search of the name table
+std::vector<std::string> FileSystemImage::find(const std::string& name) const {
+    auto nameBefore = [this](uint32_t index, std::string_view name) { return nameOf(nodeAt(index)) < name; };
+    auto nameAfter = [this](std::string_view name, uint32_t index) { return name < nameOf(nodeAt(index)); };
+    const uint32_t* first = std::lower_bound(byName, byName + nodeCount, std::string_view(name), nameBefore);
+    const uint32_t* last = std::upper_bound(first, byName + nodeCount, std::string_view(name), nameAfter);
+    std::vector<std::string> paths;
+    for (const uint32_t* it = first; it != last; ++it) {
+        paths.push_back(pathOf(*it));
+    }
+    return paths;
+}
+
+std::string FileSystemImage::tree() const {
+    std::string result;
+    tree([&result](const char* data, size_t length) {
+        result.append(data, length);
+        return true;
+    });
+    return result;
+}
+
+// Same layout as FileSystem::tree
+size_t FileSystemImage::tree(const OutputSink& sink, const ListOptions& options) const {
+    struct Frame {
+        uint32_t next;                                                                              // Next child to visit
+        uint32_t end;
+    };
+
+    ListingWriter writer(sink, options);
+    std::vector<Frame> stack;
+    const ImageNode& root = nodeAt(0);
+    if (writer.entry(0, nameOf(root), true) && options.maxDepth > 0) {
+        stack.push_back(Frame{root.firstChild, root.firstChild + root.childCount});
+    }
+    while (!stack.empty()) {
+        Frame& top = stack.back();
+        if (top.next == top.end) {
+            stack.pop_back();
+            continue;
+        }
+        const ImageNode& child = nodeAt(top.next++);
+        size_t depth = stack.size();
+        if (!writer.entry(depth, nameOf(child), child.isDirectory != 0)) {
+            break;
+        }
+        if (child.isDirectory && depth < options.maxDepth) {
+            stack.push_back(Frame{child.firstChild, child.firstChild + child.childCount});         // Invalidates top, which is not used again
+        }
+    }
+    writer.flush();
+    return writer.written;
+}
+
+static const uint32_t JOURNAL_MAGIC = 0x314A5346;                                                   // "FSJ1"
+
+// FNV-1a over a journal record's payload, to find a record torn by a crash
+static uint32_t journalChecksum(const char* data, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ static_cast<unsigned char>(data[i])) * 16777619u;
+    }
+    return hash;
+}
+
+// Dry run of a batch: every operation is applied in order to an overlay on the live tree, so
+// a failing operation rejects the batch before anything has changed. What is left in the
+// overlay afterwards is the net effect, grouped by directory.
+class BatchPlan {
+public:
+    static const uint32_t NONE = UINT32_MAX;
+
+    struct Change {
+        uint64_t order;                                 // When the batch last created it, 0 once removed
+        uint32_t dir;                                   // Plan directory of a created directory
+        uint32_t created;                               // Index into its parent's created list
+    };
+
+    // A child created or removed by the batch, keyed by plan directory, interned name and type
+    struct Entry {
+        const char* name;                               // nullptr if the slot is free
+        uint32_t dir;
+        bool isDirectory;
+        Change change;
+    };
+
+    struct Created {
+        uint64_t order;                                 // 0 if removed again later in the batch
+        std::string_view name;
+        bool isDirectory;
+        uint32_t dir;
+    };
+
+    struct Directory {
+        FileSystemNode* live;                           // Existing directory, nullptr if the batch creates it
+        uint32_t parent;
+        std::string_view name;
+        bool removed;
+        FileSystemNode* node;                           // Live or created node, set while applying
+        std::vector<Created> created;                   // In creation order
+        std::vector<FileSystemNode*> dropped;           // Existing children the batch removes
+    };
+
+    // A child as the batch sees it so far
+    struct Child {
+        FileSystemNode* live;                           // nullptr if the batch created it
+        uint32_t dir;                                   // Plan directory, NONE for files
+        uint64_t rank;                                  // Creation order, live children first
+        Change* change;                                 // Set if the batch created or removed it
+    };
+
+    FileSystem& fs;
+    FileSystemSession& session;
+    std::vector<Directory> dirs;                        // dirs[0] is the root
+    std::unordered_map<FileSystemNode*, uint32_t> liveDirs;
+    std::vector<Entry> changes;                         // Open addressing, at most half full
+    size_t changed;
+    uint64_t sequence;
+    std::vector<std::string_view> parts;
+    std::unordered_map<std::string_view, uint32_t> parents[2];  // Parent paths already walked, absolute and relative
+
+    BatchPlan(FileSystem& fs, FileSystemSession& session, size_t operations) : fs(fs), session(session), changed(0), sequence(0) {
+        dirs.push_back(Directory{fs.root, 0, fs.root->name, false, fs.root, {}, {}});
+        liveDirs[fs.root] = 0;
+        changes.resize(std::bit_ceil(2 * operations + 16));
+    }
+
+    // Slot for the key: its entry if the batch touched it, otherwise the free slot it would take
+    Entry& slotOf(uint32_t dir, const char* name, bool isDir) {
+        uint64_t hash = (reinterpret_cast<uintptr_t>(name) ^ (uint64_t(dir) << 1) ^ (isDir ? 1 : 0)) * 0x9E3779B97F4A7C15ULL;
+        size_t mask = changes.size() - 1;
+        for (size_t i = (hash ^ (hash >> 29)) & mask;; i = (i + 1) & mask) {
+            Entry& entry = changes[i];
+            if (entry.name == nullptr || (entry.name == name && entry.dir == dir && entry.isDirectory == isDir)) {
+                return entry;
+            }
+        }
+    }
+
+    void record(uint32_t dir, const char* name, bool isDir, const Change& change) {
+        Entry* entry = &slotOf(dir, name, isDir);
+        if (entry->name == nullptr && 2 * ++changed > changes.size()) {                             // mkdir -p can add several per operation
+            std::vector<Entry> old(changes.size() * 2);
+            old.swap(changes);
+            for (const Entry& moved : old) {
+                if (moved.name != nullptr) {
+                    slotOf(moved.dir, moved.name, moved.isDirectory) = moved;
+                }
+            }
+            entry = &slotOf(dir, name, isDir);
+        }
+        *entry = Entry{name, dir, isDir, change};
+    }
+
+    // Plan directory of an existing directory, added along with its ancestors on first use
+    uint32_t planOf(FileSystemNode* dir) {
+        std::vector<FileSystemNode*> missing;
+        for (; liveDirs.find(dir) == liveDirs.end(); dir = fs.parentOf(dir)) {
+            missing.push_back(dir);
+        }
+        uint32_t plan = liveDirs[dir];
+        for (size_t i = missing.size(); i-- > 0;) {
+            dirs.push_back(Directory{missing[i], plan, missing[i]->name, false, nullptr, {}, {}});
+            plan = static_cast<uint32_t>(dirs.size() - 1);
+            liveDirs[missing[i]] = plan;
+        }
+        return plan;
+    }
+
+    bool find(uint32_t dir, std::string_view name, bool isDir, Child& child) {
+        std::string_view interned = fs.names.find(name);
+        if (interned.data() == nullptr) {
+            return false;                                                                           // Never created, by anyone
+        }
+        Entry& entry = slotOf(dir, interned.data(), isDir);
+        if (entry.name != nullptr) {
+            child = Child{nullptr, entry.change.dir, UINT64_MAX / 2 + entry.change.order, &entry.change};
+            return entry.change.order != 0;
+        }
+        if (dirs[dir].live == nullptr) {
+            return false;
+        }
+        FileSystemNode* node = dirs[dir].live->findChild(fs.nodes, interned, isDir);
+        if (node == nullptr) {
+            return false;
+        }
+        child = Child{node, isDir ? planOf(node) : NONE, node->slot, nullptr};
+        return true;
+    }
+
+    uint32_t create(uint32_t dir, std::string_view name, bool isDir) {
+        std::string_view interned = fs.names.intern(name);
+        uint32_t created = NONE;
+        if (isDir) {
+            dirs.push_back(Directory{nullptr, dir, interned, false, nullptr, {}, {}});
+            created = static_cast<uint32_t>(dirs.size() - 1);
+        }
+        std::vector<Created>& list = dirs[dir].created;
+        record(dir, interned.data(), isDir, Change{++sequence, created, static_cast<uint32_t>(list.size())});
+        list.push_back(Created{sequence, interned, isDir, created});
+        return created;
+    }
+
+    void remove(uint32_t dir, std::string_view name, bool isDir, const Child& child) {
+        if (child.live != nullptr && isDir) {                                                       // Same rule as rm
+            std::lock_guard<std::mutex> guard(fs.sessionsLock);
+            for (auto other : fs.sessions) {
+                for (FileSystemNode* current = other->cwd; current != nullptr; current = fs.parentOf(current)) {
+                    if (current == child.live) {
+                        throw std::runtime_error(other == &session ? "Cannot remove the current directory" : "Directory is in use");
+                    }
+                }
+            }
+        }
+        if (child.live != nullptr) {
+            dirs[dir].dropped.push_back(child.live);
+        }
+        if (child.dir != NONE) {
+            dirs[child.dir].removed = true;
+            parents[0].clear();                                                                     // Walked paths may lead through it
+            parents[1].clear();
+        }
+        if (child.change != nullptr) {
+            dirs[dir].created[child.change->created].order = 0;
+            *child.change = Change{0, NONE, NONE};
+        } else {
+            record(dir, fs.names.find(name).data(), isDir, Change{0, NONE, NONE});
+        }
+    }
+
+    // Follows count components as directories, like FileSystem::walk
+    uint32_t walk(uint32_t dir, size_t count, bool createMissing) {
+        for (size_t i = 0; i < count; i++) {
+            if (parts[i] == ".") {
+                continue;
+            }
+            if (parts[i] == "..") {
+                dir = dirs[dir].parent;                                                             // The root is its own parent
+                continue;
+            }
+            Child child;
+            if (find(dir, parts[i], true, child)) {
+                dir = child.dir;
+            } else if (createMissing) {
+                dir = create(dir, parts[i], true);
+            } else {
+                throw std::runtime_error("Directory not found");
+            }
+        }
+        return dir;
+    }
+
+    // Directory holding the last component; consecutive operations in one directory share the walk
+    uint32_t parentOf(uint32_t start, const std::string& path, bool createMissing) {
+        std::unordered_map<std::string_view, uint32_t>& walked = parents[start == 0 ? 0 : 1];     // The cwd is fixed for the batch
+        std::string_view prefix(path.data(), parts.back().data() - path.data());
+        auto known = walked.find(prefix);
+        if (known != walked.end()) {
+            return known->second;
+        }
+        uint32_t dir = walk(start, parts.size() - 1, createMissing);
+        walked.emplace(prefix, dir);
+        return dir;
+    }
+
+    // Applies one operation to the overlay, failing as the single operation would
+    void add(const BatchOperation& operation) {
+        const std::string& path = operation.path;
+        parts.clear();
+        for (size_t start = 0; start < path.size();) {                                             // Same components as splitPath
+            size_t end = std::min(path.find('/', start), path.size());
+            if (end > start) {
+                parts.push_back(std::string_view(path).substr(start, end - start));
+            }
+            start = end + 1;
+        }
+        uint32_t start = (!path.empty() && path[0] == '/') ? 0 : planOf(session.cwd);
+        bool namesDirectory = parts.empty() || parts.back() == "." || parts.back() == "..";
+        Child child;
+        switch (operation.kind) {
+        case BatchOperation::MKDIR: {
+            if (path.empty()) {
+                throw std::runtime_error("Invalid directory name");
+            }
+            if (namesDirectory) {
+                walk(start, parts.size(), operation.parents);
+                if (!operation.parents) {
+                    throw std::runtime_error("File already exists");
+                }
+                return;
+            }
+            uint32_t dir = parentOf(start, path, operation.parents);
+            if (find(dir, parts.back(), true, child)) {
+                if (operation.parents) {
+                    return;
+                }
+                throw std::runtime_error("File already exists");
+            }
+            create(dir, parts.back(), true);
+            return;
+        }
+        case BatchOperation::TOUCH: {
+            if (namesDirectory || path[path.size() - 1] == '/') {
+                throw std::runtime_error("Invalid file name");
+            }
+            uint32_t dir = parentOf(start, path, false);
+            if (find(dir, parts.back(), false, child)) {
+                throw std::runtime_error("File already exists");
+            }
+            create(dir, parts.back(), false);
+            return;
+        }
+        case BatchOperation::RM: {
+            if (namesDirectory) {
+                uint32_t dir = walk(start, parts.size(), false);
+                if (dir == 0) {
+                    throw std::runtime_error("Cannot remove the current directory");
+                }
+                uint32_t parent = dirs[dir].parent;
+                std::string_view name = dirs[dir].name;
+                find(parent, name, true, child);
+                remove(parent, name, true, child);
+                return;
+            }
+            uint32_t dir = parentOf(start, path, false);
+            Child file;
+            bool isFile = path[path.size() - 1] != '/' && find(dir, parts.back(), false, file);
+            bool isDir = find(dir, parts.back(), true, child);
+            if (!isFile && !isDir) {
+                throw std::runtime_error("File or directory not found");
+            }
+            if (isFile && (!isDir || file.rank < child.rank)) {                                     // Either type: the one created first
+                remove(dir, parts.back(), false, file);
+            } else {
+                remove(dir, parts.back(), true, child);
+            }
+            return;
+        }
+        }
+    }
+};
+
+// Applies a batch of mkdir/touch/rm as one change: the batch is first checked in full against
+// an overlay of the tree, so either every operation takes effect or none does. The net effect
+// is then applied one directory at a time, each locked and looked up once with room for its
+// new children reserved up front. Other sessions see the tree before or after the batch.
+// All or nothing covers the checks only: running out of nodes or memory while applying a
+// batch that passed them leaves it partly applied, and still journaled.
+void FileSystem::apply(FileSystemSession& session, const std::vector<BatchOperation>& batch, bool logged) {
+    OperationGuard operation(session.activeEpoch, reclaimEpoch);
+    std::vector<FileSystemNode*> removed;
+    {
+        std::unique_lock<std::shared_mutex> structure(structureLock);                               // No mkdir/touch/rm/cd meanwhile
+        BatchPlan plan(*this, session, batch.size());
+        for (const BatchOperation& step : batch) {
+            plan.add(step);
+        }
+        if (logged && journal >= 0) {
+            appendJournal(session, batch);                                                          // Written ahead of the change
+        }
+
+        for (BatchPlan::Directory& dir : plan.dirs) {
+            if (dir.dropped.empty()) {
+                continue;
+            }
+            FileSystemNode* parent = dir.live;
+            lockNode(parent, true);
+            NodeLock parentLock(parent, true);
+            std::unique_lock<std::shared_mutex> detach(detachLock);
+            std::unique_lock<std::mutex> shadowGuard(snapshotLock, std::defer_lock);
+            if (snapshotEpoch != 0) {
+                shadowGuard.lock();
+                dropUnusedShadows();
+            }
+            for (FileSystemNode* node : dir.dropped) {
+                detachCount++;
+                dentries.erase(parent, node);
+                DiskUsage usage = usageOf(node);
+                addUsage(parent, -int64_t(usage.files), -int64_t(usage.directories), -int64_t(usage.bytes));
+                size_t slot = node->slot;
+                bool compacted = parent->removeChild(nodes, node);
+                if (snapshotEpoch != 0) {
+                    shadowRemove(parent, slot, compacted);
+                }
+                removed.push_back(node);
+            }
+        }
+
+        std::vector<FileSystemNode*> created;
+        std::vector<DiskUsage> below(plan.dirs.size(), DiskUsage{0, 0, 0});                         // Created under each plan directory
+        for (size_t i = 0; i < plan.dirs.size(); i++) {                                             // Parents come before their subdirectories
+            BatchPlan::Directory& dir = plan.dirs[i];
+            if (dir.live != nullptr) {
+                dir.node = (i == 0 || (!dir.removed && plan.dirs[dir.parent].node != nullptr)) ? dir.live : nullptr;
+            }
+            size_t added = 0;
+            for (const BatchPlan::Created& entry : dir.created) {
+                added += (entry.order != 0);                                                        // Not removed again later
+            }
+            if (dir.node == nullptr || added == 0) {
+                continue;
+            }
+            lockNode(dir.node, true);
+            NodeLock dirLock(dir.node, true);
+            dir.node->reserveChildren(nodes, added);
+            for (const BatchPlan::Created& entry : dir.created) {
+                if (entry.order == 0) {
+                    continue;
+                }
+                FileSystemNode* child = createNode(dir.node, entry.name, entry.isDirectory, true);
+                created.push_back(child);
+                if (entry.isDirectory) {
+                    plan.dirs[entry.dir].node = child;
+                    below[i].directories++;
+                } else {
+                    below[i].files++;
+                }
+            }
+        }
+        {
+            std::shared_lock<std::shared_mutex> detach(detachLock);
+            for (size_t i = plan.dirs.size(); i-- > 0;) {                                           // New directories pass their totals up
+                BatchPlan::Directory& dir = plan.dirs[i];
+                if (dir.node == nullptr || (below[i].files == 0 && below[i].directories == 0)) {
+                    continue;
+                }
+                if (dir.live != nullptr) {
+                    addUsage(dir.node, below[i].files, below[i].directories, 0);                   // Once per existing directory
+                } else {
+                    dir.node->files = static_cast<uint32_t>(below[i].files);
+                    dir.node->directories = static_cast<uint32_t>(below[i].directories);
+                    below[dir.parent].files += below[i].files;
+                    below[dir.parent].directories += below[i].directories;
+                }
+            }
+        }
+        std::sort(created.begin(), created.end(), [](FileSystemNode* a, FileSystemNode* b) {
+            return NameOrder::keyOf(b) < NameOrder::keyOf(a);
+        });
+        std::unique_lock<std::shared_mutex> indexGuard(indexLock);
+        auto hint = nameIndex.end();
+        for (auto node : created) {                                                                 // Descending, so each lands just before the last
+            hint = nameIndex.insert(hint, node);
+        }
+    }
+    retire(session, removed);
+}
+
+// Appends one batch to the journal and waits for it to reach the disk. Records are
+// [magic, payload length, checksum] then the payload: the operation count, then per operation
+// its kind, parents flag, path length and the path made absolute. Called under structureLock.
+void FileSystem::appendJournal(FileSystemSession& session, const std::vector<BatchOperation>& batch) {
+    std::string payload;
+    auto put32 = [&payload](uint32_t value) { payload.append(reinterpret_cast<const char*>(&value), sizeof(value)); };
+    put32(static_cast<uint32_t>(batch.size()));
+    for (const BatchOperation& step : batch) {
+        std::string path = (!step.path.empty() && step.path[0] == '/') ? step.path : session.cwdPath + step.path;
+        payload.push_back(static_cast<char>(step.kind));
+        payload.push_back(step.parents ? 1 : 0);
+        put32(static_cast<uint32_t>(path.size()));
+        payload.append(path);
+    }
+    uint32_t header[3] = {JOURNAL_MAGIC, static_cast<uint32_t>(payload.size()), journalChecksum(payload.data(), payload.size())};
+    std::string record(reinterpret_cast<const char*>(header), sizeof(header));
+    record.append(payload);
+    off_t end = ::lseek(journal, 0, SEEK_END);
+    if (end < 0) {
+        throw std::runtime_error("Cannot write journal");
+    }
+    auto fail = [this, end]() {                                                                     // The batch fails, so replay must not apply it
+        if (::ftruncate(journal, end) != 0) {
+            throw std::runtime_error("Cannot write journal, and the failed batch may remain in it");
+        }
+        throw std::runtime_error("Cannot write journal");
+    };
+    for (size_t done = 0; done < record.size();) {
+        ssize_t written = ::write(journal, record.data() + done, record.size() - done);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            fail();
+        }
+        done += written;
+    }
+    if (::fdatasync(journal) != 0) {
+        fail();
+    }
+}
+
+// Starts appending every applied batch to a journal, creating it if needed. Replay an existing
+// journal first: records are appended after whatever the file holds.
+void FileSystem::openJournal(const std::string& path) {
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open journal");
+    }
+    std::unique_lock<std::shared_mutex> structure(structureLock);                                   // Not while a batch is being logged
+    if (journal >= 0) {
+        ::close(journal);
+    }
+    journal = fd;
+}
+
+// Applies every complete record of a journal in order, without journaling them again, and
+// cuts off a record torn by a crash so that new records can follow the last good one
+size_t FileSystem::replayJournal(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        throw std::runtime_error("Cannot open journal");
+    }
+    std::string contents((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    auto get32 = [&contents](size_t at) {
+        uint32_t value;
+        std::memcpy(&value, contents.data() + at, sizeof(value));
+        return value;
+    };
+
+    size_t position = 0;
+    size_t replayed = 0;
+    while (contents.size() - position >= 12) {
+        size_t length = get32(position + 4);
+        if (get32(position) != JOURNAL_MAGIC || contents.size() - position - 12 < length ||
+            journalChecksum(contents.data() + position + 12, length) != get32(position + 8)) {
+            break;
+        }
+        std::vector<BatchOperation> batch;
+        size_t at = position + 12;
+        size_t end = at + length;
+        if (length < 4) {
+            throw std::runtime_error("Corrupt journal");
+        }
+        uint32_t count = get32(at);
+        at += 4;
+        for (uint32_t i = 0; i < count; i++) {
+            if (end - at < 6 || end - at - 6 < get32(at + 2) || static_cast<uint8_t>(contents[at]) > BatchOperation::RM) {
+                throw std::runtime_error("Corrupt journal");                                        // Intact record that was never valid
+            }
+            uint32_t pathLength = get32(at + 2);
+            batch.emplace_back(static_cast<BatchOperation::Kind>(contents[at]), contents.substr(at + 6, pathLength), contents[at + 1] != 0);
+            at += 6 + pathLength;
+        }
+        apply(*primary, batch, false);
+        replayed++;
+        position = end;
+    }
+    in.close();
+    if (position != contents.size() && ::truncate(path.c_str(), position) != 0) {
+        throw std::runtime_error("Cannot truncate journal");
+    }
+    return replayed;
+}
+
+void FileSystem::apply(const std::vector<BatchOperation>& batch) { apply(*primary, batch, true); }
+void FileSystemSession::apply(const std::vector<BatchOperation>& batch) { fs.apply(*this, batch, true); }
@@ -5,38 +5,638 @@
 #include <string>
 #include <vector>
 #include <sstream>
+#include <cstdint>
+#include <unordered_map>
+#include <map>
+#include <set>
+#include <utility>
+#include <functional>
+#include <ostream>
+#include <span>
+#include <string_view>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <thread>
+#include <deque>
+#include "BlockStore.hpp"
+#include "RWLock.hpp"
+#include "NameTable.hpp"
 
+class FileSystemNode;
+class NodePool;
+
+// Node of the structurally shared tree behind FileSystem snapshots. A node created in the
+// current epoch is private to the live tree and updated in place; an older one may be
+// reachable from a snapshot, so mutating it copies it and its ancestors first.
+// children mirrors the live node's slots, holes included.
+struct SnapshotNode {
+    std::string name;
+    bool isDirectory;
+    uint64_t epoch;
+    std::vector<std::shared_ptr<SnapshotNode>> children;
+
+    SnapshotNode(std::string_view name, bool isDir, uint64_t epoch)
+        : name(name), isDirectory(isDir), epoch(epoch) {}
+    ~SnapshotNode();
+};
+
+// Open-addressing hash table over a directory's children, keyed by interned name and type.
+// Entries are node indices, so compacting the children list does not touch it. Each entry
+// keeps 32 bits of its hash so probing past other entries does not have to load their nodes.
+class ChildIndex {
+private:
+    struct Entry {
+        uint32_t node;                                  // NO_NODE = empty slot, TOMBSTONE = erased
+        uint32_t hash;
+    };
+
+    std::vector<Entry> table;
+    size_t occupied;                                    // Live entries plus tombstones
+    size_t live;
+
+    static const uint32_t TOMBSTONE = UINT32_MAX;
+
+    static size_t hashOf(std::string_view name, bool isDir);
+    size_t probe(const NodePool& pool, std::string_view name, bool isDir) const;
+    void rehash(size_t capacity);
+
+public:
+    explicit ChildIndex(size_t expected);
+
+    uint32_t find(const NodePool& pool, std::string_view name, bool isDir) const;
+    void insert(const NodePool& pool, uint32_t node);
+    void erase(const NodePool& pool, uint32_t node);
+    void reserve(size_t entries);                       // Room for this many live entries without rehashing
+};
+
+// Child indices of a directory in insertion order. Up to two are stored inline, so files
+// and small directories need no allocation of their own.
+class ChildList {
+private:
+    union {
+        uint32_t inlined[2];
+        uint32_t* heap;
+    };
+    uint32_t count;
+    uint32_t capacity;                                  // 2 while inline
+
+    uint32_t* data() { return capacity > 2 ? heap : inlined; }
+    const uint32_t* data() const { return capacity > 2 ? heap : inlined; }
+
+public:
+    ChildList() : count(0), capacity(2) {}
+    ~ChildList() {
+        if (capacity > 2) {
+            delete[] heap;
+        }
+    }
+
+    ChildList(const ChildList&) = delete;
+    ChildList& operator=(const ChildList&) = delete;
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    uint32_t& operator[](size_t i) { return data()[i]; }
+    uint32_t operator[](size_t i) const { return data()[i]; }
+    uint32_t back() const { return data()[count - 1]; }
+    const uint32_t* begin() const { return data(); }
+    const uint32_t* end() const { return data() + count; }
+
+    void push_back(uint32_t node);
+    void reserve(size_t size);
+    void pop_back() { count--; }
+    void shrink(size_t size) { count = static_cast<uint32_t>(size); }
+};
+
+// A file or directory. Nodes live in their FileSystem's NodePool and refer to each other by
+// 32-bit index; NodePool::NO_NODE marks a missing parent or a hole in children.
 class FileSystemNode {
 public:
-    std::string name;
+    std::string_view name;                              // Interned in the FileSystem's NameTable
+    uint64_t id;                                        // Unique for the life of the FileSystem, never reused
+    ChildList children;                                 // Insertion order; removed children leave NO_NODE holes
+    union {
+        ChildIndex* index;                              // Directories: only built above INDEX_THRESHOLD
+        FileContents* contents;                         // Files: data, nullptr while the file is empty
+    };
+    std::atomic<uint32_t> parent;                       // Only changes when the node is detached by rm
+    uint32_t self;                                      // This node's index in the pool
+    uint32_t slot;                                      // Position in the parent's children
+    uint32_t childCount;                                // Children that are not holes
+    std::atomic<uint32_t> files;                        // Directories: files anywhere below
+    std::atomic<uint32_t> directories;                  // Directories: directories anywhere below
+    std::atomic<uint64_t> bytes;                        // Size of the file, or of every file below a directory
+    mutable RWLock lock;                                // Guards children (directories) or contents (files)
     bool isDirectory;
-    std::vector<FileSystemNode*> children;
-    FileSystemNode* parent;
 
-    FileSystemNode(std::string name, bool isDir);
+    static const size_t INDEX_THRESHOLD = 32;
+
+    FileSystemNode(std::string_view name, bool isDir, uint32_t self);
     ~FileSystemNode();
+
+    FileSystemNode(const FileSystemNode&) = delete;
+    FileSystemNode& operator=(const FileSystemNode&) = delete;
+
+    // Names passed in must be interned, they are compared by address
+    FileSystemNode* findChild(const NodePool& pool, std::string_view name, bool isDir) const;
+    void addChild(const NodePool& pool, FileSystemNode* child);
+    void reserveChildren(const NodePool& pool, size_t extra);  // Before adding extra children at once
+    bool removeChild(const NodePool& pool, FileSystemNode* child);  // Unlinks without freeing; true if other children changed slot
+
+private:
+    void compact(const NodePool& pool);
+};
+
+// Slab allocator for FileSystemNode. Nodes are named by 32-bit indices and slabs never move,
+// so at() needs no lock and an index maps to the same address for the node's whole life.
+// The slab table is reserved up front for MAX_SLABS but only touched as slabs are added.
+class NodePool {
+private:
+    FileSystemNode** slabs;
+    std::vector<uint32_t> freeNodes;
+    uint32_t nextUnused;                                // Indices below this have been handed out at least once
+    size_t inUse;
+    std::mutex lock;
+
+    static const size_t SLAB_BITS = 12;
+    static const size_t SLAB_NODES = size_t(1) << SLAB_BITS;
+    static const size_t MAX_SLABS = (size_t(1) << 32) / SLAB_NODES;
+
+public:
+    static constexpr uint32_t NO_NODE = 0;              // Never handed out
+
+    NodePool();
+    ~NodePool();
+
+    NodePool(const NodePool&) = delete;
+    NodePool& operator=(const NodePool&) = delete;
+
+    uint32_t create(std::string_view name, bool isDir);
+    void destroy(uint32_t node);
+
+    FileSystemNode* at(uint32_t node) const {
+        return slabs[node >> SLAB_BITS] + (node & (SLAB_NODES - 1));
+    }
+
+    size_t nodesInUse();
+    size_t bytesReserved();
+};
+
+// Bounded cache of resolved path components, keyed by (parent id, interned name, type).
+// Keys use node ids rather than indices, so entries under a removed directory can
+// never be hit again even if the pool hands its slot to a new node.
+// Eviction follows the CLOCK algorithm within each of SHARDS independently locked shards.
+class DentryCache {
+private:
+    struct Key {
+        uint64_t parentId;
+        const char* name;                               // Interned, so the address identifies it
+        bool isDirectory;
+
+        bool operator==(const Key& other) const {
+            return parentId == other.parentId && isDirectory == other.isDirectory && name == other.name;
+        }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const;
+    };
+
+    struct Entry {
+        Key key;
+        FileSystemNode* node;                           // nullptr when the slot is free
+        bool referenced;
+    };
+
+    struct Shard {
+        std::mutex lock;
+        std::vector<Entry> entries;
+        std::vector<size_t> freeSlots;
+        std::unordered_map<Key, size_t, KeyHash> slots;
+        size_t hand = 0;
+    };
+
+    static const size_t SHARDS = 16;
+
+    std::unique_ptr<Shard[]> shards;
+    size_t capacity;                                    // Per shard
+
+    Shard& shardFor(const Key& key) { return shards[(KeyHash()(key) >> 8) % SHARDS]; }
+
+public:
+    std::atomic<size_t> hits;
+    std::atomic<size_t> misses;
+
+    explicit DentryCache(size_t capacity);
+
+    FileSystemNode* lookup(const FileSystemNode* parent, std::string_view name, bool isDir);
+    void insert(const FileSystemNode* parent, FileSystemNode* child);
+    void erase(const FileSystemNode* parent, const FileSystemNode* child);
+};
+
+// One step of a batch passed to FileSystem::apply
+struct BatchOperation {
+    enum Kind : uint8_t { MKDIR, TOUCH, RM };
+
+    Kind kind;
+    std::string path;
+    bool parents;                                       // mkdir creates missing parents
+
+    BatchOperation(Kind kind, const std::string& path, bool parents = false) : kind(kind), path(path), parents(parents) {}
+};
+
+// Result of FileSystem::du: totals for a path and everything below it, the path included
+struct DiskUsage {
+    uint64_t files;
+    uint64_t directories;
+    uint64_t bytes;
+};
+
+// Result of FileSystem::stat
+struct FileStat {
+    std::string name;
+    std::string path;
+    bool isDirectory;
+    size_t entries;                                     // Number of children for directories
+    uint64_t size;                                      // Bytes in a file
+};
+
+// Receives ls/tree output in chunks; returning false stops the listing early
+typedef std::function<bool(const char* data, size_t length)> OutputSink;
+
+// Depth limit and paging for the streaming ls/tree
+struct ListOptions {
+    size_t maxDepth;                                    // tree levels shown below the root, SIZE_MAX for all
+    size_t offset;                                      // Entries skipped before output starts
+    size_t limit;                                       // Entries written at most, SIZE_MAX for all
+
+    ListOptions() : maxDepth(SIZE_MAX), offset(0), limit(SIZE_MAX) {}
+};
+
+// What a WalkVisitor wants done after seeing a node
+enum class WalkAction : uint8_t {
+    CONTINUE,                                           // Visit the node's children too
+    PRUNE,                                              // Skip everything below the node
+    STOP                                                // End the walk; other workers stop at their next node
+};
+
+// A node reached by FileSystem::traverse
+struct WalkEntry {
+    FileSystemNode* node;
+    size_t depth;                                       // 0 for the node the walk starts at
+    size_t worker;                                      // Thread calling the visitor, numbered from 0
+    size_t strand;                                      // Piece of the walk the node belongs to, see WalkOptions
+};
+
+// Called for every node reached, from several threads at once
+typedef std::function<WalkAction(const WalkEntry& entry)> WalkVisitor;
+
+// Called on a worker that has handed the rest of a directory's children to another worker,
+// at the place in its strand where they would have been visited
+typedef std::function<void(size_t worker, size_t strand, size_t handedOver)> WalkSplitHandler;
+
+// Threads and depth for FileSystem::traverse. Each strand is walked by one worker in preorder;
+// strand 0 begins at the start node, and every strand handed over begins where onSplit said.
+// Reading the strands with each split replaced by its strand gives the sequential preorder.
+struct WalkOptions {
+    size_t threads;                                     // Workers at most, 0 for one per hardware thread
+    size_t maxDepth;                                    // Levels below the start node that are visited
+    WalkSplitHandler onSplit;                           // Optional
+
+    WalkOptions() : threads(0), maxDepth(SIZE_MAX) {}
+};
+
+// Read-only point-in-time view of a FileSystem, taken in O(1) by FileSystem::snapshot while
+// another snapshot is alive. It stays valid and unchanged while the live tree is modified or
+// destroyed.
+class FileSystemSnapshot {
+private:
+    std::shared_ptr<const SnapshotNode> root;
+    uint64_t snapshotVersion;
+    std::shared_ptr<const void> pin;                    // Keeps the FileSystem maintaining its shared tree
+
+    const SnapshotNode* resolveDirectory(const std::string& path) const;
+
+public:
+    FileSystemSnapshot(std::shared_ptr<const SnapshotNode> root, uint64_t version, std::shared_ptr<const void> pin = nullptr);
+
+    uint64_t version() const { return snapshotVersion; }
+    std::string ls(const std::string& path = "/") const;
+    std::string tree() const;
+    std::vector<std::string> find(const std::string& name) const;  // Paths of all matches in tree order
+};
+
+// On-disk image written by FileSystem::save, in native byte order. After the header come, in
+// this order: nodeCount ImageNodes in breadth-first order with the root first, so every
+// directory's children are one contiguous range; nodeCount uint32 sortedChildren, which
+// holds each directory's child range again sorted by (name, type); nodeCount uint32 byName,
+// every node sorted by (name, position); the name heap; the file contents, holes as zeros.
+struct ImageHeader {
+    char magic[8];                                      // IMAGE_MAGIC
+    uint32_t version;
+    uint32_t nodeCount;
+    uint64_t nameHeapSize;
+    uint64_t dataSize;
+};
+
+struct ImageNode {
+    uint32_t name;                                      // Offset in the name heap
+    uint32_t nameLength;
+    uint32_t parent;                                    // Position of the parent, 0 for the root
+    uint32_t firstChild;                                // Children are [firstChild, firstChild + childCount)
+    uint32_t childCount;
+    uint32_t isDirectory;
+    uint64_t data;                                      // Offset of the contents in the data section
+    uint64_t size;
+};
+
+// Read-only file system served straight from an image written by FileSystem::save. The image
+// is mmapped and nothing is allocated per node, so opening one takes the same time at any
+// size. Nodes are checked as they are reached, so a damaged image throws rather than
+// reading out of bounds.
+class FileSystemImage {
+private:
+    const char* base;                                   // The whole mapped file
+    size_t length;
+    uint32_t nodeCount;
+    const ImageNode* nodes;                             // Breadth-first, root first
+    const uint32_t* sortedChildren;                     // Each directory's child range sorted by (name, type)
+    const uint32_t* byName;                             // Every node sorted by (name, position)
+    const char* nameHeap;
+    uint64_t nameHeapSize;
+    const char* data;                                   // File contents
+    uint64_t dataSize;
+    uint32_t cwd;
+    std::string cwdPath;
+
+    friend class FileSystem;
+
+    const ImageNode& nodeAt(uint32_t index) const;
+    std::string_view nameOf(const ImageNode& node) const { return std::string_view(nameHeap + node.name, node.nameLength); }
+    uint32_t lookup(uint32_t dir, std::string_view name, bool isDir) const;
+    std::string pathOf(uint32_t index) const;
+
+public:
+    explicit FileSystemImage(const std::string& path);
+    ~FileSystemImage();
+
+    FileSystemImage(const FileSystemImage&) = delete;
+    FileSystemImage& operator=(const FileSystemImage&) = delete;
+
+    size_t size() const { return nodeCount; }
+    std::string ls() const;
+    size_t ls(const OutputSink& sink, const ListOptions& options = ListOptions()) const;
+    void cd(const std::string& path);
+    std::string pwd() const { return cwdPath; }
+    std::vector<std::string> find(const std::string& name) const;  // Paths of all matches in breadth-first order
+    std::string tree() const;
+    size_t tree(const OutputSink& sink, const ListOptions& options = ListOptions()) const;
+};
+
+// Progress of the background reclaimer that frees subtrees unlinked by rm
+struct ReclaimStats {
+    size_t pendingSubtrees;                             // Unlinked but not yet completely freed
+    size_t pendingNodes;                                // Found in those subtrees so far and not yet freed
+    size_t reclaimedSubtrees;
+    size_t reclaimedNodes;
 };
 
+class FileSystem;
+class BatchPlan;
+
+// One user's handle on a FileSystem, with its own current directory. Sessions of the same
+// FileSystem may run on different threads at once; a single session is used by one thread
+// at a time. Sessions must be closed before their FileSystem is destroyed.
+class FileSystemSession {
+private:
+    FileSystem& fs;
+    std::atomic<FileSystemNode*> cwd;
+    std::atomic<uint64_t> activeEpoch;                  // Reclaim epoch when the running operation began, 0 when idle
+    std::string cwdPath;                                // pwd of cwd, kept up to date by cd
+    std::vector<uint32_t> cwdStarts;                    // Where each component of cwdPath begins, for ".."
+
+    friend class FileSystem;
+    friend class BatchPlan;
+
+public:
+    explicit FileSystemSession(FileSystem& fs);
+    ~FileSystemSession();
+
+    FileSystemSession(const FileSystemSession&) = delete;
+    FileSystemSession& operator=(const FileSystemSession&) = delete;
+
+    void mkdir(const std::string& path, bool parents = false);
+    void touch(const std::string& path);
+    std::string ls();
+    size_t ls(const OutputSink& sink, const ListOptions& options = ListOptions());
+    void cd(const std::string& path);
+    void rm(const std::string& path);
+    FileStat stat(const std::string& path);
+    DiskUsage du(const std::string& path);
+    std::string pwd();
+    size_t pwd(char* buffer, size_t size);
+    std::vector<std::string> find(const std::string& name);     // Paths of all nodes with that name
+    size_t write(const std::string& path, uint64_t offset, const char* data, size_t length);
+    size_t append(const std::string& path, const char* data, size_t length);
+    size_t read(const std::string& path, uint64_t offset, char* buffer, size_t length);
+    void truncate(const std::string& path, uint64_t size);
+    std::string tree();
+    size_t tree(const OutputSink& sink, const ListOptions& options = ListOptions());
+    void apply(const std::vector<BatchOperation>& batch);
+    size_t traverse(const std::string& path, const WalkVisitor& visitor, const WalkOptions& options = WalkOptions());
+    std::vector<std::string> findIn(const std::string& path, const std::string& pattern, size_t threads = 0);
+    DiskUsage countIn(const std::string& path, const std::string& pattern, size_t threads = 0);
+    size_t exportTree(const std::string& path, const OutputSink& sink, const ListOptions& options = ListOptions(), size_t threads = 0);
+};
+
+// Orders the name index by (name, id). Lookups can pass a (name, id) pair instead of a node.
+struct NameOrder {
+    typedef void is_transparent;
+
+    typedef std::pair<std::string_view, uint64_t> Key;
+
+    static Key keyOf(const FileSystemNode* node) { return Key(node->name, node->id); }
+
+    bool operator()(const FileSystemNode* a, const FileSystemNode* b) const { return keyOf(a) < keyOf(b); }
+    bool operator()(const FileSystemNode* a, const Key& b) const { return keyOf(a) < b; }
+    bool operator()(const Key& a, const FileSystemNode* b) const { return a < keyOf(b); }
+};
+
+// In-memory file system. Every operation is thread-safe: directories carry reader/writer
+// locks taken hand over hand (lock coupling) while paths are walked, so operations in
+// different parts of the tree run in parallel. rm only unlinks; a background reclaimer frees
+// the subtree once every operation that could still be inside it has finished.
+// The FileSystem's own mkdir/cd/... act through a built-in primary session; the raw
+// FileSystemNode pointers returned by find/findAll/findPrefix/glob are only safe to use
+// while no other session is removing nodes.
 class FileSystem {
 private:
+    NameTable names;
+    NodePool nodes;
     FileSystemNode* root;
-    FileSystemNode* currentDirectory;
+    std::atomic<uint64_t> nextNodeId;
+    DentryCache dentries;
+    std::set<FileSystemNode*, NameOrder> nameIndex;     // Sorted by (name, id) for prefix search
+    BlockStore blocks;
+    std::atomic<uint64_t> snapshotEpoch;                // 0 while there is no shared tree to keep up
+    std::vector<std::shared_ptr<SnapshotNode>> shadows; // Each node's place in the shared tree, by pool index
+    std::weak_ptr<const void> snapshotPin;              // Held by every live snapshot
+    uint64_t lastSnapshotEpoch;                         // Epoch of the last shared tree dropped, so versions keep rising
+
+    // Lock order: structureLock, node locks (ancestors before descendants), detachLock,
+    // then any one of indexLock, blocksLock, snapshotLock, sessionsLock, reclaimLock and dentry shards.
+    std::shared_mutex structureLock;                    // Shared by mutations, exclusive while the shared tree is built
+    std::shared_mutex detachLock;                       // Exclusive while rm unlinks, shared while a session changes cwd
+                                                        // or usage is added up the parent chain
+    std::shared_mutex indexLock;                        // nameIndex
+    std::mutex blocksLock;                              // blocks
+    std::mutex snapshotLock;                            // shadows, and slots while snapshots are in use
+    std::mutex sessionsLock;                            // sessions
+    std::mutex reclaimLock;                             // reclaimQueue, reclaimer and stopReclaimer
+
+    std::vector<FileSystemSession*> sessions;
+    std::atomic<uint64_t> reclaimEpoch;
+    std::atomic<uint64_t> detachCount;                  // Subtrees unlinked by rm so far
+    FileSystemSession* primary;                         // Session behind the single-user API
+    int journal;                                        // Append-only batch journal, -1 if none is open
+
+    struct PendingSubtree {
+        FileSystemNode* node;
+        uint64_t epoch;                                 // reclaimEpoch once it was unlinked
+    };
+
+    std::deque<PendingSubtree> reclaimQueue;
+    std::condition_variable reclaimReady;               // Work was queued or the reclaimer should stop
+    std::condition_variable reclaimDone;                // A subtree was completely freed
+    std::thread reclaimer;                              // Started by the first rm
+    bool stopReclaimer;
+    std::atomic<size_t> pendingSubtrees;
+    std::atomic<size_t> pendingNodes;
+    std::atomic<size_t> reclaimedSubtrees;
+    std::atomic<size_t> reclaimedNodes;
+
+    static const size_t DENTRY_CACHE_SIZE = 65536;
+    static constexpr size_t RECLAIM_BATCH = 4096;       // Nodes handled per lock acquisition while reclaiming
+    static constexpr size_t PARALLEL_RECLAIM_FANOUT = 1024; // Children above which a subtree is freed by several threads
+    static constexpr size_t MAX_RECLAIM_WORKERS = 4;
+    static constexpr size_t PARALLEL_WALK_NODES = 4096; // Smaller subtrees are walked by the calling thread alone
+
+    friend class FileSystemSession;
+    friend class BatchPlan;
+
+    void registerSession(FileSystemSession* session);
+    void unregisterSession(FileSystemSession* session);
+    void retire(FileSystemSession& session, std::span<FileSystemNode* const> subtrees);
+    void reclaimLoop();
+    bool operationsBefore(uint64_t epoch);
+    void reclaimSubtree(FileSystemNode* node);
+    void reclaimSubtrees(const std::vector<FileSystemNode*>& roots);
+    void unindexNodes(std::span<FileSystemNode* const> batch);
+    void releaseNodes(std::span<FileSystemNode* const> batch);
+    bool isVisible(FileSystemNode* node) {              // For nodes found in the name index
+        return node == root || (node->parent != NodePool::NO_NODE && (pendingSubtrees == 0 || isAttached(node)));
+    }
+    void destroySubtree(FileSystemNode* node);
+    void releaseBlocks(FileContents* contents, size_t firstBlock);
+    size_t writeContents(FileSystemNode* file, uint64_t offset, const char* data, size_t length);
+    std::vector<std::span<const char>> viewContents(FileSystemNode* file, uint64_t offset, size_t length);
 
-    FileSystemNode* findNode(FileSystemNode* startNode, const std::string& name);
-    std::string displayTree(FileSystemNode* node, std::string indent);
+    FileSystemNode* createNode(FileSystemNode* dir, std::string_view name, bool isDir, bool bulk = false);
+    void addUsage(FileSystemNode* dir, int64_t files, int64_t directories, int64_t bytes);
+    DiskUsage usageOf(const FileSystemNode* node) const;
+    void resize(FileSystemNode* file, uint64_t size);
+    FileSystemNode* parentOf(const FileSystemNode* node) const {
+        uint32_t parent = node->parent;
+        return parent != NodePool::NO_NODE ? nodes.at(parent) : nullptr;
+    }
+    FileSystemNode* lookup(FileSystemNode* dir, std::string_view name, bool isDir);
+    FileSystemNode* lookupAny(FileSystemNode* dir, std::string_view name);
+    FileSystemNode* startOf(FileSystemSession& session, const std::string& path);
+    FileSystemNode* walk(FileSystemNode* dir, const std::vector<std::string>& parts, size_t count, bool createMissing, bool exclusive);
+    FileSystemNode* resolve(FileSystemSession& session, const std::string& path);
+    FileSystemNode* resolveFile(FileSystemSession& session, const std::string& path, bool exclusive);
+    bool isAttached(FileSystemNode* node);
+    std::string pathOf(FileSystemNode* node);
+
+    void mkdir(FileSystemSession& session, const std::string& path, bool parents);
+    void touch(FileSystemSession& session, const std::string& path);
+    size_t ls(FileSystemSession& session, const OutputSink& sink, const ListOptions& options);
+    void cd(FileSystemSession& session, const std::string& path);
+    void rm(FileSystemSession& session, const std::string& path);
+    FileStat stat(FileSystemSession& session, const std::string& path);
+    DiskUsage du(FileSystemSession& session, const std::string& path);
+    std::string pwd(FileSystemSession& session);
+    size_t pwd(FileSystemSession& session, char* buffer, size_t size);
+    size_t write(FileSystemSession& session, const std::string& path, uint64_t offset, const char* data, size_t length);
+    size_t append(FileSystemSession& session, const std::string& path, const char* data, size_t length);
+    size_t read(FileSystemSession& session, const std::string& path, uint64_t offset, char* buffer, size_t length);
+    std::vector<std::span<const char>> readView(FileSystemSession& session, const std::string& path, uint64_t offset, size_t length);
+    void truncate(FileSystemSession& session, const std::string& path, uint64_t size);
+    size_t tree(FileSystemSession& session, const OutputSink& sink, const ListOptions& options);
+    size_t traverse(FileSystemSession& session, const std::string& path, const WalkVisitor& visitor, const WalkOptions& options);
+    std::vector<std::string> findIn(FileSystemSession& session, const std::string& path, const std::string& pattern, size_t threads);
+    DiskUsage countIn(FileSystemSession& session, const std::string& path, const std::string& pattern, size_t threads);
+    size_t exportTree(FileSystemSession& session, const std::string& path, const OutputSink& sink, const ListOptions& options, size_t threads);
+    void apply(FileSystemSession& session, const std::vector<BatchOperation>& batch, bool logged);
+    void appendJournal(FileSystemSession& session, const std::vector<BatchOperation>& batch);
+
+    std::shared_ptr<SnapshotNode>& shadowOf(const FileSystemNode* node) { return shadows[node->self]; }
+    void buildShadows();
+    void dropUnusedShadows();
+    SnapshotNode* writableShadow(FileSystemNode* node);
+    void shadowAdd(FileSystemNode* dir, FileSystemNode* child);
+    void shadowRemove(FileSystemNode* dir, size_t slot, bool compacted);
 
 public:
     FileSystem();
     ~FileSystem();
 
-    void mkdir(const std::string& name);
-    void touch(const std::string& name);
+    void mkdir(const std::string& path, bool parents = false);
+    void touch(const std::string& path);
     std::string ls();
+    size_t ls(const OutputSink& sink, const ListOptions& options = ListOptions());
+    size_t ls(std::ostream& out, const ListOptions& options = ListOptions());
     void cd(const std::string& path);
-    void rm(const std::string& name);
+    void rm(const std::string& path);
+    FileStat stat(const std::string& path);
+    DiskUsage du(const std::string& path);              // O(1) once the path is resolved
     std::string pwd();
+    size_t pwd(char* buffer, size_t size);              // Copies the path if it fits; returns its length
     FileSystemNode* find(const std::string& name);
+    std::vector<FileSystemNode*> findAll(const std::string& name);
+    std::vector<FileSystemNode*> findPrefix(const std::string& prefix);
+    std::vector<FileSystemNode*> glob(const std::string& pattern);
+    size_t write(const std::string& path, uint64_t offset, const char* data, size_t length);
+    size_t append(const std::string& path, const char* data, size_t length);
+    size_t read(const std::string& path, uint64_t offset, char* buffer, size_t length);
+    std::vector<std::span<const char>> readView(const std::string& path, uint64_t offset, size_t length);
+    void truncate(const std::string& path, uint64_t size);
+
     std::string tree();
+    size_t tree(const OutputSink& sink, const ListOptions& options = ListOptions());
+    size_t tree(std::ostream& out, const ListOptions& options = ListOptions());
+
+    // Parallel walks of the subtree at path, split between threads by work stealing
+    size_t traverse(const std::string& path, const WalkVisitor& visitor, const WalkOptions& options = WalkOptions());
+    std::vector<std::string> findIn(const std::string& path, const std::string& pattern, size_t threads = 0);  // Sorted paths matching a '*'/'?' pattern
+    DiskUsage countIn(const std::string& path, const std::string& pattern, size_t threads = 0);  // Matching files, directories and file bytes
+    size_t exportTree(const std::string& path, const OutputSink& sink, const ListOptions& options = ListOptions(), size_t threads = 0);
+
+    FileSystemSnapshot snapshot();
+
+    void save(const std::string& path);                 // Writes an image for load or FileSystemImage
+    void apply(const std::vector<BatchOperation>& batch);   // All or nothing if any step is invalid, journaled if a journal is open
+    void openJournal(const std::string& path);
+    size_t replayJournal(const std::string& path);      // Returns the number of batches applied
+    void load(const std::string& path);                 // Fills an empty file system from an image
+
+    ReclaimStats reclaimStats();
+    void waitForReclaim();                              // Blocks until every removed subtree has been freed
+
+    FileSystemSession& primarySession() { return *primary; }
 };
 
 #endif // FILESYSTEM_HPP
\ No newline at end of file
@@ -0,0 +1,657 @@
+// FileSystemBench.cpp
+// Populates one directory with many entries and removes them again.
+#include "FileSystem.hpp"
+#include <chrono>
+#include <random>
+#include <vector>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <fstream>
+#include <cstdio>
+#include <unistd.h>
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void benchWideDirectory(long entries) {
+    FileSystem fs;
+    fs.mkdir("wide");
+    fs.cd("wide");
+
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < entries; i++) {
+        if (i % 2 == 0) {
+            fs.touch("entry" + std::to_string(i));
+        } else {
+            fs.mkdir("entry" + std::to_string(i));
+        }
+    }
+    double createTime = secondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    for (long i = 0; i < entries; i += 2) {                                                         // Lookups of existing children
+        fs.cd("entry" + std::to_string(i + 1));
+        fs.cd("..");
+    }
+    double lookupTime = secondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    size_t listed = fs.ls().size();
+    double lsTime = secondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    for (long i = entries - 1; i >= 0; i -= 2) {                                                    // Remove odd entries back to front,
+        fs.rm("entry" + std::to_string(i));
+    }
+    for (long i = 0; i < entries; i += 2) {                                                         // then even entries front to back
+        fs.rm("entry" + std::to_string(i));
+    }
+    double removeTime = secondsSince(start);
+
+    std::cout << "wide directory, " << entries << " entries\n";
+    std::cout << "  create: " << createTime << " s (" << createTime * 1e9 / entries << " ns/op)\n";
+    std::cout << "  cd:     " << lookupTime << " s (" << lookupTime * 1e9 / (entries / 2 + 1) << " ns/op)\n";
+    std::cout << "  ls:     " << lsTime << " s (" << listed << " bytes)\n";
+    std::cout << "  rm:     " << removeTime << " s (" << removeTime * 1e9 / entries << " ns/op)\n";
+}
+
+static void benchDeepPaths(int depth, long lookups) {
+    FileSystem fs;
+    std::string path;
+    for (int i = 0; i < depth; i++) {
+        path += "/level" + std::to_string(i);
+    }
+    fs.mkdir(path, true);
+
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < lookups; i++) {
+        fs.cd(path);
+        fs.cd("/");
+    }
+    double cdTime = secondsSince(start);
+
+    std::cout << "deep path, " << depth << " components\n";
+    std::cout << "  cd:     " << cdTime << " s (" << cdTime * 1e9 / lookups << " ns/op)\n";
+}
+
+// pwd after every cd, like a shell prompt, down to depth levels; then repeated pwd at the bottom
+static void benchPwd(int depth, long calls) {
+    FileSystem fs;
+    size_t total = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < depth; i++) {
+        fs.mkdir("level");
+        fs.cd("level");
+        total += fs.pwd().size();
+    }
+    double descendTime = secondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    for (long i = 0; i < calls; i++) {
+        total += fs.pwd().size();
+    }
+    double pwdTime = secondsSince(start);
+
+    std::vector<char> buffer(fs.pwd().size() + 1);
+    start = std::chrono::steady_clock::now();
+    for (long i = 0; i < calls; i++) {
+        total += fs.pwd(buffer.data(), buffer.size());
+    }
+    double bufferTime = secondsSince(start);
+
+    fs.touch("leaf");
+    start = std::chrono::steady_clock::now();
+    for (long i = 0; i < calls / 10; i++) {
+        total += fs.stat("leaf").path.size();                                                      // Path built from the node
+    }
+    double statTime = secondsSince(start);
+
+    std::cout << "pwd, depth " << depth << " (" << total << " bytes)\n";
+    std::cout << "  mkdir+cd+pwd per level: " << descendTime * 1e9 / depth << " ns\n";
+    std::cout << "  pwd at the bottom:      " << pwdTime * 1e9 / calls << " ns/op\n";
+    std::cout << "  pwd into a buffer:      " << bufferTime * 1e9 / calls << " ns/op\n";
+    std::cout << "  stat path at the bottom: " << statTime * 1e9 / (calls / 10) << " ns/op\n";
+}
+
+static void benchFind(long nodes) {
+    FileSystem fs;
+    long created = 0;
+    for (long d = 0; created < nodes; d++) {                                                        // 100 files in each directory
+        std::string dir = "/dir" + std::to_string(d);
+        fs.mkdir(dir);
+        created++;
+        for (int f = 0; f < 100 && created < nodes; f++, created++) {
+            fs.touch(dir + "/file" + std::to_string(f));
+        }
+    }
+
+    const long lookups = 10000;
+    size_t matches = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < lookups; i++) {
+        matches += (fs.find("dir" + std::to_string(i % 1000)) != nullptr);
+    }
+    double findTime = secondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    size_t all = fs.findAll("file42").size();
+    double findAllTime = secondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    size_t prefixed = fs.findPrefix("dir99").size();
+    double prefixTime = secondsSince(start);
+
+    std::cout << "find, " << created << " nodes\n";
+    std::cout << "  find:       " << findTime * 1e9 / lookups << " ns/op (" << matches << " hits)\n";
+    std::cout << "  findAll:    " << findAllTime << " s (" << all << " matches)\n";
+    std::cout << "  findPrefix: " << prefixTime << " s (" << prefixed << " matches)\n";
+}
+
+static void benchTree(long nodes) {
+    FileSystem fs;
+    long created = 0;
+    for (long d = 0; created < nodes; d++) {                                                        // Three levels: /dN/sM/fK
+        std::string dir = "/d" + std::to_string(d);
+        fs.mkdir(dir);
+        created++;
+        for (int sub = 0; sub < 10 && created < nodes; sub++) {
+            std::string subdir = dir + "/s" + std::to_string(sub);
+            fs.mkdir(subdir);
+            created++;
+            for (int f = 0; f < 99 && created < nodes; f++, created++) {
+                fs.touch(subdir + "/f" + std::to_string(f));
+            }
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    size_t bytes = fs.tree().size();
+    double stringTime = secondsSince(start);
+
+    size_t streamed = 0;
+    start = std::chrono::steady_clock::now();
+    size_t entries = fs.tree([&streamed](const char*, size_t length) {
+        streamed += length;
+        return true;
+    });
+    double streamTime = secondsSince(start);
+
+    ListOptions page;
+    page.offset = nodes / 2;
+    page.limit = 100;
+    start = std::chrono::steady_clock::now();
+    fs.tree([](const char*, size_t) { return true; }, page);
+    double pageTime = secondsSince(start);
+
+    std::cout << "tree, " << created << " nodes\n";
+    std::cout << "  tree() string: " << stringTime << " s (" << bytes << " bytes)\n";
+    std::cout << "  tree(sink):    " << streamTime << " s (" << entries << " entries, " << streamed << " bytes)\n";
+    std::cout << "  middle page:   " << pageTime << " s\n";
+
+    FileSystem deep;                                                                                // Too deep for a recursive walk
+    std::string path;
+    for (int i = 0; i < 50000; i++) {
+        path += "/d";
+    }
+    deep.mkdir(path, true);
+    start = std::chrono::steady_clock::now();
+    entries = deep.tree([](const char*, size_t) { return true; });
+    std::cout << "  deep tree:     " << secondsSince(start) << " s (" << entries << " entries)\n";
+}
+
+static void benchSnapshots(long nodes) {
+    FileSystem plain;
+    FileSystem snapshotted;
+    FileSystemSnapshot first = snapshotted.snapshot();                                              // Builds the shared tree up front
+    FileSystem dropped;
+    dropped.snapshot();                                                                             // Gone at once, so upkeep stops
+
+    auto populate = [nodes](FileSystem& fs, bool takeSnapshots) {
+        std::vector<FileSystemSnapshot> kept;
+        for (long i = 0; i < nodes; i++) {
+            if (i % 100 == 0) {
+                fs.mkdir("/d" + std::to_string(i / 100) + "/sub", true);
+            }
+            fs.touch("/d" + std::to_string(i / 100) + "/sub/f" + std::to_string(i % 100));
+            if (takeSnapshots && i % 1000 == 0) {
+                kept.push_back(fs.snapshot());
+            }
+        }
+        return kept.size();
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    populate(plain, false);
+    double plainTime = secondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    size_t taken = populate(snapshotted, true);
+    double snapshotTime = secondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    populate(dropped, false);
+    double droppedTime = secondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    FileSystemSnapshot view = snapshotted.snapshot();
+    double takeTime = secondsSince(start);
+
+    std::cout << "snapshots, " << nodes << " files\n";
+    std::cout << "  populate, no snapshots:       " << plainTime * 1e9 / nodes << " ns/file\n";
+    std::cout << "  populate, " << taken << " live snapshots: " << snapshotTime * 1e9 / nodes << " ns/file\n";
+    std::cout << "  populate, snapshot dropped:   " << droppedTime * 1e9 / nodes << " ns/file\n";
+    std::cout << "  snapshot():                   " << takeTime * 1e9 << " ns\n";
+}
+
+static void benchFileIO(long megabytes) {
+    FileSystem fs;
+    fs.touch("/data.bin");
+    const size_t chunk = 1 << 20;                                                                   // 1 MB sequential requests
+    const size_t small = 4096;                                                                      // 4 KB random requests
+    uint64_t total = static_cast<uint64_t>(megabytes) << 20;
+    std::vector<char> buffer(chunk, 'x');
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t offset = 0; offset < total; offset += chunk) {
+        fs.write("/data.bin", offset, buffer.data(), chunk);
+    }
+    double writeTime = secondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    for (uint64_t offset = 0; offset < total; offset += chunk) {
+        fs.read("/data.bin", offset, buffer.data(), chunk);
+    }
+    double readTime = secondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    size_t viewed = 0;
+    for (uint64_t offset = 0; offset < total; offset += chunk) {
+        for (auto view : fs.readView("/data.bin", offset, chunk)) {
+            viewed += view.size();
+        }
+    }
+    double viewTime = secondsSince(start);
+
+    std::mt19937_64 random(42);
+    long requests = static_cast<long>(total / small / 4);
+    start = std::chrono::steady_clock::now();
+    for (long i = 0; i < requests; i++) {
+        fs.read("/data.bin", (random() % (total / small)) * small, buffer.data(), small);
+    }
+    double randomReadTime = secondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    for (long i = 0; i < requests; i++) {
+        fs.write("/data.bin", (random() % (total / small)) * small, buffer.data(), small);
+    }
+    double randomWriteTime = secondsSince(start);
+
+    double mb = static_cast<double>(megabytes);
+    double randomMb = requests * small / double(1 << 20);
+    std::cout << "file I/O, " << megabytes << " MB\n";
+    std::cout << "  sequential write: " << mb / writeTime << " MB/s\n";
+    std::cout << "  sequential read:  " << mb / readTime << " MB/s\n";
+    std::cout << "  sequential view:  " << mb / viewTime << " MB/s (" << viewed << " bytes, no copy)\n";
+    std::cout << "  random 4K read:   " << randomMb / randomReadTime << " MB/s\n";
+    std::cout << "  random 4K write:  " << randomMb / randomWriteTime << " MB/s\n";
+}
+
+// Resident set size of the process, from /proc (Linux only; 0 elsewhere)
+static size_t residentBytes() {
+    std::ifstream statm("/proc/self/statm");
+    size_t pages = 0;
+    size_t resident = 0;
+    statm >> pages >> resident;
+    return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+// Memory cost of an entry: the RSS a tree of small directories grows by, divided by its nodes.
+// Half the names fit std::string's inline buffer, half do not.
+static void benchMemory(long nodes) {
+    size_t before = residentBytes();
+    auto start = std::chrono::steady_clock::now();
+    long created = 0;
+    {
+        FileSystem fs;
+        for (long d = 0; created < nodes; d++) {                                                    // 64 files in each directory
+            std::string dir = "/project" + std::to_string(d);
+            fs.mkdir(dir);
+            created++;
+            for (int f = 0; f < 64 && created < nodes; f++, created++) {
+                fs.touch(dir + (f % 2 == 0 ? "/f" : "/generated_source_file_") + std::to_string(f));
+            }
+        }
+        double createTime = secondsSince(start);
+        size_t after = residentBytes();
+
+        std::cout << "memory, " << created << " nodes\n";
+        std::cout << "  sizeof(FileSystemNode): " << sizeof(FileSystemNode) << " bytes\n";
+        std::cout << "  resident per entry:     " << double(after - before) / created << " bytes\n";
+        std::cout << "  create:                 " << createTime * 1e9 / created << " ns/entry\n";
+        start = std::chrono::steady_clock::now();
+    }
+    std::cout << "  destroy:                " << secondsSince(start) * 1e9 / created << " ns/entry\n";
+}
+
+// Mixed workload from several sessions at once: mostly path lookups and listings across a
+// shared tree, plus creates/removes and small file writes in each thread's own directory
+static void benchSessions(long operations) {
+    const int shared = 64;
+    FileSystem fs;
+    for (int d = 0; d < shared; d++) {
+        std::string dir = "/shared/d" + std::to_string(d);
+        fs.mkdir(dir + "/sub", true);
+        for (int f = 0; f < 16; f++) {
+            fs.touch(dir + "/sub/f" + std::to_string(f));
+        }
+    }
+
+    std::cout << "sessions, mixed workload, " << operations << " ops per run (" << std::thread::hardware_concurrency() << " hardware threads)\n";
+    for (int threads = 1; threads <= 8; threads *= 2) {
+        std::vector<std::thread> workers;
+        auto start = std::chrono::steady_clock::now();
+        for (int t = 0; t < threads; t++) {
+            workers.push_back(std::thread([&fs, operations, threads, t]() {
+                FileSystemSession session(fs);
+                std::string home = "/home" + std::to_string(threads) + "_" + std::to_string(t);
+                session.mkdir(home, true);
+                session.touch(home + "/log");
+                std::mt19937 random(t);
+                char buffer[64] = {};
+                for (long i = t; i < operations; i += threads) {
+                    int kind = random() % 100;
+                    std::string dir = "/shared/d" + std::to_string(random() % shared) + "/sub";
+                    if (kind < 50) {
+                        session.stat(dir + "/f" + std::to_string(random() % 16));
+                    } else if (kind < 70) {
+                        session.cd(dir);
+                        session.ls();
+                    } else if (kind < 80) {
+                        session.read(dir + "/f0", 0, buffer, sizeof(buffer));
+                    } else if (kind < 90) {
+                        std::string name = home + "/n" + std::to_string(i);
+                        session.touch(name);
+                        session.rm(name);
+                    } else {
+                        session.append(home + "/log", buffer, sizeof(buffer));
+                    }
+                }
+            }));
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        double elapsed = secondsSince(start);
+        std::cout << "  " << threads << " thread(s): " << operations / elapsed / 1e6 << " Mops/s\n";
+    }
+}
+
+// rm of a wide and of a deep directory: time until rm returns, then until the reclaimer is done
+static void benchReclaim(long entries, int depth) {
+    FileSystem fs;
+    fs.mkdir("/wide");
+    fs.cd("/wide");
+    for (long i = 0; i < entries; i++) {
+        fs.touch("f" + std::to_string(i));
+    }
+    fs.mkdir("/deep");
+    fs.cd("/deep");
+    for (int i = 0; i < depth; i++) {
+        fs.mkdir("d");
+        fs.cd("d");
+    }
+    fs.cd("/");
+
+    std::cout << "reclaim, " << entries << " wide, " << depth << " deep\n";
+    for (const char* path : {"/wide", "/deep"}) {
+        auto start = std::chrono::steady_clock::now();
+        fs.rm(path);
+        double removeTime = secondsSince(start);
+        ReclaimStats pending = fs.reclaimStats();
+        fs.waitForReclaim();
+        double reclaimTime = secondsSince(start);
+        std::cout << "  rm " << path << ": " << removeTime * 1e6 << " us, freed after " << reclaimTime << " s ("
+                  << fs.reclaimStats().reclaimedNodes << " nodes reclaimed, " << pending.pendingSubtrees << " pending at return)\n";
+    }
+}
+
+// Startup from an image: rebuilding through mkdir/touch vs load vs opening the image read-only
+static void benchImages(long entries) {
+    const std::string file = "filesystem_bench.img";
+    const long perDirectory = 1000;
+    FileSystem fs;
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < entries; i++) {
+        if (i % perDirectory == 0) {
+            fs.mkdir("/d" + std::to_string(i / perDirectory));
+            fs.cd("/d" + std::to_string(i / perDirectory));
+        }
+        fs.touch("f" + std::to_string(i));
+    }
+    double buildTime = secondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    fs.save(file);
+    double saveTime = secondsSince(start);
+    std::ifstream saved(file, std::ios::binary | std::ios::ate);
+    long imageBytes = saved.tellg();
+
+    FileSystem loaded;
+    start = std::chrono::steady_clock::now();
+    loaded.load(file);
+    double loadTime = secondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    FileSystemImage image(file);
+    double openTime = secondsSince(start);
+
+    const long lookups = 100000;
+    start = std::chrono::steady_clock::now();
+    size_t listed = 0;
+    for (long i = 0; i < lookups; i++) {
+        image.cd("/d" + std::to_string(i % (entries / perDirectory)));
+        if (i % 1000 == 0) {
+            listed += image.ls().size();
+        }
+    }
+    double cdTime = secondsSince(start);
+    start = std::chrono::steady_clock::now();
+    size_t found = 0;
+    for (long i = 0; i < lookups; i++) {
+        found += image.find("f" + std::to_string(i % entries)).size();
+    }
+    double findTime = secondsSince(start);
+    std::remove(file.c_str());
+
+    std::cout << "images, " << entries << " entries (" << imageBytes / double(entries) << " bytes/entry)\n";
+    std::cout << "  mkdir/touch: " << buildTime << " s\n";
+    std::cout << "  save:        " << saveTime << " s\n";
+    std::cout << "  load:        " << loadTime << " s\n";
+    std::cout << "  mmap open:   " << openTime * 1e3 << " ms\n";
+    std::cout << "  image cd:    " << cdTime * 1e9 / lookups << " ns/op (" << listed << " bytes listed)\n";
+    std::cout << "  image find:  " << findTime * 1e9 / lookups << " ns/op (" << found << " found)\n";
+}
+
+// A change set of entries touches over 100 directories, then their removal: one call per
+// operation vs one batch, and the batch again with a journal
+static void benchBatches(long entries) {
+    const long directories = 100;
+    const std::string journal = "filesystem_bench.journal";
+    std::vector<BatchOperation> creates;
+    std::vector<BatchOperation> removes;
+    for (long d = 0; d < directories; d++) {
+        creates.emplace_back(BatchOperation::MKDIR, "/d" + std::to_string(d));
+    }
+    for (long i = 0; i < entries; i++) {
+        std::string path = "/d" + std::to_string(i % directories) + "/f" + std::to_string(i);
+        creates.emplace_back(BatchOperation::TOUCH, path);
+        removes.emplace_back(BatchOperation::RM, path);
+    }
+
+    FileSystem single;
+    auto start = std::chrono::steady_clock::now();
+    for (const BatchOperation& step : creates) {
+        if (step.kind == BatchOperation::MKDIR) {
+            single.mkdir(step.path);
+        } else {
+            single.touch(step.path);
+        }
+    }
+    double singleCreate = secondsSince(start);
+    start = std::chrono::steady_clock::now();
+    for (const BatchOperation& step : removes) {
+        single.rm(step.path);
+    }
+    double singleRemove = secondsSince(start);
+
+    std::cout << "batches, " << entries << " entries in " << directories << " directories\n";
+    std::cout << "  one by one: create " << singleCreate * 1e9 / entries << " ns/op, rm " << singleRemove * 1e9 / entries << " ns/op\n";
+    for (bool journaled : {false, true}) {
+        FileSystem batched;
+        if (journaled) {
+            std::remove(journal.c_str());
+            batched.openJournal(journal);
+        }
+        start = std::chrono::steady_clock::now();
+        batched.apply(creates);
+        double batchCreate = secondsSince(start);
+        start = std::chrono::steady_clock::now();
+        batched.apply(removes);
+        double batchRemove = secondsSince(start);
+        std::cout << (journaled ? "  journaled:  " : "  batch:      ") << "create " << batchCreate * 1e9 / entries
+                  << " ns/op, rm " << batchRemove * 1e9 / entries << " ns/op\n";
+        if (journaled) {
+            FileSystem replayed;
+            start = std::chrono::steady_clock::now();
+            replayed.replayJournal(journal);
+            std::cout << "  replay:     " << secondsSince(start) * 1e9 / entries << " ns/op\n";
+        }
+    }
+    std::remove(journal.c_str());
+}
+
+// du against counting by a full walk, on a tree of 100 x 100 directories holding the files
+static void benchUsage(long nodes) {
+    const long top = 100;
+    const long filesPerDir = std::max(1L, nodes / (top * top));
+    FileSystem fs;
+    auto start = std::chrono::steady_clock::now();
+    for (long p = 0; p < top; p++) {
+        std::vector<BatchOperation> batch;
+        for (long q = 0; q < top; q++) {
+            std::string dir = "/p" + std::to_string(p) + "/q" + std::to_string(q);
+            batch.emplace_back(BatchOperation::MKDIR, dir, true);
+            for (long f = 0; f < filesPerDir; f++) {
+                batch.emplace_back(BatchOperation::TOUCH, dir + "/f" + std::to_string(f));
+            }
+        }
+        fs.apply(batch);
+    }
+    double buildTime = secondsSince(start);
+    DiskUsage total = fs.du("/");
+
+    const long updates = 100000;                                                                    // Counter upkeep, three levels deep
+    start = std::chrono::steady_clock::now();
+    for (long i = 0; i < updates; i++) {
+        fs.touch("/p7/q7/extra" + std::to_string(i));
+    }
+    double touchTime = secondsSince(start);
+    start = std::chrono::steady_clock::now();
+    for (long i = 0; i < updates; i++) {
+        fs.append("/p7/q7/f0", "x", 1);
+    }
+    double appendTime = secondsSince(start);
+
+    const long queries = 1000000;
+    const char* paths[] = {"/", "/p42", "/p42/q42", "/p42/q42/f0"};
+    start = std::chrono::steady_clock::now();
+    size_t walked = fs.tree([](const char*, size_t) { return true; });                              // What counting took without the totals
+    double walkTime = secondsSince(start);
+    std::cout << "du, " << total.files + total.directories << " nodes (" << total.directories << " directories), built in " << buildTime << " s\n";
+    std::cout << "  touch: " << touchTime * 1e9 / updates << " ns/op, 1-byte append: " << appendTime * 1e9 / updates << " ns/op\n";
+    std::cout << "  counting by walking the tree: " << walkTime << " s (" << walked << " entries)\n";
+    for (const char* path : paths) {
+        uint64_t counted = 0;
+        start = std::chrono::steady_clock::now();
+        for (long i = 0; i < queries; i++) {
+            counted += fs.du(path).files;
+        }
+        std::cout << "  du " << path << ": " << secondsSince(start) * 1e9 / queries << " ns (" << counted / queries << " files)\n";
+    }
+}
+
+// Parallel walks at 1 to 8 threads against the sequential tree walk, on a tree of 100 x 100
+// directories holding the files
+static void benchWalk(long nodes) {
+    const long top = 100;
+    const long filesPerDir = std::max(1L, nodes / (top * top));
+    FileSystem fs;
+    for (long p = 0; p < top; p++) {
+        std::vector<BatchOperation> batch;
+        for (long q = 0; q < top; q++) {
+            std::string dir = "/p" + std::to_string(p) + "/q" + std::to_string(q);
+            batch.emplace_back(BatchOperation::MKDIR, dir, true);
+            for (long f = 0; f < filesPerDir; f++) {
+                batch.emplace_back(BatchOperation::TOUCH, dir + "/f" + std::to_string(f));
+            }
+        }
+        fs.apply(batch);
+    }
+    DiskUsage total = fs.du("/");
+    auto discard = [](const char*, size_t) { return true; };
+
+    auto start = std::chrono::steady_clock::now();
+    size_t walked = fs.tree(discard);
+    std::cout << "parallel walk, " << total.files + total.directories << " nodes, " << std::thread::hardware_concurrency()
+              << " hardware threads\n";
+    std::cout << "  sequential tree: " << secondsSince(start) << " s (" << walked << " entries)\n";
+    for (size_t threads : {1, 2, 4, 8}) {
+        WalkOptions options;
+        options.threads = threads;
+        std::atomic<size_t> splits(0);
+        options.onSplit = [&splits](size_t, size_t, size_t) { splits++; };
+        start = std::chrono::steady_clock::now();
+        size_t visited = fs.traverse("/", [](const WalkEntry&) { return WalkAction::CONTINUE; }, options);
+        double walkTime = secondsSince(start);
+
+        start = std::chrono::steady_clock::now();
+        size_t found = fs.findIn("/", "f42", threads).size();
+        double findTime = secondsSince(start);
+
+        start = std::chrono::steady_clock::now();
+        DiskUsage counted = fs.countIn("/", "q*", threads);
+        double countTime = secondsSince(start);
+
+        start = std::chrono::steady_clock::now();
+        size_t exported = fs.exportTree("/", discard, ListOptions(), threads);
+        double exportTime = secondsSince(start);
+
+        std::cout << "  " << threads << " threads: traverse " << walkTime << " s (" << visited << " nodes, " << splits
+                  << " splits), findIn " << findTime << " s (" << found << "), countIn " << countTime << " s ("
+                  << counted.directories << "), exportTree " << exportTime << " s (" << exported << ")\n";
+    }
+}
+
+int main(int argc, char* argv[]) {
+    long entries = (argc > 1) ? atol(argv[1]) : 1000000;
+    long megabytes = (argc > 2) ? atol(argv[2]) : 1024;
+    benchMemory(entries);                                                                           // First, before other benchmarks leave freed memory behind
+    benchWideDirectory(entries);
+    benchReclaim(entries, 100000);
+    benchDeepPaths(64, 100000);
+    benchPwd(10000, 10000);
+    benchFind(entries);
+    benchTree(entries);
+    benchSnapshots(entries);
+    benchImages(entries);
+    benchBatches(entries);
+    benchUsage(entries * 10);
+    benchWalk(entries * 10);
+    benchFileIO(megabytes);
+    benchSessions(entries);
+    return 0;
+}
@@ -0,0 +1,175 @@
+// FileSystemLoad.cpp
+// Load generator for the FileSystem server: several connections, each working in its own
+// directory and sending pipelined batches of mkdir, touch, rm, ls, pwd, cd and find, then
+// throughput and per-command latency percentiles. Runs a server in-process unless --socket
+// names one that is already running.
+//   filesystem_load [--socket path] [--workers n] [--connections n] [--depth n]
+//                   [--commands n] [--entries n]
+#include "FileSystemServer.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::string socket;
+    int workers = 2;
+    int connections = 4;
+    int depth = 16;
+    int commands = 100000;                              // Per connection
+    size_t entries = 256;                               // Live entries per connection before it only removes
+};
+
+static Options parseOptions(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string name = argv[i];
+        if (name == "--socket") options.socket = argv[i + 1];
+        else if (name == "--workers") options.workers = std::atoi(argv[i + 1]);
+        else if (name == "--connections") options.connections = std::atoi(argv[i + 1]);
+        else if (name == "--depth") options.depth = std::atoi(argv[i + 1]);
+        else if (name == "--commands") options.commands = std::atoi(argv[i + 1]);
+        else if (name == "--entries") options.entries = std::atol(argv[i + 1]);
+        else {
+            std::cerr << "Unknown option " << name << std::endl;
+            std::exit(1);
+        }
+    }
+    options.depth = std::max(1, options.depth);
+    options.entries = std::max<size_t>(1, options.entries);
+    return options;
+}
+
+// Per-connection results
+struct ConnectionResult {
+    std::vector<long long> latencies;                   // Nanoseconds from a batch's send to each response
+    long long errors = 0;
+    std::string failure;                                // Why the connection stopped early, if it did
+};
+
+// Sends options.commands commands on one connection in batches of options.depth. Entries are
+// created and removed by absolute path under /load<pid>_<index>, so the cd commands, which
+// move between that directory and its sub directory, only change what ls lists, and runs
+// against the same server do not collide.
+static void runConnection(const Options& options, int index, ConnectionResult& result) {
+    FileSystemClient client(options.socket);
+    std::string home = "/load" + std::to_string(getpid()) + "_" + std::to_string(index);
+    client.mkdir(home + "/sub", true);
+    client.cd(home);
+
+    std::mt19937 random(index + 1);
+    std::deque<std::string> live;                       // Names this connection created, oldest first
+    long long created = 0;
+    bool inSub = false;
+    result.latencies.reserve(options.commands);
+    for (int sent = 0; sent < options.commands;) {
+        int batch = std::min(options.depth, options.commands - sent);
+        for (int i = 0; i < batch; i++) {
+            int pick = int(random() % 100);
+            if (pick < 45 && live.size() >= options.entries) {
+                pick = 45;                                                                          // Full, so remove instead
+            } else if (pick >= 45 && pick < 60 && live.empty()) {
+                pick = 0;                                                                           // Empty, so create instead
+            }
+            if (pick < 45) {
+                live.push_back("c" + std::to_string(index) + "e" + std::to_string(created++));
+                if (pick < 30) {
+                    client.queueTouch(home + "/" + live.back());
+                } else {
+                    client.queueMkdir(home + "/" + live.back());
+                }
+            } else if (pick < 60) {
+                client.queueRm(home + "/" + live.front());
+                live.pop_front();
+            } else if (pick < 80) {
+                client.queueLs();
+            } else if (pick < 88) {
+                client.queuePwd();
+            } else if (pick < 94) {
+                client.queueCd(inSub ? ".." : "sub");
+                inSub = !inSub;
+            } else {
+                client.queueFind(live.empty() ? "sub" : live[random() % live.size()]);
+            }
+        }
+        Clock::time_point start = Clock::now();
+        client.flush();
+        for (int i = 0; i < batch; i++) {
+            if (client.receive().status != protocol::STATUS_OK) {
+                result.errors++;
+            }
+            result.latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+        }
+        sent += batch;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    Options options = parseOptions(argc, argv);
+
+    FileSystem fs;
+    std::unique_ptr<FileSystemServer> server;
+    if (options.socket.empty()) {
+        options.socket = "/tmp/filesystem_load_" + std::to_string(getpid()) + ".sock";
+        server = std::make_unique<FileSystemServer>(fs, options.socket, options.workers);
+        server->start();
+    }
+
+    ServiceStats before = server ? server->getStats() : ServiceStats();
+    std::vector<ConnectionResult> results(options.connections);
+    std::vector<std::thread> threads;
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < options.connections; i++) {
+        threads.emplace_back([&options, &results, i] {
+            try {
+                runConnection(options, i, results[i]);
+            } catch (const std::exception& error) {
+                results[i].failure = error.what();
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::vector<long long> all;
+    long long errors = 0;
+    int exitCode = 0;
+    for (const auto& result : results) {
+        all.insert(all.end(), result.latencies.begin(), result.latencies.end());
+        errors += result.errors;
+        if (!result.failure.empty()) {
+            std::cerr << result.failure << std::endl;
+            exitCode = 1;
+        }
+    }
+    if (all.empty()) {
+        std::cerr << "No commands sent" << std::endl;
+        return 1;
+    }
+    std::sort(all.begin(), all.end());
+    auto at = [&all](double q) { return all[std::min(all.size() - 1, size_t(q * all.size()))] / 1000.0; };
+
+    std::cout << options.connections << " connections, depth " << options.depth << ", "
+              << (server ? std::to_string(options.workers) + " server workers" : "external server") << std::endl;
+    std::cout << std::fixed << std::setprecision(0) << all.size() / seconds << " ops/s"
+              << std::setprecision(1) << "  p50 " << at(0.5) << " us  p99 " << at(0.99) << " us  p99.9 " << at(0.999)
+              << " us  max " << all.back() / 1000.0 << " us  (" << errors << " failed)" << std::endl;
+    if (server) {
+        ServiceStats stats = server->getStats();
+        std::cout << std::setprecision(1) << double(stats.commands - before.commands) / std::max(1LL, stats.batches - before.batches)
+                  << " commands per batch" << std::endl;
+        server->stop();
+    }
+    return exitCode;
+}
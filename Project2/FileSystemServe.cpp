@@ -0,0 +1,39 @@
+// FileSystemServe.cpp
+// Serves an empty FileSystem on a Unix-domain socket until interrupted.
+//   filesystem_server <socket path> [workers]
+#include "FileSystemServer.hpp"
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <socket path> [workers]" << std::endl;
+        return 1;
+    }
+
+    // Block the stop signals here so every thread inherits the mask, then wait for one
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    FileSystem fs;
+    FileSystemServer server(fs, argv[1], argc > 2 ? std::atoi(argv[2]) : 2);
+    try {
+        server.start();
+    } catch (const std::exception& error) {
+        std::cerr << error.what() << std::endl;
+        return 1;
+    }
+    std::cout << "Serving on " << argv[1] << std::endl;
+
+    int signal;
+    sigwait(&signals, &signal);
+    server.stop();
+    ServiceStats stats = server.getStats();
+    std::cout << stats.connections << " connections, " << stats.commands << " commands in "
+              << stats.batches << " batches" << std::endl;
+    return 0;
+}
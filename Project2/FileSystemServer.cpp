@@ -0,0 +1,424 @@
+// FileSystemServer.cpp
+#include "FileSystemServer.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Appends and reads integers of the wire format
+template <typename T>
+static void put(std::string& buffer, T value) {
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+static T get(const char* data) {
+    T value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+// Reserves a frame's length, to be filled in by endFrame once the rest is written
+static size_t beginFrame(std::string& output, uint32_t id, uint8_t code) {
+    size_t start = output.size();
+    put<uint32_t>(output, 0);
+    put<uint32_t>(output, id);
+    put<uint8_t>(output, code);
+    return start;
+}
+
+static void endFrame(std::string& output, size_t start) {
+    uint32_t length = static_cast<uint32_t>(output.size() - start - 4);
+    std::memcpy(&output[start], &length, sizeof(length));
+}
+
+// Tell the listening socket and the wake eventfd apart from connections in epoll events
+static char listenTag, wakeTag;
+
+static sockaddr_un socketAddress(const std::string& path) {
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("Socket path too long: " + path);
+    }
+    std::strcpy(address.sun_path, path.c_str());
+    return address;
+}
+
+FileSystemServer::FileSystemServer(FileSystem& fs, const std::string& path, int workers)
+    : fs(fs), path(path), workerCount(std::max(workers, 1)), listenFd(-1), wakeFd(-1),
+      connections(0), commands(0), batches(0) {}
+
+FileSystemServer::~FileSystemServer() {
+    stop();
+}
+
+// Binds the socket and starts the workers
+void FileSystemServer::start() {
+    sockaddr_un address = socketAddress(path);
+    listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd < 0) {
+        throw std::runtime_error(std::string("socket: ") + std::strerror(errno));
+    }
+    unlink(path.c_str());
+    if (bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || listen(listenFd, 512) < 0) {
+        std::string error = std::strerror(errno);
+        close(listenFd);
+        listenFd = -1;
+        throw std::runtime_error("Cannot listen on " + path + ": " + error);
+    }
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeFd < 0) {
+        std::string error = std::strerror(errno);
+        releaseDescriptors();
+        unlink(path.c_str());
+        throw std::runtime_error("eventfd: " + error);
+    }
+
+    // Every worker's epoll set watches the listening socket and the wake eventfd
+    for (int i = 0; i < workerCount; i++) {
+        int epollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (epollFd >= 0) {
+            epollFds.push_back(epollFd);
+        }
+        epoll_event listenEvent{}, wakeEvent{};
+        listenEvent.events = EPOLLIN | EPOLLEXCLUSIVE;
+        listenEvent.data.ptr = &listenTag;
+        wakeEvent.events = EPOLLIN;
+        wakeEvent.data.ptr = &wakeTag;
+        if (epollFd < 0 || epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &listenEvent) < 0 ||
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &wakeEvent) < 0) {
+            std::string error = std::strerror(errno);
+            releaseDescriptors();
+            unlink(path.c_str());
+            throw std::runtime_error("epoll: " + error);
+        }
+    }
+    for (int epollFd : epollFds) {
+        workers.emplace_back(&FileSystemServer::workerLoop, this, epollFd);
+    }
+}
+
+// Wakes the workers, waits for them to close their connections and removes the socket
+void FileSystemServer::stop() {
+    if (listenFd < 0) return;
+    uint64_t one = 1;
+    if (write(wakeFd, &one, sizeof(one)) < 0) {}                                                    // Never consumed, so every worker sees it
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+    releaseDescriptors();
+    unlink(path.c_str());
+}
+
+// Closes the listening socket, the wake eventfd and the epoll sets
+void FileSystemServer::releaseDescriptors() {
+    for (int epollFd : epollFds) {
+        close(epollFd);
+    }
+    epollFds.clear();
+    if (wakeFd >= 0) {
+        close(wakeFd);
+    }
+    close(listenFd);
+    listenFd = wakeFd = -1;
+}
+
+ServiceStats FileSystemServer::getStats() const {
+    return ServiceStats{connections.load(), commands.load(), batches.load()};
+}
+
+// Event loop of one worker. The listening socket is shared with EPOLLEXCLUSIVE, so a new
+// connection wakes one worker, which accepts it, opens its session and serves it from then on.
+// A session is only ever used by the worker that owns it.
+void FileSystemServer::workerLoop(int epollFd) {
+    epoll_event event;
+    std::vector<Connection*> open;
+    epoll_event events[64];
+    bool running = true;
+    while (running) {
+        int ready = epoll_wait(epollFd, events, 64, -1);
+        for (int i = 0; i < ready; i++) {
+            if (events[i].data.ptr == &wakeTag) {
+                running = false;
+            } else if (events[i].data.ptr == &listenTag) {
+                int fd;
+                while ((fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                    Connection* connection = new Connection();
+                    connection->fd = fd;
+                    connection->session = std::make_unique<FileSystemSession>(fs);
+                    event.events = EPOLLIN;
+                    event.data.ptr = connection;
+                    epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+                    open.push_back(connection);
+                    connections++;
+                }
+            } else {
+                Connection* connection = static_cast<Connection*>(events[i].data.ptr);
+                bool alive = true;
+                if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                    alive = readCommands(*connection);
+                }
+                if (alive) {
+                    alive = writeResponses(*connection);
+                }
+                if (alive) {
+                    // Stop reading while responses are pending, so a client that sends without
+                    // reading cannot grow the output without bound
+                    event.events = connection->output.empty() ? EPOLLIN : EPOLLOUT;
+                    event.data.ptr = connection;
+                    epoll_ctl(epollFd, EPOLL_CTL_MOD, connection->fd, &event);
+                } else {
+                    close(connection->fd);
+                    open.erase(std::find(open.begin(), open.end(), connection));
+                    delete connection;                                                              // Closes its session
+                }
+            }
+        }
+    }
+
+    for (auto connection : open) {
+        close(connection->fd);
+        delete connection;
+    }
+}
+
+// Reads everything the connection has sent and runs its complete commands as one batch.
+// Returns false once the connection should be closed.
+bool FileSystemServer::readCommands(Connection& connection) {
+    char chunk[65536];
+    bool closed = false;
+    for (;;) {
+        ssize_t count = read(connection.fd, chunk, sizeof(chunk));
+        if (count > 0) {
+            connection.input.append(chunk, count);
+            if (count < static_cast<ssize_t>(sizeof(chunk))) break;
+        } else if (count == 0) {
+            closed = true;
+            break;
+        } else if (errno == EINTR) {
+            continue;
+        } else {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) return false;
+            break;
+        }
+    }
+
+    size_t offset = 0;
+    const std::string& input = connection.input;
+    long long handled = 0;
+    while (input.size() - offset >= 4) {
+        uint32_t length = get<uint32_t>(input.data() + offset);
+        if (length < 6 || length > protocol::MAX_FRAME) return false;
+        if (input.size() - offset - 4 < length) break;
+        execute(*connection.session, input.data() + offset + 4, length, connection.output);
+        offset += 4 + length;
+        handled++;
+    }
+    if (handled) {
+        commands += handled;
+        batches++;
+    }
+    connection.input.erase(0, offset);
+    return !closed || !connection.output.empty();
+}
+
+// Writes pending responses; returns false if the connection failed
+bool FileSystemServer::writeResponses(Connection& connection) {
+    while (connection.written < connection.output.size()) {
+        ssize_t count = send(connection.fd, connection.output.data() + connection.written,
+                             connection.output.size() - connection.written, MSG_NOSIGNAL);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        connection.written += count;
+    }
+    connection.output.clear();
+    connection.written = 0;
+    return true;
+}
+
+// Runs one command frame (id, opcode, flags and argument) on the connection's session and
+// appends its response. Listings stream straight into the output; a command that throws has
+// whatever it wrote dropped and answers with the message instead.
+void FileSystemServer::execute(FileSystemSession& session, const char* frame, uint32_t length, std::string& output) {
+    uint32_t id = get<uint32_t>(frame);
+    uint8_t opcode = static_cast<uint8_t>(frame[4]);
+    uint8_t flags = static_cast<uint8_t>(frame[5]);
+    std::string argument(frame + 6, length - 6);
+    auto append = [&output](const char* data, size_t size) {
+        output.append(data, size);
+        return true;
+    };
+
+    size_t start = beginFrame(output, id, protocol::STATUS_OK);
+    try {
+        switch (opcode) {
+        case protocol::OP_MKDIR:
+            session.mkdir(argument, flags & protocol::FLAG_PARENTS);
+            break;
+        case protocol::OP_TOUCH:
+            session.touch(argument);
+            break;
+        case protocol::OP_CD:
+            session.cd(argument);
+            break;
+        case protocol::OP_LS:
+            session.ls(append);
+            break;
+        case protocol::OP_RM:
+            session.rm(argument);
+            break;
+        case protocol::OP_PWD:
+            output += session.pwd();
+            break;
+        case protocol::OP_FIND:
+            for (const auto& match : session.find(argument)) {
+                output += match;
+                output += '\n';
+            }
+            break;
+        case protocol::OP_TREE:
+            session.tree(append);
+            break;
+        default:
+            output.resize(start);
+            start = beginFrame(output, id, protocol::STATUS_BAD_REQUEST);
+            break;
+        }
+    } catch (const std::exception& error) {
+        output.resize(start);
+        start = beginFrame(output, id, protocol::STATUS_ERROR);
+        output += error.what();
+    }
+    endFrame(output, start);
+}
+
+FileSystemClient::FileSystemClient(const std::string& path) {
+    sockaddr_un address = socketAddress(path);
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+        std::string error = std::strerror(errno);
+        if (fd >= 0) close(fd);
+        throw std::runtime_error("Cannot connect to " + path + ": " + error);
+    }
+}
+
+FileSystemClient::~FileSystemClient() {
+    close(fd);
+}
+
+uint32_t FileSystemClient::queue(uint8_t opcode, uint8_t flags, const std::string& argument) {
+    size_t start = beginFrame(output, nextId, opcode);
+    put<uint8_t>(output, flags);
+    output += argument;
+    endFrame(output, start);
+    return nextId++;
+}
+
+uint32_t FileSystemClient::queueMkdir(const std::string& path, bool parents) {
+    return queue(protocol::OP_MKDIR, parents ? protocol::FLAG_PARENTS : 0, path);
+}
+
+uint32_t FileSystemClient::queueTouch(const std::string& path) { return queue(protocol::OP_TOUCH, 0, path); }
+uint32_t FileSystemClient::queueCd(const std::string& path) { return queue(protocol::OP_CD, 0, path); }
+uint32_t FileSystemClient::queueLs() { return queue(protocol::OP_LS, 0, ""); }
+uint32_t FileSystemClient::queueRm(const std::string& path) { return queue(protocol::OP_RM, 0, path); }
+uint32_t FileSystemClient::queuePwd() { return queue(protocol::OP_PWD, 0, ""); }
+uint32_t FileSystemClient::queueFind(const std::string& name) { return queue(protocol::OP_FIND, 0, name); }
+uint32_t FileSystemClient::queueTree() { return queue(protocol::OP_TREE, 0, ""); }
+
+// Sends every queued command in one write
+void FileSystemClient::flush() {
+    size_t sent = 0;
+    while (sent < output.size()) {
+        ssize_t count = send(fd, output.data() + sent, output.size() - sent, MSG_NOSIGNAL);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error(std::string("send: ") + std::strerror(errno));
+        }
+        sent += count;
+    }
+    output.clear();
+}
+
+CommandResponse FileSystemClient::receive() {
+    for (;;) {
+        size_t available = input.size() - consumed;
+        if (available >= 4) {
+            uint32_t length = get<uint32_t>(input.data() + consumed);
+            if (length < 5) {
+                throw std::runtime_error("Malformed response");
+            }
+            if (available - 4 >= length) {
+                const char* data = input.data() + consumed + 4;
+                CommandResponse response;
+                response.id = get<uint32_t>(data);
+                response.status = static_cast<uint8_t>(data[4]);
+                response.text.assign(data + 5, length - 5);
+                consumed += 4 + length;
+                if (consumed == input.size()) {
+                    input.clear();
+                    consumed = 0;
+                }
+                return response;
+            }
+        }
+
+        char chunk[65536];
+        ssize_t count = read(fd, chunk, sizeof(chunk));
+        if (count < 0 && errno == EINTR) continue;
+        if (count <= 0) {
+            throw std::runtime_error("Connection closed by server");
+        }
+        if (consumed) {
+            input.erase(0, consumed);
+            consumed = 0;
+        }
+        input.append(chunk, count);
+    }
+}
+
+// Sends the queued commands and returns the text of the response to id, which must be the
+// only one outstanding
+std::string FileSystemClient::roundTrip(uint32_t id) {
+    flush();
+    CommandResponse response = receive();
+    if (response.id != id) {
+        throw std::runtime_error("Response out of order");
+    }
+    if (response.status == protocol::STATUS_BAD_REQUEST) {
+        throw std::runtime_error("Bad request");
+    }
+    if (response.status != protocol::STATUS_OK) {
+        throw std::runtime_error(response.text);
+    }
+    return response.text;
+}
+
+void FileSystemClient::mkdir(const std::string& path, bool parents) { roundTrip(queueMkdir(path, parents)); }
+void FileSystemClient::touch(const std::string& path) { roundTrip(queueTouch(path)); }
+void FileSystemClient::cd(const std::string& path) { roundTrip(queueCd(path)); }
+std::string FileSystemClient::ls() { return roundTrip(queueLs()); }
+void FileSystemClient::rm(const std::string& path) { roundTrip(queueRm(path)); }
+std::string FileSystemClient::pwd() { return roundTrip(queuePwd()); }
+std::string FileSystemClient::tree() { return roundTrip(queueTree()); }
+
+std::vector<std::string> FileSystemClient::find(const std::string& name) {
+    std::string text = roundTrip(queueFind(name));
+    std::vector<std::string> paths;
+    for (size_t begin = 0, end; begin < text.size(); begin = end + 1) {
+        end = text.find('\n', begin);
+        paths.push_back(text.substr(begin, end - begin));
+    }
+    return paths;
+}
@@ -0,0 +1,140 @@
+// FileSystemServer.hpp
+#ifndef FILESYSTEM_SERVER_HPP
+#define FILESYSTEM_SERVER_HPP
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <cstdint>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include "FileSystem.hpp"
+
+// Binary protocol over a Unix stream socket, integers in host byte order.
+//   Request:  u32 length | u32 id | u8 opcode | u8 flags | path    (length counts the bytes after it)
+//     MKDIR takes FLAG_PARENTS; FIND takes a name in place of the path; LS, PWD and TREE take none
+//   Response: u32 length | u32 id | u8 status | text
+//     LS and TREE: the listing; PWD: the path; FIND: matching paths, one per line;
+//     STATUS_ERROR: the message the FileSystem threw
+// Requests on a connection may be pipelined; responses come back in request order.
+namespace protocol {
+    const uint8_t OP_MKDIR = 1;
+    const uint8_t OP_TOUCH = 2;
+    const uint8_t OP_CD = 3;
+    const uint8_t OP_LS = 4;
+    const uint8_t OP_RM = 5;
+    const uint8_t OP_PWD = 6;
+    const uint8_t OP_FIND = 7;
+    const uint8_t OP_TREE = 8;
+
+    const uint8_t FLAG_PARENTS = 1;                     // mkdir -p
+
+    const uint8_t STATUS_OK = 0;
+    const uint8_t STATUS_ERROR = 1;                     // The command failed, e.g. a missing path
+    const uint8_t STATUS_BAD_REQUEST = 2;
+
+    const uint32_t MAX_FRAME = 1 << 20;                 // Longer requests close the connection
+}
+
+// Connection and command counters of a running server
+struct ServiceStats {
+    long long connections;
+    long long commands;
+    long long batches;                                  // Groups of pipelined commands read and answered together
+};
+
+// Serves one FileSystem on a Unix-domain socket. Every connection gets its own
+// FileSystemSession, so it has its own working directory. Every worker thread runs its own
+// epoll loop, accepts connections itself and keeps them; each read drains all pipelined
+// commands a connection has sent, runs them in order and answers them with one write.
+// Stop the server before destroying the FileSystem, since that closes the sessions.
+class FileSystemServer {
+private:
+    struct Connection {
+        int fd;
+        std::unique_ptr<FileSystemSession> session;
+        std::string input;
+        std::string output;
+        size_t written = 0;
+    };
+
+    FileSystem& fs;
+    std::string path;
+    int workerCount;
+    int listenFd;
+    int wakeFd;                                         // eventfd that wakes every worker to stop
+    std::vector<int> epollFds;                          // One per worker, set up by start
+    std::vector<std::thread> workers;
+    std::atomic<long long> connections;
+    std::atomic<long long> commands;
+    std::atomic<long long> batches;
+
+    void releaseDescriptors();
+    void workerLoop(int epollFd);
+    bool readCommands(Connection& connection);
+    bool writeResponses(Connection& connection);
+    void execute(FileSystemSession& session, const char* frame, uint32_t length, std::string& output);
+
+public:
+    FileSystemServer(FileSystem& fs, const std::string& path, int workers = 1);
+    ~FileSystemServer();
+
+    FileSystemServer(const FileSystemServer&) = delete;
+    FileSystemServer& operator=(const FileSystemServer&) = delete;
+
+    void start();                                       // Throws std::runtime_error if the socket or polling cannot be set up
+    void stop();
+    ServiceStats getStats() const;
+};
+
+// A decoded response
+struct CommandResponse {
+    uint32_t id;
+    uint8_t status;
+    std::string text;
+};
+
+// Blocking client. Commands are queued and sent together by flush, so a batch is pipelined;
+// the mkdir/touch/cd/ls/rm/pwd/find/tree helpers do a single round trip each and throw
+// std::runtime_error with the server's message when the command fails, like FileSystem.
+class FileSystemClient {
+private:
+    int fd;
+    uint32_t nextId = 0;
+    std::string output;
+    std::string input;
+    size_t consumed = 0;
+
+    uint32_t queue(uint8_t opcode, uint8_t flags, const std::string& argument);
+    std::string roundTrip(uint32_t id);
+
+public:
+    explicit FileSystemClient(const std::string& path);  // Throws std::runtime_error if it cannot connect
+    ~FileSystemClient();
+
+    FileSystemClient(const FileSystemClient&) = delete;
+    FileSystemClient& operator=(const FileSystemClient&) = delete;
+
+    uint32_t queueMkdir(const std::string& path, bool parents = false);
+    uint32_t queueTouch(const std::string& path);
+    uint32_t queueCd(const std::string& path);
+    uint32_t queueLs();
+    uint32_t queueRm(const std::string& path);
+    uint32_t queuePwd();
+    uint32_t queueFind(const std::string& name);
+    uint32_t queueTree();
+    void flush();                                       // Nothing is read meanwhile, so keep batches to a few thousand
+    CommandResponse receive();                          // Next response, in request order
+
+    void mkdir(const std::string& path, bool parents = false);
+    void touch(const std::string& path);
+    void cd(const std::string& path);
+    std::string ls();
+    void rm(const std::string& path);
+    std::string pwd();
+    std::vector<std::string> find(const std::string& name);
+    std::string tree();
+};
+
+#endif // FILESYSTEM_SERVER_HPP
@@ -1,18 +1,27 @@
 // FileSystemTester.cpp
 #include "FileSystem.hpp"
+#include "FileSystemServer.hpp"
 #include <cassert>
 #include <iostream>
 #include <sstream>
+#include <thread>
+#include <atomic>
+#include <fstream>
+#include <cstdio>
+#include <algorithm>
+#include <unistd.h>
 
 class FileSystemTester {
 private:
     int totalScore = 0;
     int totalTests = 0;
     int passedTests = 0;
+    int maxScore = 0;
     std::stringstream testOutput;
 
     void logTest(const std::string& testName, bool passed, int points) {
         totalTests++;
+        maxScore += points;
         if (passed) {
             passedTests++;
             totalScore += points;
@@ -222,7 +231,959 @@ private:
         return success;
     }
 
+    bool testLargeDirectory(FileSystem& fs, int points = 10) {
+        bool success = true;
+        try {
+            const int count = 200;                                                      // Well above the child index threshold
+            fs.mkdir("large");
+            fs.cd("large");
+            for (int i = 0; i < count; i++) {
+                fs.touch("f" + std::to_string(i));
+                fs.mkdir("d" + std::to_string(i));
+            }
+            fs.touch("d7");                                                             // A file may share a directory's name
+
+            try {
+                fs.mkdir("d150");
+                success = false;
+            } catch (const std::runtime_error&) {
+                // Expected behavior
+            }
+
+            fs.cd("d150");
+            if (fs.pwd() != "/large/d150/") {
+                success = false;
+            }
+            fs.cd("..");
+
+            for (int i = 0; i < count; i += 2) {
+                fs.rm("f" + std::to_string(i));
+                fs.rm("d" + std::to_string(i));
+            }
+            fs.rm("d7");                                                                // Removes the directory created first
+            fs.cd("d9");
+            fs.cd("..");
+            try {
+                fs.cd("d7");
+                success = false;
+            } catch (const std::runtime_error&) {
+                // Expected behavior
+            }
+
+            std::string expected;                                                       // ls keeps insertion order
+            for (int i = 1; i < count; i += 2) {
+                expected += "f" + std::to_string(i) + "\n";
+                if (i != 7) {
+                    expected += "d" + std::to_string(i) + "/\n";
+                }
+            }
+            expected += "d7\n";
+            if (fs.ls() != expected) {
+                success = false;
+            }
+            fs.cd("/");
+        } catch (const std::exception& e) {
+            success = false;
+        }
+        logTest("large directory functionality", success, points);
+        return success;
+    }
+
+    bool testPaths(FileSystem& fs, int points = 15) {
+        bool success = true;
+        try {
+            fs.mkdir("/paths/a/b/c", true);                                             // mkdir -p
+            fs.mkdir("paths/a/b/c", true);                                              // Existing directories are fine with -p
+            fs.cd("/paths/a/b/../b/./c");
+            if (fs.pwd() != "/paths/a/b/c/") {
+                success = false;
+            }
+
+            fs.touch("../note.txt");
+            fs.cd("..");
+            FileStat info = fs.stat("./note.txt");
+            if (info.isDirectory || info.path != "/paths/a/b/note.txt") {
+                success = false;
+            }
+            info = fs.stat("/paths/a");
+            if (!info.isDirectory || info.entries != 1 || info.path != "/paths/a/") {
+                success = false;
+            }
+
+            try {
+                fs.mkdir("missing/dir");                                                // Parent must exist without -p
+                success = false;
+            } catch (const std::runtime_error&) {
+                // Expected behavior
+            }
+            try {
+                fs.rm("/paths/a");                                                      // Ancestor of the current directory
+                success = false;
+            } catch (const std::runtime_error&) {
+                // Expected behavior
+            }
+
+            fs.rm("c/");
+            fs.rm("/paths/a/b/note.txt");
+            if (fs.ls() != "") {
+                success = false;
+            }
+            try {
+                fs.stat("c");
+                success = false;
+            } catch (const std::runtime_error&) {
+                // Expected behavior
+            }
+
+            fs.cd("/");
+            fs.rm("paths");
+            fs.mkdir("paths");                                                          // Removed names resolve to the new node
+            fs.cd("paths");
+            if (fs.pwd() != "/paths/" || fs.ls() != "") {
+                success = false;
+            }
+            fs.cd("/");
+        } catch (const std::exception& e) {
+            success = false;
+        }
+        logTest("path resolution functionality", success, points);
+        return success;
+    }
+
+    bool testFind(FileSystem& fs, int points = 15) {
+        bool success = true;
+        try {
+            fs.mkdir("/search/x/y", true);
+            fs.touch("/search/report.txt");
+            fs.touch("/search/x/report.txt");
+            fs.touch("/search/x/y/report.txt");
+            fs.touch("/search/x/y/readme.md");
+
+            std::vector<FileSystemNode*> matches = fs.findAll("report.txt");
+            if (matches.size() != 3 || fs.find("report.txt") != matches[0]) {
+                success = false;
+            }
+            if (fs.findPrefix("rep").size() != 3 || fs.findPrefix("re").size() != 4) {
+                success = false;
+            }
+            if (fs.glob("*.md").size() != 1 || fs.glob("re??rt.*").size() != 3 || fs.glob("r*").size() != 4) {
+                success = false;
+            }
+
+            fs.rm("/search/x");                                                         // Drops the whole subtree from the index
+            if (fs.findAll("report.txt").size() != 1 || fs.find("readme.md") != nullptr || fs.find("y") != nullptr) {
+                success = false;
+            }
+            if (fs.find("/") == nullptr || fs.find("nonexistent") != nullptr) {
+                success = false;
+            }
+            fs.rm("/search");
+        } catch (const std::exception& e) {
+            success = false;
+        }
+        logTest("find functionality", success, points);
+        return success;
+    }
+
+    bool testStreaming(int points = 10) {
+        bool success = true;
+        try {
+            FileSystem fs;                                                              // Fresh tree so the output is known
+            fs.mkdir("/a/b", true);
+            fs.touch("/a/b/f.txt");
+            fs.touch("/a/g.txt");
+            fs.mkdir("/c");
+
+            std::string expected = "//\n  a/\n    b/\n      f.txt\n    g.txt\n  c/\n";
+            if (fs.tree() != expected) {
+                success = false;
+            }
+
+            std::stringstream out;
+            ListOptions options;
+            options.maxDepth = 1;
+            if (fs.tree(out, options) != 3 || out.str() != "//\n  a/\n  c/\n") {
+                success = false;
+            }
+
+            ListOptions page;                                                           // Second page of two entries
+            page.offset = 2;
+            page.limit = 2;
+            out.str("");
+            if (fs.tree(out, page) != 2 || out.str() != "    b/\n      f.txt\n") {
+                success = false;
+            }
+
+            std::string chunks;
+            size_t written = fs.tree([&chunks](const char* data, size_t length) {
+                chunks.append(data, length);
+                return false;                                                           // Stop after the first chunk
+            });
+            if (written != 6 || chunks != expected) {
+                success = false;
+            }
+
+            fs.cd("/a");
+            ListOptions first;
+            first.limit = 1;
+            out.str("");
+            if (fs.ls(out, first) != 1 || out.str() != "b/\n" || fs.ls() != "b/\ng.txt\n") {
+                success = false;
+            }
+        } catch (const std::exception& e) {
+            success = false;
+        }
+        logTest("streaming ls/tree functionality", success, points);
+        return success;
+    }
+
+    bool testFileContents(FileSystem& fs, int points = 15) {
+        bool success = true;
+        try {
+            fs.mkdir("/data");
+            fs.touch("/data/log.txt");
+            fs.append("/data/log.txt", "hello ", 6);
+            fs.append("/data/log.txt", "world", 5);
+            char buffer[16] = {};
+            if (fs.read("/data/log.txt", 0, buffer, sizeof(buffer)) != 11 || std::string(buffer, 11) != "hello world") {
+                success = false;
+            }
+            fs.write("/data/log.txt", 6, "WORLD", 5);
+            if (fs.read("/data/log.txt", 4, buffer, 4) != 4 || std::string(buffer, 4) != "o WO") {
+                success = false;
+            }
+
+            fs.touch("/data/sparse.bin");                                               // Write far past the end: a hole in between
+            fs.write("/data/sparse.bin", 10000, "xyz", 3);
+            if (fs.stat("/data/sparse.bin").size != 10003) {
+                success = false;
+            }
+            std::vector<std::span<const char>> views = fs.readView("/data/sparse.bin", 4090, 5915);
+            size_t viewed = 0;
+            bool zeros = true;
+            for (auto view : views) {
+                for (size_t i = 0; i < view.size() && viewed + i < 5910; i++) {
+                    zeros = zeros && view[i] == 0;
+                }
+                viewed += view.size();
+            }
+            if (viewed != 5913 || !zeros || views.back().back() != 'z') {
+                success = false;
+            }
+
+            fs.truncate("/data/log.txt", 3);                                            // Shrink, then grow back
+            fs.truncate("/data/log.txt", 6);
+            if (fs.read("/data/log.txt", 0, buffer, sizeof(buffer)) != 6 || std::string(buffer, 6) != std::string("hel\0\0\0", 6)) {
+                success = false;
+            }
+
+            try {
+                fs.write("/data", 0, "x", 1);                                           // Directories have no contents
+                success = false;
+            } catch (const std::runtime_error&) {
+                // Expected behavior
+            }
+            fs.rm("/data");
+        } catch (const std::exception& e) {
+            success = false;
+        }
+        logTest("file contents functionality", success, points);
+        return success;
+    }
+
+    bool testSnapshots(int points = 15) {
+        bool success = true;
+        try {
+            FileSystem fs;
+            fs.mkdir("/src/lib", true);
+            fs.touch("/src/main.cpp");
+            FileSystemSnapshot before = fs.snapshot();
+            std::string treeBefore = fs.tree();
+
+            fs.touch("/src/lib/util.cpp");                                              // Mutations after the snapshot
+            fs.rm("/src/main.cpp");
+            fs.mkdir("/docs");
+            FileSystemSnapshot after = fs.snapshot();
+            fs.rm("/src");
+
+            if (before.tree() != treeBefore || before.ls("/src") != "lib/\nmain.cpp\n") {
+                success = false;
+            }
+            if (before.find("util.cpp").size() != 0 || before.find("main.cpp") != std::vector<std::string>{"/src/main.cpp"}) {
+                success = false;
+            }
+            if (after.ls() != "src/\ndocs/\n" || after.ls("src/lib/..") != "lib/\n") {
+                success = false;
+            }
+            if (after.find("util.cpp") != std::vector<std::string>{"/src/lib/util.cpp"} || after.version() <= before.version()) {
+                success = false;
+            }
+            if (fs.snapshot().tree() != fs.tree() || fs.tree() != "//\n  docs/\n") {
+                success = false;
+            }
+
+            try {
+                before.ls("/docs");
+                success = false;
+            } catch (const std::runtime_error&) {
+                // Expected behavior
+            }
+
+            FileSystem other;                                                           // Shared tree dropped with the last snapshot, then rebuilt
+            other.mkdir("/a");
+            uint64_t first = other.snapshot().version();
+            other.touch("/a/f");
+            other.mkdir("/b");
+            std::string treeRebuilt = other.tree();
+            FileSystemSnapshot rebuilt = other.snapshot();
+            other.rm("/a");
+            if (rebuilt.version() <= first || rebuilt.tree() != treeRebuilt || other.snapshot().tree() != other.tree()) {
+                success = false;
+            }
+        } catch (const std::exception& e) {
+            success = false;
+        }
+        logTest("snapshot functionality", success, points);
+        return success;
+    }
+
 public:
+    bool testSessions(int points = 15) {
+        bool success = true;
+        try {
+            FileSystem fs;
+            fs.mkdir("/a/b", true);
+            fs.mkdir("/c");
+            {
+                FileSystemSession first(fs);
+                FileSystemSession second(fs);
+                first.cd("/a/b");
+                second.cd("c");
+                if (first.pwd() != "/a/b/" || second.pwd() != "/c/" || fs.pwd() != "/") {
+                    success = false;
+                }
+                try {
+                    second.rm("/a");                                                    // first is inside it
+                    success = false;
+                } catch (const std::runtime_error&) {
+                    // Expected behavior
+                }
+                first.cd("..");
+                first.touch("notes");
+                first.write("notes", 0, "hello", 5);
+                char buffer[8] = {};
+                if (second.read("/a/notes", 0, buffer, sizeof(buffer)) != 5 || std::string(buffer) != "hello") {
+                    success = false;
+                }
+                first.cd("/");
+                second.rm("/a");
+                if (second.find("notes").size() != 0 || fs.ls() != "c/\n") {
+                    success = false;
+                }
+            }
+
+            const int threads = 4;
+            const int rounds = 300;
+            std::atomic<int> failures(0);
+            std::vector<std::thread> workers;
+            for (int t = 0; t < threads; t++) {
+                workers.push_back(std::thread([&fs, &failures, t]() {
+                    try {
+                        FileSystemSession session(fs);
+                        std::string home = "/c/t" + std::to_string(t);
+                        session.mkdir(home);
+                        session.cd(home);
+                        for (int i = 0; i < rounds; i++) {
+                            std::string name = "f" + std::to_string(i);
+                            session.touch(name);
+                            session.append(name, "x", 1);
+                            session.mkdir("d" + std::to_string(i));
+                            if (i > 0) {
+                                session.rm("d" + std::to_string(i - 1));                // Keeps one directory around
+                            }
+                            session.stat("/c");                                         // Shared path with the other threads
+                            session.ls();
+                        }
+                        if (session.pwd() != home + "/") {
+                            failures++;
+                        }
+                    } catch (const std::exception&) {
+                        failures++;
+                    }
+                }));
+            }
+            workers.push_back(std::thread([&fs, &failures]() {                          // Reader walking the whole tree meanwhile
+                try {
+                    FileSystemSession session(fs);
+                    for (int i = 0; i < 50; i++) {
+                        session.tree();
+                        session.find("f0");
+                    }
+                } catch (const std::exception&) {
+                    failures++;
+                }
+            }));
+            for (auto& worker : workers) {
+                worker.join();
+            }
+
+            if (failures != 0 || fs.stat("/c").entries != threads) {
+                success = false;
+            }
+            for (int t = 0; t < threads; t++) {
+                FileStat home = fs.stat("/c/t" + std::to_string(t));
+                if (home.entries != rounds + 1 || fs.stat("/c/t" + std::to_string(t) + "/f7").size != 1) {
+                    success = false;
+                }
+            }
+            if (fs.findAll("f0").size() != threads) {
+                success = false;
+            }
+        } catch (const std::exception& e) {
+            success = false;
+        }
+        logTest("concurrent sessions functionality", success, points);
+        return success;
+    }
+
+    bool testPwdCache(int points = 10) {
+        bool success = true;
+        try {
+            FileSystem fs;
+            const int depth = 10000;
+            std::string expected = "/";
+            for (int i = 0; i < depth; i++) {                                           // One level per cd, like a shell
+                std::string name = "d" + std::to_string(i % 10);
+                fs.mkdir(name);
+                fs.cd(name);
+                expected += name + "/";
+            }
+            if (fs.pwd() != expected) {
+                success = false;
+            }
+
+            fs.touch("leaf.txt");
+            if (fs.stat("leaf.txt").path != expected + "leaf.txt") {                    // pathOf agrees with the cache
+                success = false;
+            }
+
+            fs.cd("../.././d8/./");
+            expected.resize(expected.size() - 3);                                       // "d8/d9/" -> "d8/"
+            if (fs.pwd() != expected || fs.stat(".").path != expected) {
+                success = false;
+            }
+
+            std::vector<char> buffer(expected.size() + 1, 'x');
+            if (fs.pwd(buffer.data(), buffer.size()) != expected.size() || std::string(buffer.data()) != expected) {
+                success = false;
+            }
+            char small[4] = {'x', 'x', 'x', 'x'};
+            if (fs.pwd(small, sizeof(small)) != expected.size() || small[0] != 'x') {   // Too small: nothing written
+                success = false;
+            }
+
+            try {
+                fs.cd("missing/../..");
+                success = false;
+            } catch (const std::runtime_error&) {
+                // Expected behavior, the cached path must not change
+            }
+            fs.cd("/../d0/d1/..");
+            if (fs.pwd() != "/d0/") {
+                success = false;
+            }
+        } catch (const std::exception& e) {
+            success = false;
+        }
+        logTest("cached pwd functionality", success, points);
+        return success;
+    }
+
+    bool testReclaim(int points = 10) {
+        bool success = true;
+        try {
+            FileSystem fs;
+            const int width = 3000;
+            const int depth = 20000;
+            fs.mkdir("/wide");
+            for (int i = 0; i < width; i++) {
+                std::string name = "/wide/f" + std::to_string(i);
+                fs.touch(name);
+                fs.write(name, 0, "data", 4);
+            }
+            fs.mkdir("/deep");
+            fs.cd("/deep");
+            for (int i = 0; i < depth; i++) {                                           // Deep enough to overflow a recursive delete
+                fs.mkdir("d");
+                fs.cd("d");
+            }
+            fs.touch("bottom");
+            fs.cd("/");
+
+            fs.rm("/wide");
+            fs.rm("/deep");
+            if (fs.ls() != "" || fs.find("f7") != nullptr || fs.find("bottom") != nullptr ||
+                fs.findPrefix("f").size() != 0 || fs.glob("bot*").size() != 0) {       // Gone even if not yet freed
+                success = false;
+            }
+
+            fs.mkdir("/wide");                                                          // Names can be reused at once
+            fs.touch("/wide/f7");
+            if (fs.findAll("f7").size() != 1 || fs.stat("/wide/f7").size != 0) {
+                success = false;
+            }
+
+            fs.waitForReclaim();
+            ReclaimStats stats = fs.reclaimStats();
+            if (stats.pendingSubtrees != 0 || stats.pendingNodes != 0 || stats.reclaimedSubtrees != 2 ||
+                stats.reclaimedNodes != size_t(width + 1 + depth + 2)) {
+                success = false;
+            }
+            if (fs.find("f7") == nullptr || fs.tree() != "//\n  wide/\n    f7\n") {
+                success = false;
+            }
+
+            // Leaves freed inline by rm must never come back from a lookup in the name index
+            std::atomic<bool> stop(false);
+            std::atomic<bool> stale(false);
+            std::thread reader([&fs, &stop, &stale] {
+                FileSystemSession session(fs);
+                while (!stop) {
+                    for (const std::string& path : session.find("leaf")) {
+                        if (path != "/wide/leaf") {
+                            stale = true;
+                        }
+                    }
+                }
+            });
+            {
+                FileSystemSession writer(fs);
+                for (int i = 0; i < 20000; i++) {
+                    writer.touch("/wide/leaf");
+                    writer.touch("/wide/other" + std::to_string(i % 4));             // Reuses the freed slots
+                    writer.rm("/wide/leaf");
+                    writer.rm("/wide/other" + std::to_string(i % 4));
+                }
+            }
+            stop = true;
+            reader.join();
+            if (stale) {
+                success = false;
+            }
+        } catch (const std::exception& e) {
+            success = false;
+        }
+        logTest("background reclamation functionality", success, points);
+        return success;
+    }
+
+    bool testImages(int points = 10) {
+        bool success = true;
+        const std::string file = "filesystem_test.img";
+        try {
+            FileSystem fs;
+            fs.mkdir("/src/lib", true);
+            fs.mkdir("/docs");
+            fs.touch("/src/main.cpp");
+            fs.touch("/src/lib/util.cpp");
+            fs.touch("/docs/util.cpp");
+            fs.mkdir("/docs/b");
+            fs.touch("/docs/a");
+            fs.append("/src/main.cpp", "int main() {}", 13);
+            fs.write("/docs/a", 5000, "end", 3);                                       // Hole in front
+            fs.save(file);
+
+            FileSystem loaded;
+            loaded.load(file);
+            char buffer[16] = {};
+            if (loaded.tree() != fs.tree() || loaded.read("/src/main.cpp", 0, buffer, sizeof(buffer)) != 13 ||
+                std::string(buffer, 13) != "int main() {}" || loaded.stat("/docs/a").size != 5003 ||
+                loaded.findAll("util.cpp").size() != 2) {
+                success = false;
+            }
+            try {
+                loaded.load(file);                                                      // Only into an empty file system
+                success = false;
+            } catch (const std::runtime_error&) {
+                // Expected behavior
+            }
+
+            FileSystemImage image(file);
+            image.cd("docs");
+            if (image.size() != 9 || image.ls() != "util.cpp\nb/\na\n" || image.pwd() != "/docs/" || image.tree() != fs.tree()) {
+                success = false;
+            }
+            image.cd("../src/./lib/..");
+            if (image.pwd() != "/src/" || image.ls() != "lib/\nmain.cpp\n") {
+                success = false;
+            }
+            try {
+                image.cd("main.cpp");                                                   // A file, not a directory
+                success = false;
+            } catch (const std::runtime_error&) {
+                // Expected behavior, the current directory must not change
+            }
+            if (image.pwd() != "/src/" || image.find("util.cpp") != std::vector<std::string>{"/docs/util.cpp", "/src/lib/util.cpp"} ||
+                image.find("b") != std::vector<std::string>{"/docs/b/"} || image.find("missing").size() != 0) {
+                success = false;
+            }
+
+            std::ofstream damaged(file, std::ios::binary | std::ios::trunc);
+            damaged << "FSIMAGE";
+            damaged.close();
+            try {
+                FileSystemImage broken(file);
+                success = false;
+            } catch (const std::runtime_error&) {
+                // Expected behavior
+            }
+        } catch (const std::exception& e) {
+            success = false;
+        }
+        std::remove(file.c_str());
+        logTest("image save/load functionality", success, points);
+        return success;
+    }
+
+    bool testBatches(int points = 15) {
+        bool success = true;
+        const std::string file = "filesystem_test.journal";
+        std::remove(file.c_str());
+        try {
+            std::vector<BatchOperation> batch = {
+                {BatchOperation::MKDIR, "/b"},
+                {BatchOperation::TOUCH, "/b/x"},
+                {BatchOperation::MKDIR, "/b/c/d", true},
+                {BatchOperation::TOUCH, "/a/g"},
+                {BatchOperation::RM, "/a/f"},
+                {BatchOperation::TOUCH, "/a/f"},                                        // Same name again, now last in /a
+                {BatchOperation::MKDIR, "/e"},
+                {BatchOperation::TOUCH, "/e/gone"},
+                {BatchOperation::RM, "/e"},
+                {BatchOperation::TOUCH, "/b/c/y"},
+                {BatchOperation::RM, "/old"},
+            };
+            FileSystem fs;
+            FileSystem oneByOne;
+            for (FileSystem* target : {&fs, &oneByOne}) {
+                target->mkdir("/a/h", true);
+                target->touch("/a/f");
+                target->mkdir("/old/sub", true);
+            }
+            fs.openJournal(file);
+            fs.apply(batch);
+            oneByOne.mkdir("/b");
+            oneByOne.touch("/b/x");
+            oneByOne.mkdir("/b/c/d", true);
+            oneByOne.touch("/a/g");
+            oneByOne.rm("/a/f");
+            oneByOne.touch("/a/f");
+            oneByOne.touch("/b/c/y");
+            oneByOne.rm("/old");
+            if (fs.tree() != oneByOne.tree() || fs.find("gone") != nullptr || fs.findAll("f").size() != 1) {
+                success = false;
+            }
+
+            fs.cd("/b");
+            try {
+                fs.apply({{BatchOperation::MKDIR, "/new"}, {BatchOperation::RM, "x"}, {BatchOperation::TOUCH, "missing/z"}});
+                success = false;
+            } catch (const std::runtime_error&) {
+                // Expected behavior, nothing of the batch may remain
+            }
+            if (fs.tree() != oneByOne.tree()) {
+                success = false;
+            }
+            {
+                FileSystemSession other(fs);
+                other.cd("/b/c/d");
+                try {
+                    fs.apply({{BatchOperation::TOUCH, "z"}, {BatchOperation::RM, "/b/c"}});  // other is inside it
+                    success = false;
+                } catch (const std::runtime_error&) {
+                    // Expected behavior
+                }
+            }
+            fs.apply({{BatchOperation::TOUCH, "rel"}, {BatchOperation::RM, "c/"}});    // Relative to /b, journaled as absolute paths
+
+            std::ofstream torn(file, std::ios::binary | std::ios::app);                 // A crash in the middle of a record
+            torn.write("\x46\x53\x4a\x31\x40\x00", 6);
+            torn.close();
+            FileSystem recovered;
+            recovered.mkdir("/a/h", true);                                              // Same starting point as fs
+            recovered.touch("/a/f");
+            recovered.mkdir("/old/sub", true);
+            if (recovered.replayJournal(file) != 2 || recovered.tree() != fs.tree() || recovered.stat("/b/rel").isDirectory) {
+                success = false;
+            }
+            recovered.openJournal(file);                                                // Appends after the last good record
+            recovered.apply({{BatchOperation::MKDIR, "/later"}});
+            FileSystem again;
+            again.mkdir("/a/h", true);
+            again.touch("/a/f");
+            again.mkdir("/old/sub", true);
+            if (again.replayJournal(file) != 3 || again.tree() != recovered.tree()) {
+                success = false;
+            }
+
+            FileSystem full;                                                            // Every journal write fails
+            full.openJournal("/dev/full");
+            try {
+                full.apply({{BatchOperation::MKDIR, "/lost"}});
+                success = false;
+            } catch (const std::runtime_error&) {
+                // Expected behavior
+            }
+            if (full.ls() != "") {
+                success = false;
+            }
+        } catch (const std::exception& e) {
+            success = false;
+        }
+        std::remove(file.c_str());
+        logTest("batch and journal functionality", success, points);
+        return success;
+    }
+
+    bool testUsage(int points = 10) {
+        bool success = true;
+        const std::string file = "filesystem_test.img";
+        auto same = [](const DiskUsage& usage, uint64_t files, uint64_t directories, uint64_t bytes) {
+            return usage.files == files && usage.directories == directories && usage.bytes == bytes;
+        };
+        try {
+            FileSystem fs;
+            fs.mkdir("/q/a/b", true);
+            fs.touch("/q/a/f1");
+            fs.touch("/q/a/b/f2");
+            std::string data(100, 'x');
+            fs.write("/q/a/f1", 0, data.data(), 100);
+            fs.append("/q/a/b/f2", data.data(), 50);
+            fs.write("/q/a/f1", 20, data.data(), 30);                                  // Inside the file, no change in size
+            fs.truncate("/q/a/f1", 10);
+            if (!same(fs.du("/q"), 2, 3, 60) || !same(fs.du("/q/a/b/f2"), 1, 0, 50) || !same(fs.du("/"), 2, 4, 60)) {
+                success = false;
+            }
+
+            fs.rm("/q/a/b");
+            if (!same(fs.du("/q"), 1, 2, 10) || !same(fs.du("/"), 1, 3, 10)) {
+                success = false;
+            }
+            fs.apply({{BatchOperation::MKDIR, "/q/x/y", true}, {BatchOperation::TOUCH, "/q/x/y/z"}, {BatchOperation::RM, "/q/a/f1"}});
+            if (!same(fs.du("/q"), 1, 4, 0) || !same(fs.du("/q/x"), 1, 2, 0)) {
+                success = false;
+            }
+
+            fs.append("/q/x/y/z", data.data(), 7);
+            fs.save(file);
+            FileSystem loaded;
+            loaded.load(file);
+            if (!same(loaded.du("/"), 1, 5, 7) || !same(loaded.du("/q/x/y"), 1, 1, 7)) {
+                success = false;
+            }
+
+            std::vector<std::thread> threads;                                           // Changes from several sessions add up
+            for (int t = 0; t < 4; t++) {
+                threads.emplace_back([&fs, &data, t] {
+                    FileSystemSession session(fs);
+                    std::string dir = "/q/t" + std::to_string(t);
+                    session.mkdir(dir);
+                    for (int i = 0; i < 50; i++) {
+                        session.touch(dir + "/f" + std::to_string(i));
+                        session.append(dir + "/f" + std::to_string(i), data.data(), 2);
+                    }
+                    session.rm(dir + "/f0");
+                });
+            }
+            for (auto& thread : threads) {
+                thread.join();
+            }
+            if (!same(fs.du("/q"), 1 + 4 * 49, 8, 7 + 4 * 49 * 2)) {
+                success = false;
+            }
+            try {
+                fs.du("/missing");
+                success = false;
+            } catch (const std::runtime_error&) {
+                // Expected behavior
+            }
+        } catch (const std::exception& e) {
+            success = false;
+        }
+        std::remove(file.c_str());
+        logTest("du functionality", success, points);
+        return success;
+    }
+
+    bool testWalk(int points = 15) {
+        bool success = true;
+        try {
+            FileSystem fs;                                                              // Big enough to be walked by several threads
+            for (int d = 0; d < 20; d++) {
+                std::vector<BatchOperation> batch;
+                for (int s = 0; s < 10; s++) {
+                    std::string dir = "/w/d" + std::to_string(d) + "/s" + std::to_string(s);
+                    batch.emplace_back(BatchOperation::MKDIR, dir, true);
+                    for (int f = 0; f < 30; f++) {
+                        batch.emplace_back(BatchOperation::TOUCH, dir + "/f" + std::to_string(f));
+                    }
+                }
+                fs.apply(batch);
+            }
+            fs.mkdir("/deep/a/b/c/d/e", true);
+            fs.rm("/w/d3/s3/f3");                                                       // Leaves a hole
+            fs.append("/w/d1/s1/f1", "abc", 3);
+
+            DiskUsage usage = fs.du("/w");
+            std::atomic<size_t> seen(0);
+            std::atomic<size_t> splits(0);
+            WalkOptions options;
+            options.threads = 4;
+            options.onSplit = [&splits](size_t, size_t, size_t) { splits++; };
+            size_t visited = fs.traverse("/w", [&seen](const WalkEntry&) {
+                seen++;
+                return WalkAction::CONTINUE;
+            }, options);
+            if (visited != usage.files + usage.directories || seen != visited) {
+                success = false;
+            }
+
+            // Pruning every s3 skips its 30 files (29 under d3)
+            visited = fs.traverse("/w", [](const WalkEntry& entry) {
+                return entry.node->name == "s3" ? WalkAction::PRUNE : WalkAction::CONTINUE;
+            }, options);
+            if (visited != usage.files + usage.directories - (20 * 30 - 1)) {
+                success = false;
+            }
+            visited = fs.traverse("/w", [](const WalkEntry& entry) {
+                return entry.node->name == "f7" ? WalkAction::STOP : WalkAction::CONTINUE;
+            }, options);
+            if (visited >= usage.files + usage.directories) {
+                success = false;
+            }
+
+            // The parallel export is the sequential listing, whatever the split points were
+            for (size_t threads : {1, 2, 4, 8}) {
+                std::stringstream exported;
+                fs.exportTree("/", [&exported](const char* data, size_t length) {
+                    exported.write(data, length);
+                    return true;
+                }, ListOptions(), threads);
+                if (exported.str() != fs.tree()) {
+                    success = false;
+                }
+            }
+            ListOptions page;
+            page.maxDepth = 3;
+            page.offset = 100;
+            page.limit = 50;
+            std::stringstream expected, exported;
+            fs.tree(expected, page);
+            size_t written = fs.exportTree("/", [&exported](const char* data, size_t length) {
+                exported.write(data, length);
+                return true;
+            }, page, 4);
+            if (written != 50 || exported.str() != expected.str()) {
+                success = false;
+            }
+
+            std::vector<std::string> sequential = fs.primarySession().find("f7");
+            std::sort(sequential.begin(), sequential.end());
+            if (fs.findIn("/", "f7", 4) != sequential || sequential.size() != 200) {
+                success = false;
+            }
+            std::vector<std::string> matches = fs.findIn("/w/d1", "f1?", 4);      // f10..f19 in each of 10 directories
+            if (matches.size() != 100 || matches.front() != "/w/d1/s0/f10") {
+                success = false;
+            }
+            fs.cd("/deep/a");
+            if (fs.findIn(".", "?") != std::vector<std::string>{"/deep/a/", "/deep/a/b/", "/deep/a/b/c/", "/deep/a/b/c/d/", "/deep/a/b/c/d/e/"}) {
+                success = false;
+            }
+            fs.cd("/");
+
+            DiskUsage counted = fs.countIn("/w", "f1", 4);
+            if (counted.files != 200 || counted.directories != 0 || counted.bytes != 3 || fs.countIn("/w", "s*").directories != 200) {
+                success = false;
+            }
+            try {
+                fs.findIn("/missing", "*");
+                success = false;
+            } catch (const std::runtime_error&) {
+                // Expected behavior
+            }
+        } catch (const std::exception& e) {
+            success = false;
+        }
+        logTest("parallel walk functionality", success, points);
+        return success;
+    }
+
+    bool testServer(int points = 15) {
+        bool success = true;
+        try {
+            FileSystem fs;
+            FileSystemSession local(fs);
+            std::string path = "/tmp/filesystem_test_" + std::to_string(getpid()) + ".sock";
+            FileSystemServer server(fs, path, 2);
+            server.start();
+            {
+                FileSystemClient a(path), b(path);
+                a.mkdir("/srv/x", true);
+                a.cd("/srv");
+                b.cd("/srv/x");                                                         // Each connection has its own cwd
+                local.cd("/srv");
+                if (a.pwd() != local.pwd() || b.pwd() == a.pwd()) {
+                    success = false;
+                }
+
+                // Pipelined commands run in order, and a failure does not stop the rest
+                uint32_t first = a.queueTouch("f1");
+                a.queueMkdir("d1");
+                a.queueLs();
+                a.queueRm("missing");
+                a.queuePwd();
+                a.flush();
+                std::vector<CommandResponse> responses;
+                for (int i = 0; i < 5; i++) {
+                    responses.push_back(a.receive());
+                    if (responses.back().id != first + i) {
+                        success = false;
+                    }
+                }
+                if (responses[0].status != protocol::STATUS_OK || responses[2].text != local.ls() ||
+                    responses[3].status != protocol::STATUS_ERROR || responses[3].text.empty() ||
+                    responses[4].text != local.pwd()) {
+                    success = false;
+                }
+
+                b.touch("f1");
+                if (a.find("f1") != local.find("f1") || a.find("f1").size() != 2 || a.tree() != fs.tree()) {
+                    success = false;
+                }
+                try {
+                    b.cd("/missing");
+                    success = false;
+                } catch (const std::runtime_error&) {
+                    // Expected behavior
+                }
+                b.rm("/srv/x/f1");
+                if (!b.ls().empty()) {
+                    success = false;
+                }
+            }
+            server.stop();
+            ServiceStats stats = server.getStats();
+            if (stats.connections != 2 || stats.batches >= stats.commands) {
+                success = false;
+            }
+        } catch (const std::exception& e) {
+            success = false;
+        }
+        logTest("socket server functionality", success, points);
+        return success;
+    }
+
     void runTests() {
         std::cout << "Starting FileSystem Tests...\n\n";
         
@@ -234,13 +1195,27 @@ public:
         testLs(fs);       // 10 points
         testPwd(fs);      // 15 points
         testRm(fs);       // 25 points
+        testLargeDirectory(fs); // 10 points
+        testPaths(fs);    // 15 points
+        testFind(fs);     // 15 points
+        testStreaming();  // 10 points
+        testFileContents(fs); // 15 points
+        testSnapshots();  // 15 points
+        testSessions();   // 15 points
+        testPwdCache();   // 10 points
+        testReclaim();    // 10 points
+        testImages();     // 10 points
+        testBatches();    // 15 points
+        testUsage();      // 10 points
+        testWalk();       // 15 points
+        testServer();     // 15 points
         
         std::cout << testOutput.str() << "\n";
         std::cout << "Test Summary:\n";
         std::cout << "============\n";
         std::cout << "Total Tests: " << totalTests << "\n";
         std::cout << "Passed Tests: " << passedTests << "\n";
-        std::cout << "Total Score: " << totalScore << "/90 points\n";
+        std::cout << "Total Score: " << totalScore << "/" << maxScore << " points\n";
     }
 };
 
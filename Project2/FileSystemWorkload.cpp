@@ -0,0 +1,588 @@
+// FileSystemWorkload.cpp
+// Drives a FileSystem with a generated or recorded trace of shell-like operations and reports
+// per-operation latency percentiles, throughput, allocations and peak RSS as JSON.
+//
+// Usage: filesystem_workload [--shape wide|deep|skewed] [--nodes N] [--ops N] [--seed N]
+//                            [--save-trace FILE] [--replay FILE] [--output FILE]
+//
+// A run has two phases. build grows the tree to --nodes entries with mkdir/touch (and cd, in
+// the deep shape); mixed then runs --ops operations of cd/ls/pwd/find/mkdir/touch/rm against
+// it, choosing directories with a Zipf distribution so that a few of them are hot.
+//   wide:   4 directories sharing all the files
+//   deep:   chains 256 directories deep with 3 files on every level
+//   skewed: one directory per 100 nodes, file counts following a Zipf distribution
+// Traces are text with one operation per line ("touch /w0/f17", "ls"); a "phase <name>" line
+// starts each phase. They are generated and replayed as a stream, so the trace itself does
+// not add to the memory that is measured.
+#include "FileSystem.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <unistd.h>
+
+// Every allocation made through the global operator new, counted around each operation
+static std::atomic<uint64_t> allocations(0);
+static std::atomic<uint64_t> allocatedBytes(0);
+
+// Counts and makes one allocation. This and release are kept out of line (noipa) so GCC does not
+// see malloc and free through the replaced operators and warn that they mismatch new and delete.
+__attribute__((noipa)) static void* allocate(std::size_t size, std::size_t alignment) noexcept {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    if (size == 0) {
+        size = 1;
+    }
+    if (alignment <= alignof(std::max_align_t)) {
+        return std::malloc(size);
+    }
+    return std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+}
+
+__attribute__((noipa)) static void release(void* memory) noexcept { std::free(memory); }
+
+void* operator new(std::size_t size) {
+    void* memory = allocate(size, 0);
+    if (memory == nullptr) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    void* memory = allocate(size, static_cast<std::size_t>(alignment));
+    if (memory == nullptr) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return allocate(size, 0); }
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return allocate(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void* memory) noexcept { release(memory); }
+void operator delete(void* memory, std::size_t) noexcept { release(memory); }
+void operator delete(void* memory, std::align_val_t) noexcept { release(memory); }
+void operator delete(void* memory, std::size_t, std::align_val_t) noexcept { release(memory); }
+void operator delete(void* memory, const std::nothrow_t&) noexcept { release(memory); }
+void operator delete(void* memory, std::align_val_t, const std::nothrow_t&) noexcept { release(memory); }
+
+enum OpKind : uint8_t { MKDIR, TOUCH, CD, LS, RM, FIND, PWD, PHASE };
+
+static const size_t OP_KINDS = PHASE;
+static const char* const OP_NAMES[OP_KINDS] = {"mkdir", "touch", "cd", "ls", "rm", "find", "pwd"};
+
+struct TraceOp {
+    OpKind kind;
+    std::string argument;                               // Path, name to find or phase name; empty for ls/pwd
+};
+
+// Where the operations of a run come from
+class TraceSource {
+public:
+    virtual ~TraceSource() {}
+    virtual bool next(TraceOp& op) = 0;                 // false once the trace is over
+};
+
+// Samples ranks 0..n-1 with probability proportional to 1 / (rank + 1)
+class ZipfSampler {
+private:
+    std::vector<double> cumulative;
+
+public:
+    explicit ZipfSampler(size_t n) : cumulative(std::max<size_t>(n, 1)) {
+        double sum = 0;
+        for (size_t rank = 0; rank < cumulative.size(); rank++) {
+            sum += 1.0 / double(rank + 1);
+            cumulative[rank] = sum;
+        }
+    }
+
+    size_t operator()(std::mt19937_64& rng) const {
+        double target = std::uniform_real_distribution<double>(0, cumulative.back())(rng);
+        size_t rank = std::upper_bound(cumulative.begin(), cumulative.end(), target) - cumulative.begin();
+        return std::min(rank, cumulative.size() - 1);
+    }
+};
+
+// Generates the build and mixed phases of one of the shapes
+class WorkloadGenerator : public TraceSource {
+private:
+    enum Stage { BUILD_START, BUILD, MIXED_START, MIXED, DONE };
+
+    std::string shape;
+    uint64_t nodes;
+    uint64_t operations;
+    std::mt19937_64 rng;
+    Stage stage;
+    uint64_t created;                                   // Nodes the build phase has made so far
+    uint64_t files;                                     // Files f0.. made by the build phase
+    uint64_t issued;                                    // Operations of the mixed phase so far
+    uint64_t temporaries;
+    std::deque<TraceOp> queued;                         // Rest of a step that takes several operations
+    std::deque<std::string> removable;                  // Entries the mixed phase made, oldest first
+    std::unique_ptr<ZipfSampler> sampler;
+
+    // Shape parameters
+    static const uint64_t WIDE_DIRS = 4;
+    static const uint64_t DEEP_LEVELS = 256;
+    static const uint64_t DEEP_FILES_PER_LEVEL = 3;
+    static const uint64_t SKEWED_NODES_PER_DIR = 100;
+    static const uint64_t SKEWED_DIRS_PER_GROUP = 100;
+
+    uint64_t skewedDirs;
+    uint64_t skewedMade;                                // Directories /sG/dN made so far
+    uint64_t skewedGroups;                              // Group directories /sG made so far
+    uint64_t deepChains;                                // Chains started so far
+    uint64_t deepDepth;                                 // Directories in the current chain so far
+
+    std::string skewedDir(uint64_t dir) const {
+        return "/s" + std::to_string(dir / SKEWED_DIRS_PER_GROUP) + "/d" + std::to_string(dir);
+    }
+
+    // Number of directories the mixed phase can visit, and the path of each
+    uint64_t directoryCount() const {
+        if (shape == "wide") {
+            return WIDE_DIRS;
+        }
+        if (shape == "deep") {
+            return (deepChains - 1) * DEEP_LEVELS + deepDepth;
+        }
+        return skewedDirs;
+    }
+
+    std::string directoryPath(uint64_t dir) const {
+        if (shape == "wide") {
+            return "/w" + std::to_string(dir);
+        }
+        if (shape == "deep") {
+            std::string path = "/c" + std::to_string(dir / DEEP_LEVELS);
+            for (uint64_t level = dir % DEEP_LEVELS; level > 0; level--) {
+                path += "/d";
+            }
+            return path;
+        }
+        return skewedDir(dir);
+    }
+
+    void queue(OpKind kind, std::string argument) {
+        queued.push_back(TraceOp{kind, std::move(argument)});
+        if (kind == MKDIR || kind == TOUCH) {
+            created++;
+        }
+    }
+
+    std::string newFile() { return "f" + std::to_string(files++); }
+
+    // Queues the next step of the build phase
+    void buildStep() {
+        if (shape == "wide") {
+            if (created < WIDE_DIRS) {
+                queue(MKDIR, "/w" + std::to_string(created));
+            } else {
+                queue(TOUCH, "/w" + std::to_string(files % WIDE_DIRS) + "/" + newFile());
+            }
+        } else if (shape == "deep") {
+            if (deepChains == 0 || deepDepth == DEEP_LEVELS) {
+                std::string chain = "/c" + std::to_string(deepChains++);
+                deepDepth = 1;
+                queue(MKDIR, chain);
+                queue(CD, chain);
+            } else {
+                deepDepth++;
+                queue(MKDIR, "d");
+                queue(CD, "d");
+            }
+            for (uint64_t i = 0; i < DEEP_FILES_PER_LEVEL; i++) {
+                queue(TOUCH, newFile());
+            }
+        } else {
+            if (skewedMade < skewedDirs) {
+                if (skewedMade / SKEWED_DIRS_PER_GROUP == skewedGroups) {
+                    queue(MKDIR, "/s" + std::to_string(skewedGroups++));
+                }
+                queue(MKDIR, skewedDir(skewedMade++));
+            } else {
+                queue(TOUCH, skewedDir((*sampler)(rng)) + "/" + newFile());
+            }
+        }
+    }
+
+    // Queues one operation of the mixed phase
+    void mixedStep() {
+        std::string dir = directoryPath((*sampler)(rng) % directoryCount());
+        unsigned pick = rng() % 100;
+        if (pick < 20 || (pick < 45 && removable.empty())) {
+            std::string path = dir + "/t" + std::to_string(temporaries++);
+            removable.push_back(path);
+            queued.push_back(TraceOp{TOUCH, path});
+        } else if (pick < 25) {
+            std::string path = dir + "/m" + std::to_string(temporaries++);
+            removable.push_back(path);
+            queued.push_back(TraceOp{MKDIR, path});
+        } else if (pick < 45) {
+            queued.push_back(TraceOp{RM, removable.front()});
+            removable.pop_front();
+        } else if (pick < 60) {
+            queued.push_back(TraceOp{CD, dir});
+        } else if (pick < 70) {
+            queued.push_back(TraceOp{LS, ""});
+        } else if (pick < 80) {
+            queued.push_back(TraceOp{PWD, ""});
+        } else {
+            queued.push_back(TraceOp{FIND, "f" + std::to_string(files != 0 ? rng() % files : 0)});
+        }
+    }
+
+public:
+    WorkloadGenerator(const std::string& shape, uint64_t nodes, uint64_t operations, uint64_t seed)
+        : shape(shape), nodes(nodes), operations(operations), rng(seed), stage(BUILD_START), created(0), files(0),
+          issued(0), temporaries(0), skewedDirs(std::max<uint64_t>(1, nodes / SKEWED_NODES_PER_DIR)), skewedMade(0), skewedGroups(0),
+          deepChains(0), deepDepth(0) {
+        if (shape != "wide" && shape != "deep" && shape != "skewed") {
+            throw std::runtime_error("Unknown shape " + shape);
+        }
+        if (nodes < WIDE_DIRS) {
+            throw std::runtime_error("Too few nodes");
+        }
+        if (shape == "skewed") {
+            sampler.reset(new ZipfSampler(skewedDirs));
+        }
+    }
+
+    bool next(TraceOp& op) override {
+        while (queued.empty()) {
+            switch (stage) {
+            case BUILD_START:
+                op = TraceOp{PHASE, "build"};
+                stage = BUILD;
+                return true;
+            case BUILD:
+                if (created >= nodes) {
+                    stage = MIXED_START;
+                } else {
+                    buildStep();
+                }
+                break;
+            case MIXED_START:
+                if (!sampler || shape == "deep") {
+                    sampler.reset(new ZipfSampler(directoryCount()));
+                }
+                op = TraceOp{PHASE, "mixed"};
+                stage = MIXED;
+                return true;
+            case MIXED:
+                if (issued++ >= operations) {
+                    stage = DONE;
+                } else {
+                    mixedStep();
+                }
+                break;
+            case DONE:
+                return false;
+            }
+        }
+        op = std::move(queued.front());
+        queued.pop_front();
+        return true;
+    }
+};
+
+// Reads a trace written with --save-trace
+class TraceFile : public TraceSource {
+private:
+    std::ifstream in;
+    std::string line;
+    size_t lineNumber;
+
+public:
+    explicit TraceFile(const std::string& path) : in(path), lineNumber(0) {
+        if (!in) {
+            throw std::runtime_error("Cannot open trace " + path);
+        }
+    }
+
+    bool next(TraceOp& op) override {
+        while (std::getline(in, line)) {
+            lineNumber++;
+            if (line.empty()) {
+                continue;
+            }
+            size_t space = line.find(' ');
+            std::string name = line.substr(0, space);
+            op.argument = (space == std::string::npos) ? "" : line.substr(space + 1);
+            if (name == "phase") {
+                op.kind = PHASE;
+                return true;
+            }
+            size_t kind = std::find(OP_NAMES, OP_NAMES + OP_KINDS, name) - OP_NAMES;
+            if (kind == OP_KINDS) {
+                throw std::runtime_error("Bad trace line " + std::to_string(lineNumber));
+            }
+            op.kind = static_cast<OpKind>(kind);
+            return true;
+        }
+        return false;
+    }
+};
+
+struct PhaseStats {
+    std::string name;
+    std::vector<uint64_t> latencies[OP_KINDS];          // Nanoseconds, one per operation
+    uint64_t errors[OP_KINDS] = {};
+    uint64_t allocations = 0;
+    uint64_t allocatedBytes = 0;
+    double wallSeconds = 0;
+    size_t residentBytes = 0;
+};
+
+// Resident set size of the process, from /proc (Linux only; 0 elsewhere)
+static size_t residentBytes() {
+    std::ifstream statm("/proc/self/statm");
+    size_t pages = 0;
+    size_t resident = 0;
+    statm >> pages >> resident;
+    return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+static size_t peakResidentBytes() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<size_t>(usage.ru_maxrss) * 1024;                                             // Kilobytes on Linux
+}
+
+static const size_t LS_LIMIT = 1000;                    // ls shows a page, like ls | head
+
+// Runs one operation; returns false if the file system rejected it
+static bool execute(FileSystem& fs, const TraceOp& op) {
+    try {
+        switch (op.kind) {
+        case MKDIR:
+            fs.mkdir(op.argument);
+            break;
+        case TOUCH:
+            fs.touch(op.argument);
+            break;
+        case CD:
+            fs.cd(op.argument);
+            break;
+        case LS: {
+            ListOptions page;
+            page.limit = LS_LIMIT;
+            fs.ls([](const char*, size_t) { return true; }, page);
+            break;
+        }
+        case RM:
+            fs.rm(op.argument);
+            break;
+        case FIND:
+            fs.find(op.argument);
+            break;
+        case PWD:
+            fs.pwd();
+            break;
+        case PHASE:
+            break;
+        }
+    } catch (const std::runtime_error&) {
+        return false;
+    }
+    return true;
+}
+
+// Runs the trace on a new FileSystem; finalNodes is what the tree holds at the end
+static std::vector<PhaseStats> run(TraceSource& source, std::ostream* trace, uint64_t& finalNodes) {
+    std::vector<PhaseStats> phases;
+    FileSystem fs;
+    TraceOp op;
+    std::chrono::steady_clock::time_point phaseStart;
+    auto finish = [&phases, &phaseStart]() {
+        if (!phases.empty()) {
+            phases.back().wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - phaseStart).count();
+            phases.back().residentBytes = residentBytes();
+        }
+    };
+    while (source.next(op)) {
+        if (trace != nullptr) {
+            *trace << (op.kind == PHASE ? "phase" : OP_NAMES[op.kind]) << (op.argument.empty() ? "" : " ") << op.argument << '\n';
+        }
+        if (op.kind == PHASE) {
+            finish();
+            phases.emplace_back();
+            phases.back().name = op.argument;
+            phaseStart = std::chrono::steady_clock::now();
+            continue;
+        }
+        if (phases.empty()) {
+            phases.emplace_back();
+            phases.back().name = "trace";
+            phaseStart = std::chrono::steady_clock::now();
+        }
+        PhaseStats& phase = phases.back();
+        uint64_t allocationsBefore = allocations.load(std::memory_order_relaxed);
+        uint64_t bytesBefore = allocatedBytes.load(std::memory_order_relaxed);
+        auto start = std::chrono::steady_clock::now();
+        bool ok = execute(fs, op);
+        auto end = std::chrono::steady_clock::now();
+        phase.allocations += allocations.load(std::memory_order_relaxed) - allocationsBefore;
+        phase.allocatedBytes += allocatedBytes.load(std::memory_order_relaxed) - bytesBefore;
+        phase.latencies[op.kind].push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+        phase.errors[op.kind] += !ok;
+    }
+    finish();
+    DiskUsage usage = fs.du("/");
+    finalNodes = usage.files + usage.directories;
+    return phases;
+}
+
+static std::string jsonString(const std::string& text) {
+    std::string quoted = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+        }
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+static void writeReport(std::ostream& out, const std::string& shape, uint64_t nodes, uint64_t finalNodes, uint64_t seed,
+                        const std::string& trace, std::vector<PhaseStats>& phases) {
+    out << "{\n";
+    out << "  \"shape\": " << jsonString(shape) << ",\n";
+    out << "  \"nodes\": " << nodes << ",\n";
+    out << "  \"finalNodes\": " << finalNodes << ",\n";
+    out << "  \"seed\": " << seed << ",\n";
+    out << "  \"trace\": " << jsonString(trace) << ",\n";
+    out << "  \"peakResidentBytes\": " << peakResidentBytes() << ",\n";
+    out << "  \"phases\": [";
+    for (size_t p = 0; p < phases.size(); p++) {
+        PhaseStats& phase = phases[p];
+        uint64_t operations = 0;
+        uint64_t errors = 0;
+        uint64_t busy = 0;
+        for (size_t kind = 0; kind < OP_KINDS; kind++) {
+            operations += phase.latencies[kind].size();
+            errors += phase.errors[kind];
+            for (uint64_t latency : phase.latencies[kind]) {
+                busy += latency;
+            }
+        }
+        out << (p == 0 ? "\n" : ",\n") << "    {\n";
+        out << "      \"name\": " << jsonString(phase.name) << ",\n";
+        out << "      \"operations\": " << operations << ",\n";
+        out << "      \"errors\": " << errors << ",\n";
+        out << "      \"wallSeconds\": " << phase.wallSeconds << ",\n";
+        out << "      \"busySeconds\": " << busy * 1e-9 << ",\n";
+        out << "      \"opsPerSecond\": " << (busy != 0 ? operations * 1e9 / busy : 0) << ",\n";
+        out << "      \"allocations\": " << phase.allocations << ",\n";
+        out << "      \"allocatedBytes\": " << phase.allocatedBytes << ",\n";
+        out << "      \"residentBytes\": " << phase.residentBytes << ",\n";
+        out << "      \"latencyNs\": {";
+        bool first = true;
+        for (size_t kind = 0; kind < OP_KINDS; kind++) {
+            std::vector<uint64_t>& latencies = phase.latencies[kind];
+            if (latencies.empty()) {
+                continue;
+            }
+            std::sort(latencies.begin(), latencies.end());
+            auto percentile = [&latencies](double q) { return latencies[std::min(latencies.size() - 1, size_t(q * latencies.size()))]; };
+            uint64_t total = 0;
+            for (uint64_t latency : latencies) {
+                total += latency;
+            }
+            out << (first ? "\n" : ",\n") << "        " << jsonString(OP_NAMES[kind]) << ": {\"count\": " << latencies.size()
+                << ", \"errors\": " << phase.errors[kind] << ", \"opsPerSecond\": " << (total != 0 ? latencies.size() * 1e9 / total : 0)
+                << ", \"p50\": " << percentile(0.5) << ", \"p90\": " << percentile(0.9) << ", \"p99\": " << percentile(0.99)
+                << ", \"p999\": " << percentile(0.999) << ", \"max\": " << latencies.back() << "}";
+            first = false;
+        }
+        out << "\n      }\n    }";
+    }
+    out << "\n  ]\n}\n";
+}
+
+static int usage() {
+    std::cerr << "usage: filesystem_workload [--shape wide|deep|skewed] [--nodes N] [--ops N] [--seed N]\n"
+              << "                           [--save-trace FILE] [--replay FILE] [--output FILE]\n";
+    return 1;
+}
+
+int main(int argc, char* argv[]) {
+    std::string shape = "skewed";
+    uint64_t nodes = 100000;
+    uint64_t operations = 100000;
+    uint64_t seed = 1;
+    std::string saveTrace;
+    std::string replay;
+    std::string output;
+    for (int i = 1; i < argc; i++) {
+        std::string option = argv[i];
+        if (i + 1 >= argc) {
+            return usage();
+        }
+        std::string value = argv[++i];
+        if (option == "--shape") {
+            shape = value;
+        } else if (option == "--nodes") {
+            nodes = std::strtoull(value.c_str(), nullptr, 10);
+        } else if (option == "--ops") {
+            operations = std::strtoull(value.c_str(), nullptr, 10);
+        } else if (option == "--seed") {
+            seed = std::strtoull(value.c_str(), nullptr, 10);
+        } else if (option == "--save-trace") {
+            saveTrace = value;
+        } else if (option == "--replay") {
+            replay = value;
+        } else if (option == "--output") {
+            output = value;
+        } else {
+            return usage();
+        }
+    }
+
+    try {
+        std::unique_ptr<TraceSource> source;
+        if (!replay.empty()) {
+            source.reset(new TraceFile(replay));
+        } else {
+            source.reset(new WorkloadGenerator(shape, nodes, operations, seed));
+        }
+        std::ofstream traceFile;
+        if (!saveTrace.empty()) {
+            traceFile.open(saveTrace);
+            if (!traceFile) {
+                throw std::runtime_error("Cannot write trace " + saveTrace);
+            }
+        }
+        uint64_t finalNodes = 0;
+        std::vector<PhaseStats> phases = run(*source, saveTrace.empty() ? nullptr : &traceFile, finalNodes);
+        std::ofstream outputFile;
+        if (!output.empty()) {
+            outputFile.open(output);
+            if (!outputFile) {
+                throw std::runtime_error("Cannot write report " + output);
+            }
+        }
+        writeReport(output.empty() ? std::cout : outputFile, replay.empty() ? shape : "replay", replay.empty() ? nodes : 0, finalNodes,
+                    seed, replay.empty() ? "generated" : replay, phases);
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << "filesystem_workload: " << e.what() << "\n";
+        return 1;
+    }
+}
@@ -0,0 +1,98 @@
+// NameTable.cpp
+#include "NameTable.hpp"
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <algorithm>
+
+NameTable::NameTable() : shards(new Shard[SHARDS]) {}
+
+NameTable::~NameTable() {
+    for (size_t i = 0; i < SHARDS; i++) {
+        for (auto chunk : shards[i].chunks) {
+            delete[] chunk;
+        }
+    }
+}
+
+size_t NameTable::hashOf(std::string_view name) {
+    return std::hash<std::string_view>()(name);
+}
+
+// Returns the slot holding name, or the empty slot ending its probe sequence
+size_t NameTable::probe(const Shard& shard, std::string_view name, size_t hash) {
+    size_t mask = shard.table.size() - 1;
+    size_t i = (uint32_t(hash) >> 4) & mask;                                                        // Low bits picked the shard
+    while (shard.table[i].data != nullptr) {
+        const Slot& slot = shard.table[i];
+        if (slot.hash == uint32_t(hash) && slot.length == name.size() && std::memcmp(slot.data, name.data(), name.size()) == 0) {
+            break;
+        }
+        i = (i + 1) & mask;                                                                         // Linear probing
+    }
+    return i;
+}
+
+std::string_view NameTable::find(std::string_view name) const {
+    size_t hash = hashOf(name);
+    Shard& shard = shards[hash % SHARDS];
+    std::shared_lock<std::shared_mutex> guard(shard.lock);
+    if (shard.table.empty()) {
+        return std::string_view();
+    }
+    const Slot& slot = shard.table[probe(shard, name, hash)];
+    return std::string_view(slot.data, slot.length);                                                // Null data() when absent
+}
+
+// Returns the interned copy of name, copying it into the arena the first time it is seen
+std::string_view NameTable::intern(std::string_view name) {
+    size_t hash = hashOf(name);
+    Shard& shard = shards[hash % SHARDS];
+    std::unique_lock<std::shared_mutex> guard(shard.lock);
+    if ((shard.count + 1) * 2 > shard.table.size()) {                                               // Grow before probing, keeps the load under 1/2
+        std::vector<Slot> old(std::max<size_t>(shard.table.size() * 2, 64), Slot{nullptr, 0, 0});
+        old.swap(shard.table);
+        size_t mask = shard.table.size() - 1;
+        for (const Slot& slot : old) {
+            if (slot.data != nullptr) {
+                size_t i = (slot.hash >> 4) & mask;
+                while (shard.table[i].data != nullptr) {
+                    i = (i + 1) & mask;
+                }
+                shard.table[i] = slot;
+            }
+        }
+    }
+    size_t i = probe(shard, name, hash);
+    if (shard.table[i].data != nullptr) {
+        return std::string_view(shard.table[i].data, shard.table[i].length);
+    }
+
+    char* copy;
+    if (name.size() > CHUNK_SIZE / 4) {                                                             // Long names get a chunk of their own
+        copy = new char[name.size()];
+        shard.chunks.insert(shard.chunks.begin(), copy);                                            // Keeps chunks.back() the open chunk
+        shard.bytes += name.size();
+    } else {
+        if (shard.chunks.empty() || shard.chunkUsed + name.size() > CHUNK_SIZE) {
+            shard.chunks.push_back(new char[CHUNK_SIZE]);
+            shard.chunkUsed = 0;
+            shard.bytes += CHUNK_SIZE;
+        }
+        copy = shard.chunks.back() + shard.chunkUsed;
+        shard.chunkUsed += name.size();
+    }
+    std::memcpy(copy, name.data(), name.size());
+    shard.table[i] = Slot{copy, static_cast<uint32_t>(name.size()), uint32_t(hash)};
+    shard.count++;
+    return std::string_view(copy, name.size());
+}
+
+size_t NameTable::bytesReserved() const {
+    size_t total = 0;
+    for (size_t i = 0; i < SHARDS; i++) {
+        std::shared_lock<std::shared_mutex> guard(shards[i].lock);
+        total += shards[i].bytes;
+    }
+    return total;
+}
@@ -0,0 +1,55 @@
+// NameTable.hpp
+#ifndef NAMETABLE_HPP
+#define NAMETABLE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <string_view>
+#include <vector>
+
+// Interned node names. Every distinct name is copied once into an append-only arena, so a
+// node holds a view instead of its own std::string, and two interned names are equal exactly
+// when their data pointers are. Names stay interned for the life of the table, which costs
+// memory per distinct name ever used, not per node.
+class NameTable {
+private:
+    // Open-addressing slot; the hash and length are compared before the bytes
+    struct Slot {
+        const char* data;                               // nullptr when empty
+        uint32_t length;
+        uint32_t hash;
+    };
+
+    struct Shard {
+        std::shared_mutex lock;
+        std::vector<Slot> table;                        // Power-of-two size, at most half full
+        size_t count = 0;
+        std::vector<char*> chunks;
+        size_t chunkUsed = 0;                           // Bytes taken in chunks.back()
+        size_t bytes = 0;                               // Bytes reserved by chunks
+    };
+
+    static const size_t SHARDS = 16;
+    static const size_t CHUNK_SIZE = 64 * 1024;
+
+    std::unique_ptr<Shard[]> shards;
+
+    static size_t hashOf(std::string_view name);
+    static size_t probe(const Shard& shard, std::string_view name, size_t hash);
+
+public:
+    NameTable();
+    ~NameTable();
+
+    NameTable(const NameTable&) = delete;
+    NameTable& operator=(const NameTable&) = delete;
+
+    std::string_view find(std::string_view name) const;     // The interned copy, or a view with a null data() if none
+    std::string_view intern(std::string_view name);
+
+    size_t bytesReserved() const;
+};
+
+#endif // NAMETABLE_HPP
@@ -0,0 +1,62 @@
+// RWLock.hpp
+#ifndef RWLOCK_HPP
+#define RWLOCK_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+// Four-byte reader/writer lock, small enough to live in every FileSystemNode.
+// The state word holds the reader count plus a WRITER bit and a WAITING bit; a waiting
+// writer keeps new readers out so a steady stream of readers cannot starve it.
+// Contended callers yield instead of blocking in the kernel.
+class RWLock {
+private:
+    std::atomic<uint32_t> state;
+
+    static constexpr uint32_t WRITER = 1u << 31;
+    static constexpr uint32_t WAITING = 1u << 30;
+
+public:
+    RWLock() : state(0) {}
+
+    RWLock(const RWLock&) = delete;
+    RWLock& operator=(const RWLock&) = delete;
+
+    void lockShared() {
+        for (;;) {
+            uint32_t current = state.load(std::memory_order_relaxed);
+            if ((current & (WRITER | WAITING)) == 0 &&
+                state.compare_exchange_weak(current, current + 1, std::memory_order_acquire)) {
+                return;
+            }
+            std::this_thread::yield();
+        }
+    }
+
+    void unlockShared() {
+        state.fetch_sub(1, std::memory_order_release);
+    }
+
+    void lock() {
+        for (;;) {
+            uint32_t current = state.load(std::memory_order_relaxed);
+            if ((current & ~WAITING) == 0) {                                // No readers and no writer
+                if (state.compare_exchange_weak(current, WRITER, std::memory_order_acquire)) {
+                    return;                                                 // Also clears WAITING
+                }
+                continue;
+            }
+            if ((current & WAITING) == 0) {
+                state.compare_exchange_weak(current, current | WAITING, std::memory_order_relaxed);
+            }
+            std::this_thread::yield();
+        }
+    }
+
+    void unlock() {
+        state.fetch_and(~WRITER, std::memory_order_release);                // Keeps WAITING for the next writer
+    }
+};
+
+#endif // RWLOCK_HPP